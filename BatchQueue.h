@@ -0,0 +1,100 @@
+// Batch Queue: Filtered samples waiting for the batch characteristic, so the link only holds up the batches
+#ifndef __BATCH_QUEUE_H__
+#define __BATCH_QUEUE_H__
+#include <mbed.h>
+#include "SensorFrame.h"
+#include "SampleRing.h"
+#include "SampleBatch.h"
+
+// Filtered samples held while the bluetooth link catches up, must be a power of 2
+const uint32_t BATCH_QUEUE_LENGTH = 16;
+
+///BatchQueue///
+// The batch characteristic only goes as fast as the link, and not at all while nobody is connected
+// The sensor services drain their sample ring completely on every publish(), hand every sample to the
+// consumers of the raw stream (the sample hooks, the serial stream, gestures) and the cache, and only
+// the filtered samples for the batch characteristic wait here for the link
+// When the link falls behind for longer than the queue lasts, the newest sample is dropped and counted
+// The samples of a batch must be consecutive for a client to work out their times (see SampleBatch.h), so
+// the batch holding the samples before a drop is closed and the first sample after it starts the next one,
+// the gap shows in the timestamps of the batches. Nothing else is held up
+// add() and flush() are both called from the main loop
+class BatchQueue {
+public:
+    BatchQueue() :
+        Dropping(false), HavePending(false)
+    {
+    }
+
+    // Selects the encoding of the next batch, see SampleBatch::setEncoding()
+    void setEncoding(uint16_t Encoding)
+    {
+        Batch.setEncoding(Encoding);
+    }
+
+    /// add ///
+    // Queues a filtered sample for the batch, returns false and counts it if the queue is full
+    // The first sample queued after a drop is marked to start a new batch
+    bool add(const SensorSample &Sample)
+    {
+        QueuedSample Item;
+        Item.Sample   = Sample;
+        Item.AfterGap = Dropping;
+        Dropping = !Queue.push(Item);
+        return !Dropping;
+    }
+
+    /// flush ///
+    // Fills batches from the queue and hands each one to Send once it is full, or part filled and due at Now
+    // Send notifies the batch and returns false if it must be tried again later, the batch and the sample that
+    // did not fit wait for the next call. Once Send returns true the batch is emptied, sent or not
+    void flush(uint32_t Now, const Callback<bool(const SampleBatch &)> &Send)
+    {
+        while (true) {
+            if (Batch.full() || (!HavePending && Queue.empty() && Batch.due(Now))) {
+                if (!Send(Batch)) {
+                    return;
+                }
+                Batch.clear();
+            }
+            if (!HavePending) {
+                if (!Queue.pop(Pending)) {
+                    return;
+                }
+                HavePending = true;
+            }
+            // A delta encoded sample may not fit in what is left of the batch, and a sample after a drop must
+            // not share a batch with the ones before it, send the batch and start another
+            if ((Pending.AfterGap && !Batch.empty()) || !Batch.append(Pending.Sample)) {
+                if (!Send(Batch)) {
+                    return;
+                }
+                Batch.clear();
+                continue;
+            }
+            HavePending = false;
+        }
+    }
+
+    // Filtered samples left out of the batch characteristic because the link fell behind
+    uint32_t dropped() const {
+        return Queue.overruns();
+    }
+
+private:
+    // A queued sample and whether samples were dropped just before it
+    struct QueuedSample {
+        SensorSample Sample;
+        bool AfterGap;
+    };
+
+    SampleRing<QueuedSample, BATCH_QUEUE_LENGTH> Queue;
+    SampleBatch Batch;
+    // True while add() is dropping samples, the next one queued is marked AfterGap
+    bool Dropping;
+    // A sample taken off the queue that did not fit in the batch, it goes in the next one
+    QueuedSample Pending;
+    bool HavePending;
+};
+
+#endif /* #ifndef __BATCH_QUEUE_H__ */
@@ -1,5 +1,6 @@
 #ifndef __BUTTONA_SERVICE_H__
 #define __BUTTONA_SERVICE_H__
+#include "DeadbandPublisher.h"
 // Button A is on P0 bit 17 
 volatile uint32_t * P0OUT = (uint32_t *)0x50000504;
 volatile uint32_t * P0DIR = (uint32_t *)0x50000514;
@@ -35,7 +36,6 @@ public:
         
         // On power up, input buffer is not connected so must do this
         P0CONF[17] = 0;  
-        PreviousButtonState = -1;
     }
     
     // Get the value of ButtonState handle 
@@ -50,13 +50,9 @@ public:
         // First get the state of the button 
         uint8_t newValue = GetButtonAState();
         
-        //Only notify if there is a new button state 
-        if (newValue != PreviousButtonState) 
-        {   
-            // only send an update if the button state has changed (reduces traffic)
-            ble.gattServer().write(this->getValueHandle(), (uint8_t *)&newValue, sizeof(uint8_t));        
-            PreviousButtonState = newValue;
-        }
+        // Only notify if there is a new button state (reduces traffic), PublishState remembers the 
+        // last state sent, the first state is always sent 
+        PublishState.publish(ble, this->getValueHandle(), newValue, us_ticker_read());
     }
     /// GetButtonAState ///
     // Returns the state of button A by setting up a mask for pin 17 
@@ -73,7 +69,7 @@ public:
 private:
     BLEDevice  &ble;
     ReadOnlyGattCharacteristic<int8_t>  ButtonState;
-    uint8_t PreviousButtonState;
+    DeadbandPublisher<uint8_t> PublishState;
     
 };
 
@@ -0,0 +1,73 @@
+// Deadband Publisher: Only writes a characteristic when its value has really changed
+#ifndef __DEADBAND_PUBLISHER_H__
+#define __DEADBAND_PUBLISHER_H__
+#include <mbed.h>
+#include "ble/BLE.h"
+
+///DeadbandPublisher///
+// Works the same way as ButtonAService::poll(), the characteristic is only written when the value is new,
+// but a value only counts as new once it is more than Threshold away from the last value written
+// Comparing against the last value written rather than the last value seen gives hysteresis, noise
+// around a still value never gets through while a slow drift is still published once it adds up
+// Threshold    - 0 writes every change, otherwise the change has to be larger than this
+// MaxSilenceUs - The value is written anyway once this long has passed since the last write so a client
+//                can tell the board is still there, 0 never forces a write
+// One DeadbandPublisher is needed for each characteristic, T is the type of its value
+template <typename T>
+class DeadbandPublisher {
+public:
+    DeadbandPublisher(T _Threshold = 0, uint32_t _MaxSilenceUs = 0) :
+        Threshold(_Threshold), MaxSilenceUs(_MaxSilenceUs), Last(0), LastTime(0), Published(false)
+    {
+    }
+
+    /// configure ///
+    // Changes the threshold and the longest silence, takes effect from the next publish()
+    void configure(T NewThreshold, uint32_t NewMaxSilenceUs)
+    {
+        Threshold    = NewThreshold;
+        MaxSilenceUs = NewMaxSilenceUs;
+    }
+
+    /// publish ///
+    // Writes Value to the characteristic Handle if it has moved past the threshold or the characteristic
+    // has been silent too long, Now is the time from us_ticker_read()
+    // Returns true if the value was written. If the bluetooth stack is out of buffers nothing is
+    // remembered and the next value is compared against the last one that did get written
+    bool publish(BLEDevice &ble, GattAttribute::Handle_t Handle, T Value, uint32_t Now)
+    {
+        if (Published && !moved(Value) && !silent(Now)){
+            return false;
+            }
+        if (ble.gattServer().write(Handle, (uint8_t *)&Value, sizeof(T)) == BLE_STACK_BUSY){
+            return false;
+            }
+        Last      = Value;
+        LastTime  = Now;
+        Published = true;
+        return true;
+    }
+
+private:
+    // True if Value is more than Threshold away from the last value written
+    bool moved(T Value) const {
+        int32_t Difference = (int32_t)Value - (int32_t)Last;
+        if (Difference < 0){
+            Difference = -Difference;
+            }
+        return Difference > (int32_t)Threshold;
+    }
+
+    // True if the characteristic has gone without a write for MaxSilenceUs
+    bool silent(uint32_t Now) const {
+        return (MaxSilenceUs != 0) && ((Now - LastTime) >= MaxSilenceUs);
+    }
+
+    T Threshold;
+    uint32_t MaxSilenceUs;
+    T Last;
+    uint32_t LastTime;
+    bool Published;
+};
+
+#endif /* #ifndef __DEADBAND_PUBLISHER_H__ */
@@ -0,0 +1,229 @@
+// Diagnostics: Reports the i2c bus counters and latency histograms kept by i2cQueue, see I2CStats.h,
+// and the samples the sensor services have lost
+#ifndef __BLE_DIAGNOSTICS_SERVICE_H__
+#define __BLE_DIAGNOSTICS_SERVICE_H__
+#include <mbed.h>
+#include "I2CStats.h"
+
+// Time between diagnostics notifications, each one carries one record
+const uint32_t DIAGNOSTICS_PERIOD_US = 1000000;
+
+// Diagnostics records, the first byte says which one it is and the second is the 7 bit device address
+// All of the numbers are little endian, 16 bit ones stop at 65535 rather than wrapping
+// DIAGNOSTICS_RECORD_COUNTERS  - Transactions (uint32), Bytes (uint32), Nacks, Retries, Failures, MaxUs (uint16 each)
+//                                and the bus load of the device since its last counters record in tenths of a percent (uint16)
+// DIAGNOSTICS_RECORD_HISTOGRAM - Transactions in each of the I2C_STATS_BUCKETS latency buckets (uint16 each)
+// DIAGNOSTICS_RECORD_SAMPLES   - Samples of the sensor at the address dropped because the main loop fell behind the
+//                                sensor (uint32) and filtered samples left out of the batch characteristic because
+//                                the link fell behind (uint32), since the counters were last cleared
+const uint8_t DIAGNOSTICS_RECORD_COUNTERS  = 0;
+const uint8_t DIAGNOSTICS_RECORD_HISTOGRAM = 1;
+const uint8_t DIAGNOSTICS_RECORD_SAMPLES   = 2;
+const int DIAGNOSTICS_COUNTERS_LENGTH  = 20;
+const int DIAGNOSTICS_HISTOGRAM_LENGTH = 2 + I2C_STATS_BUCKETS * 2;
+const int DIAGNOSTICS_SAMPLES_LENGTH   = 10;
+const int DIAGNOSTICS_MAX_LENGTH       = 20;
+
+// Number of sensor services whose lost samples can be reported, see watchSensor()
+const int DIAGNOSTICS_MAX_SENSORS = 2;
+
+///DiagnosticsService///
+// Lets a client see when the i2c bus is the bottleneck without a serial cable
+// The stats of every device on the bus take more than one notification, so every DIAGNOSTICS_PERIOD_US
+// the next record is notified in turn, the counters of the first device, then its histogram, then the
+// counters of the next device and so on, then the samples record of each sensor service
+// Reading the characteristic returns the last record sent
+// Writing anything to the characteristic clears the counters, the lost samples count again from zero
+// The same stats and the lost samples are printed on the serial console by pressing i
+class DiagnosticsService {
+public:
+    //Universal Unique Identification numbers for the diagnostics//
+    //The diagnostics service has a UUID of 0xA01C
+    //UUID I2C Characteristic - 0xA01D, one counters, histogram or samples record per notification, see above
+    const static uint16_t DIAGNOSTICS_SERVICE_UUID = 0xA01C;
+    const static uint16_t DIAGNOSTICS_I2C_CHARACTERISTIC_UUID = 0xA01D;
+
+    ///DiagnosticsService Constructor///
+    // Will create the diagnostics service for bluetooth profile, Stats is the one kept by the i2c queue
+    DiagnosticsService(BLEDevice &_ble, I2CStats &_Stats) :
+        ble(_ble), Stats(_Stats),
+        I2CDiagnostics(DIAGNOSTICS_I2C_CHARACTERISTIC_UUID, Record, 0, DIAGNOSTICS_MAX_LENGTH,
+                       GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+                       GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE),
+        LastRecordUs(us_ticker_read()), NextRecord(0), SensorCount(0), ResetRequested(false)
+    {
+        for (int i = 0; i < I2C_STATS_MAX_DEVICES; i++){
+            LastTotalUs[i] = 0;
+            LastLoadUs[i]  = LastRecordUs;
+            }
+
+        // Assign the gatt characteristics to a GattCharacteristic instance
+        GattCharacteristic *charTable[] = {&I2CDiagnostics};
+        // Create an instance of a service for the diagnostics and associate the characteristic with it
+        GattService         diagnosticsService(DIAGNOSTICS_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+        // Add the service to the ble profile
+        ble.addService(diagnosticsService);
+    }
+
+    GattAttribute::Handle_t getValueHandle() const {
+        return I2CDiagnostics.getValueHandle();
+    }
+
+    /// watchSensor ///
+    // Adds a samples record for the sensor at the 7 bit Address, Overruns and BatchDrops return the running
+    // totals of its service, see ACCELService::Overruns() and ACCELService::BatchDrops()
+    void watchSensor(uint8_t Address, Callback<uint32_t()> Overruns, Callback<uint32_t()> BatchDrops)
+    {
+        if (SensorCount == DIAGNOSTICS_MAX_SENSORS){
+            return;
+            }
+        SensorCounters &Sensor = Sensors[SensorCount++];
+        Sensor.Address        = Address;
+        Sensor.Overruns       = Overruns;
+        Sensor.BatchDrops     = BatchDrops;
+        Sensor.BaseOverruns   = Overruns();
+        Sensor.BaseBatchDrops = BatchDrops();
+    }
+
+    /// onDataWritten ///
+    // Called when a client writes to any characteristic, returns true if it was the diagnostics characteristic
+    // The counters are cleared when the main loop next calls update()
+    bool onDataWritten(const GattWriteCallbackParams *params)
+    {
+        if (params->handle != I2CDiagnostics.getValueHandle()){
+            return false;
+            }
+        ResetRequested = true;
+        return true;
+    }
+
+    /// update ///
+    // Called from the main loop, notifies the next record once DIAGNOSTICS_PERIOD_US has passed
+    // Nothing is sent until the bus has been used
+    void update()
+    {
+        uint32_t Now = us_ticker_read();
+        if (ResetRequested){
+            ResetRequested = false;
+            Stats.reset(Now);
+            for (int i = 0; i < I2C_STATS_MAX_DEVICES; i++){
+                LastTotalUs[i] = 0;
+                LastLoadUs[i]  = Now;
+                }
+            for (int i = 0; i < SensorCount; i++){
+                Sensors[i].BaseOverruns   = Sensors[i].Overruns();
+                Sensors[i].BaseBatchDrops = Sensors[i].BatchDrops();
+                }
+            NextRecord = 0;
+            }
+        if (((Now - LastRecordUs) < DIAGNOSTICS_PERIOD_US) || (Stats.count() == 0)){
+            return;
+            }
+        LastRecordUs = Now;
+
+        // Two records per device, counters then histogram, then one per sensor service
+        int DeviceRecords = Stats.count() * 2;
+        if (NextRecord >= (DeviceRecords + SensorCount)){
+            NextRecord = 0;
+            }
+        int Length;
+        if (NextRecord >= DeviceRecords){
+            Length = samples(Sensors[NextRecord - DeviceRecords]);
+            }
+        else if ((NextRecord % 2) == 0){
+            Length = counters(NextRecord / 2, Stats.device(NextRecord / 2), Now);
+            }
+        else{
+            Length = histogram(Stats.device(NextRecord / 2));
+            }
+        NextRecord++;
+        ble.gattServer().write(I2CDiagnostics.getValueHandle(), Record, Length);
+    }
+
+//Private variables
+private:
+    // Fills Record with the counters of device Index, returns its length
+    int counters(int Index, const I2CDeviceStats &Device, uint32_t Now)
+    {
+        uint32_t Elapsed = Now - LastLoadUs[Index];
+        uint32_t Busy    = Device.TotalUs - LastTotalUs[Index];
+        uint32_t Load    = (Elapsed != 0) ? (uint32_t)(((uint64_t)Busy * 1000) / Elapsed) : 0;
+        LastTotalUs[Index] = Device.TotalUs;
+        LastLoadUs[Index]  = Now;
+
+        Record[0] = DIAGNOSTICS_RECORD_COUNTERS;
+        Record[1] = Device.Address >> 1;
+        put32(&Record[2], Device.Transactions);
+        put32(&Record[6], Device.Bytes);
+        put16(&Record[10], Device.Nacks);
+        put16(&Record[12], Device.Retries);
+        put16(&Record[14], Device.Failures);
+        put16(&Record[16], Device.MaxUs);
+        put16(&Record[18], Load);
+        return DIAGNOSTICS_COUNTERS_LENGTH;
+    }
+
+    // Fills Record with the latency histogram of Device, returns its length
+    int histogram(const I2CDeviceStats &Device)
+    {
+        Record[0] = DIAGNOSTICS_RECORD_HISTOGRAM;
+        Record[1] = Device.Address >> 1;
+        for (int b = 0; b < I2C_STATS_BUCKETS; b++){
+            put16(&Record[2 + b * 2], Device.Histogram[b]);
+            }
+        return DIAGNOSTICS_HISTOGRAM_LENGTH;
+    }
+
+    // Where the running totals of a sensor service come from and what they were when the counters were cleared
+    struct SensorCounters {
+        uint8_t Address;
+        Callback<uint32_t()> Overruns;
+        Callback<uint32_t()> BatchDrops;
+        uint32_t BaseOverruns;
+        uint32_t BaseBatchDrops;
+    };
+
+    // Fills Record with the samples lost by Sensor, returns its length
+    int samples(const SensorCounters &Sensor)
+    {
+        Record[0] = DIAGNOSTICS_RECORD_SAMPLES;
+        Record[1] = Sensor.Address;
+        put32(&Record[2], Sensor.Overruns() - Sensor.BaseOverruns);
+        put32(&Record[6], Sensor.BatchDrops() - Sensor.BaseBatchDrops);
+        return DIAGNOSTICS_SAMPLES_LENGTH;
+    }
+
+    static void put32(uint8_t *Data, uint32_t Value)
+    {
+        Data[0] = Value;
+        Data[1] = Value >> 8;
+        Data[2] = Value >> 16;
+        Data[3] = Value >> 24;
+    }
+
+    // Stops at 65535 rather than wrapping
+    static void put16(uint8_t *Data, uint32_t Value)
+    {
+        if (Value > 0xffff){
+            Value = 0xffff;
+            }
+        Data[0] = Value;
+        Data[1] = Value >> 8;
+    }
+
+    BLEDevice &ble;
+    I2CStats &Stats;
+    uint8_t Record[DIAGNOSTICS_MAX_LENGTH];
+    GattCharacteristic I2CDiagnostics;
+    uint32_t LastRecordUs;
+    int NextRecord;
+    // TotalUs of each device and the time at its last counters record, for the bus load
+    uint32_t LastTotalUs[I2C_STATS_MAX_DEVICES];
+    uint32_t LastLoadUs[I2C_STATS_MAX_DEVICES];
+    SensorCounters Sensors[DIAGNOSTICS_MAX_SENSORS];
+    int SensorCount;
+    volatile bool ResetRequested;
+
+};
+
+#endif /* #ifndef __BLE_DIAGNOSTICS_SERVICE_H__ */
@@ -0,0 +1,275 @@
+// Display: Lets a client draw on the 5x5 LED display, single frames or short animations, see LEDMatrix.h
+#ifndef __BLE_DISPLAY_SERVICE_H__
+#define __BLE_DISPLAY_SERVICE_H__
+#include <mbed.h>
+#include "LEDMatrix.h"
+#include "LEDText.h"
+
+// Commands written to the command characteristic, the first byte says which one it is, little endian
+// DISPLAY_COMMAND_ARROW      - Hands the display back to the tilt arrow, stops any animation
+// DISPLAY_COMMAND_FRAME      - A byte per row from the top, bit 4 the left hand LED, as in LEDFrame (5 bytes)
+// DISPLAY_COMMAND_GREY_FRAME - The level of every pixel from the top left, 0 to LED_MATRIX_MAX_LEVEL, two to
+//                              a byte with the first in the high nibble (13 bytes, the last low nibble unused)
+// DISPLAY_COMMAND_LOAD       - The index of the first animation frame to load, then one to three frames laid
+//                              out as in DISPLAY_COMMAND_FRAME (6 to 16 bytes)
+// DISPLAY_COMMAND_PLAY       - Plays the first Count (uint8) loaded frames, PeriodMs (uint16) each, then
+//                              Loop (uint8), 1 to start again after the last frame, 0 to stop on it (4 bytes)
+// DISPLAY_COMMAND_BRIGHTNESS - Brightness of the whole display, 0 to LED_MATRIX_MAX_BRIGHTNESS (1 byte)
+// DISPLAY_COMMAND_TEXT       - Scrolls text across the display, PeriodMs (uint16) per column, Loop (uint8) as in
+//                              DISPLAY_COMMAND_PLAY, then 1 to 16 ASCII characters (5 to 20 bytes)
+// A command of the wrong length or out of range is ignored
+const uint8_t DISPLAY_COMMAND_ARROW      = 0;
+const uint8_t DISPLAY_COMMAND_FRAME      = 1;
+const uint8_t DISPLAY_COMMAND_GREY_FRAME = 2;
+const uint8_t DISPLAY_COMMAND_LOAD       = 3;
+const uint8_t DISPLAY_COMMAND_PLAY       = 4;
+const uint8_t DISPLAY_COMMAND_BRIGHTNESS = 5;
+const uint8_t DISPLAY_COMMAND_TEXT       = 6;
+const int DISPLAY_GREY_FRAME_LENGTH = (LED_MATRIX_SIZE * LED_MATRIX_SIZE + 1) / 2;
+const int DISPLAY_MAX_LENGTH        = 20;
+
+// Frames an animation can have, 5 bytes of RAM each
+const int DISPLAY_MAX_FRAMES = 16;
+// Frames a single DISPLAY_COMMAND_LOAD can carry in one 20 byte write
+const int DISPLAY_LOAD_FRAMES = 3;
+// Shortest time a frame of an animation is shown, a few refreshes of the display
+const uint16_t DISPLAY_MIN_PERIOD_MS = 20;
+// Time each column of scrolling text is shown when the firmware does not say
+const uint16_t DISPLAY_TEXT_PERIOD_MS = 120;
+
+// Who is drawing on the display
+const uint8_t DISPLAY_MODE_ARROW     = 0;
+const uint8_t DISPLAY_MODE_FRAME     = 1;
+const uint8_t DISPLAY_MODE_ANIMATION = 2;
+const uint8_t DISPLAY_MODE_TEXT      = 3;
+
+///DisplayService///
+// The LED service only turns one LED on and off, this one lets a client draw the whole display
+// The command characteristic takes writes without response, so a client can send a frame per connection
+// event without waiting for an answer to each one. Every frame goes to LEDMatrix::show(), which puts it into
+// the back buffer of the display, the refresh swaps it in as it starts on the top row so a frame streamed at
+// the rate of the link is never lit half over the last one
+// Longer sequences are loaded into the animation buffer a few frames per write and then played by a ticker,
+// so their timing does not depend on the link at all. Text is scrolled by the same ticker, see LEDText.h
+// Once a client has drawn something the tilt arrow is left off until it sends DISPLAY_COMMAND_ARROW or
+// disconnects, main.cpp asks active() before drawing the arrow. Text that is not looped hands the display
+// back by itself once it has scrolled off
+// The commands are run straight from the write callback, none of them does more than copy a few bytes and
+// work out the masks of one frame
+class DisplayService {
+public:
+    //Universal Unique Identification numbers for the display//
+    //The display service has a UUID of 0xA02A
+    //UUID Command Characteristic - 0xA02B, write (with or without response) the commands above
+    const static uint16_t DISPLAY_SERVICE_UUID = 0xA02A;
+    const static uint16_t DISPLAY_COMMAND_CHARACTERISTIC_UUID = 0xA02B;
+
+    ///DisplayService Constructor///
+    // Will create the display service for bluetooth profile, Matrix is the LED display it draws on
+    DisplayService(BLEDevice &_ble, LEDMatrix &_Matrix) :
+        ble(_ble), Matrix(_Matrix),
+        CommandCharacteristic(DISPLAY_COMMAND_CHARACTERISTIC_UUID, Command, 0, DISPLAY_MAX_LENGTH,
+                              GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE |
+                              GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE),
+        Mode(DISPLAY_MODE_ARROW), FrameCount(0), FrameIndex(0), Loop(false)
+    {
+        memset(Command, 0, DISPLAY_MAX_LENGTH);
+        memset(Frames, 0, sizeof(Frames));
+
+        // Assign the gatt characteristics to a GattCharacteristic instance
+        GattCharacteristic *charTable[] = {&CommandCharacteristic};
+        // Create an instance of a service for the display and associate the characteristic with it
+        GattService         displayService(DISPLAY_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+        // Add the service to the ble profile
+        ble.addService(displayService);
+    }
+
+    /// onDataWritten ///
+    // Called when a client writes to any characteristic, returns true if it was the command characteristic
+    bool onDataWritten(const GattWriteCallbackParams *params)
+    {
+        if (params->handle != CommandCharacteristic.getValueHandle()){
+            return false;
+            }
+        if (params->len > 0){
+            run(params->data, params->len);
+            }
+        return true;
+    }
+
+    /// active ///
+    // True while a client is drawing on the display and the arrow must be left off
+    bool active() const {
+        return Mode != DISPLAY_MODE_ARROW;
+    }
+
+    /// scroll ///
+    // Scrolls the zero terminated Characters across the display, for the firmware to put up a message of its own
+    // They are laid out straight away, the string does not have to stay around while it scrolls
+    void scroll(const char *Characters, bool Repeat, uint16_t PeriodMs = DISPLAY_TEXT_PERIOD_MS)
+    {
+        scroll(Characters, LED_TEXT_MAX_COLUMNS, Repeat, PeriodMs);
+    }
+
+    /// release ///
+    // Stops the animation and hands the display back to the arrow at full brightness, called on a disconnect
+    // The display is blanked until the arrow is next drawn
+    void release()
+    {
+        Player.detach();
+        Mode = DISPLAY_MODE_ARROW;
+        Matrix.brightness(LED_MATRIX_MAX_BRIGHTNESS);
+        Matrix.show(LED_FRAME_BLANK);
+    }
+
+//Private variables
+private:
+    void run(const uint8_t *Data, uint16_t Length)
+    {
+        switch (Data[0]){
+            case DISPLAY_COMMAND_ARROW:
+                release();
+                break;
+            case DISPLAY_COMMAND_FRAME:
+                if (Length == 1 + LED_MATRIX_SIZE){
+                    LEDFrame Frame;
+                    memcpy(Frame.Rows, &Data[1], LED_MATRIX_SIZE);
+                    draw(LEDMatrixMasks(Frame));
+                    }
+                break;
+            case DISPLAY_COMMAND_GREY_FRAME:
+                if (Length == 1 + DISPLAY_GREY_FRAME_LENGTH){
+                    LEDGreyFrame Frame;
+                    for (int i = 0; i < LED_MATRIX_SIZE * LED_MATRIX_SIZE; i++){
+                        uint8_t Pair = Data[1 + i / 2];
+                        Frame.Pixels[i / LED_MATRIX_SIZE][i % LED_MATRIX_SIZE] = (i & 1) ? (Pair & 0x0f) : (Pair >> 4);
+                        }
+                    draw(LEDMatrixGreyMasks(Frame));
+                    }
+                break;
+            case DISPLAY_COMMAND_LOAD:
+                load(Data, Length);
+                break;
+            case DISPLAY_COMMAND_PLAY:
+                if (Length == 5){
+                    play(Data[1], Data[2] | (Data[3] << 8), Data[4] != 0);
+                    }
+                break;
+            case DISPLAY_COMMAND_BRIGHTNESS:
+                if (Length == 2){
+                    Matrix.brightness(Data[1]);
+                    }
+                break;
+            case DISPLAY_COMMAND_TEXT:
+                if (Length > 4){
+                    scroll((const char *)&Data[4], Length - 4, Data[3] != 0, Data[1] | (Data[2] << 8));
+                    }
+                break;
+            default:
+                break;
+            }
+    }
+
+    // Shows a single frame, stopping any animation
+    void draw(const LEDMasks &Masks)
+    {
+        Player.detach();
+        Mode = DISPLAY_MODE_FRAME;
+        Matrix.show(Masks);
+    }
+
+    // Copies the frames of a DISPLAY_COMMAND_LOAD into the animation buffer
+    // Frames can be loaded while an animation plays, the ticker picks them up when it gets to them
+    void load(const uint8_t *Data, uint16_t Length)
+    {
+        if ((Length < 2) || (((Length - 2) % LED_MATRIX_SIZE) != 0)){
+            return;
+            }
+        int First = Data[1];
+        int Count = (Length - 2) / LED_MATRIX_SIZE;
+        if ((Count < 1) || (Count > DISPLAY_LOAD_FRAMES) || ((First + Count) > DISPLAY_MAX_FRAMES)){
+            return;
+            }
+        // Not torn by the ticker reading the frame it is about to show
+        core_util_critical_section_enter();
+        memcpy(Frames[First].Rows, &Data[2], Count * LED_MATRIX_SIZE);
+        core_util_critical_section_exit();
+    }
+
+    void play(uint8_t Count, uint16_t PeriodMs, bool Repeat)
+    {
+        if ((Count < 1) || (Count > DISPLAY_MAX_FRAMES) || (PeriodMs < DISPLAY_MIN_PERIOD_MS)){
+            return;
+            }
+        Player.detach();
+        FrameCount = Count;
+        FrameIndex = 0;
+        Loop       = Repeat;
+        Mode       = DISPLAY_MODE_ANIMATION;
+        step();
+        if ((Count > 1) || Repeat){
+            Player.attach_us(callback(this, &DisplayService::step), (uint32_t)PeriodMs * 1000);
+            }
+    }
+
+    void scroll(const char *Characters, int Count, bool Repeat, uint16_t PeriodMs)
+    {
+        if (PeriodMs < DISPLAY_MIN_PERIOD_MS){
+            return;
+            }
+        // The ticker must be stopped before the text is laid out again
+        Player.detach();
+        Text.set(Characters, Count);
+        Loop = Repeat;
+        Mode = DISPLAY_MODE_TEXT;
+        scrollStep();
+        Player.attach_us(callback(this, &DisplayService::scrollStep), (uint32_t)PeriodMs * 1000);
+    }
+
+    /// scrollStep ///
+    // Called by the ticker, moves the text on by a column, once it has gone the display goes back to the arrow
+    void scrollStep()
+    {
+        if (!Text.step(Matrix, Loop)){
+            Player.detach();
+            Mode = DISPLAY_MODE_ARROW;
+            }
+    }
+
+    /// step ///
+    // Called by the ticker, shows the next frame of the animation
+    void step()
+    {
+        if (FrameIndex >= FrameCount){
+            if (!Loop){
+                // Stays on the last frame
+                Player.detach();
+                return;
+                }
+            FrameIndex = 0;
+            }
+        LEDFrame Frame;
+        core_util_critical_section_enter();
+        Frame = Frames[FrameIndex];
+        core_util_critical_section_exit();
+        FrameIndex++;
+        Matrix.show(LEDMatrixMasks(Frame));
+    }
+
+    BLEDevice &ble;
+    LEDMatrix &Matrix;
+    uint8_t Command[DISPLAY_MAX_LENGTH];
+    GattCharacteristic CommandCharacteristic;
+    // Plays the animation or scrolls the text, one frame per tick
+    Ticker Player;
+    volatile uint8_t Mode;
+    // The animation buffer, the number of frames played and the next one to show
+    LEDFrame Frames[DISPLAY_MAX_FRAMES];
+    uint8_t FrameCount;
+    uint8_t FrameIndex;
+    bool Loop;
+    LEDText Text;
+
+};
+
+#endif /* #ifndef __BLE_DISPLAY_SERVICE_H__ */
@@ -0,0 +1,83 @@
+// Fixed Trig: Integer atan2 and vector rotation using CORDIC, no floating point or lookup of sin/cos
+// CORDIC - https://en.wikipedia.org/wiki/CORDIC
+// The nRF51822 has no floating point unit, a single atan2f() in software costs more than a whole CORDIC
+#ifndef __FIXED_TRIG_H__
+#define __FIXED_TRIG_H__
+#include <stdint.h>
+
+// Angles are binary angles, a full circle is 65536 so a uint16_t wraps exactly at 360 degrees
+// and an int16_t holds -180 to +180 degrees
+const int32_t FIXED_TRIG_HALF_CIRCLE    = 32768;
+const int32_t FIXED_TRIG_QUARTER_CIRCLE = 16384;
+
+// Number of CORDIC steps, each adds about one bit of precision, 14 steps gives about 0.02 degrees
+const int FIXED_TRIG_ITERATIONS = 14;
+
+// atan(2^-i) for each step as a binary angle
+const int16_t FIXED_TRIG_ATAN_TABLE[FIXED_TRIG_ITERATIONS] = {8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3, 1};
+
+// Each CORDIC step stretches the vector, after all the steps it is 1.6468 times longer
+// Multiplying by the inverse of that gain, 0.60725 as a q15, gives back the original length
+const int32_t FIXED_TRIG_INVERSE_GAIN_Q15 = 19898;
+
+/// CordicAtan2 ///
+// Returns the angle of the vector (X, Y) from the X axis as a binary angle, the same as atan2(Y, X)
+// The vector is turned onto the X axis one step at a time, the sum of the steps taken is the angle
+// The left half plane is first turned by 180 degrees as CORDIC only converges within +-99 degrees
+// X and Y must be within +-2^29 so the 1.65 gain of the steps can not overflow
+inline uint16_t CordicAtan2(int32_t Y, int32_t X)
+{
+    int32_t Angle = 0;
+    if (X < 0) {
+        X = -X;
+        Y = -Y;
+        Angle = FIXED_TRIG_HALF_CIRCLE;
+    }
+    for (int i = 0; i < FIXED_TRIG_ITERATIONS; i++) {
+        int32_t NextX;
+        if (Y > 0) {
+            NextX  = X + (Y >> i);
+            Y      = Y - (X >> i);
+            Angle += FIXED_TRIG_ATAN_TABLE[i];
+        } else {
+            NextX  = X - (Y >> i);
+            Y      = Y + (X >> i);
+            Angle -= FIXED_TRIG_ATAN_TABLE[i];
+        }
+        X = NextX;
+    }
+    return (uint16_t)Angle;
+}
+
+/// CordicRotate ///
+// Turns the vector (X, Y) anticlockwise by Angle, a binary angle
+// X' = X cos(Angle) - Y sin(Angle)
+// Y' = X sin(Angle) + Y cos(Angle)
+// The CORDIC gain is taken back out so the vector keeps its length
+// X and Y must be within +-2^29
+inline void CordicRotate(int32_t &X, int32_t &Y, int16_t Angle)
+{
+    int32_t Remaining = Angle;
+    if (Remaining > FIXED_TRIG_QUARTER_CIRCLE || Remaining < -FIXED_TRIG_QUARTER_CIRCLE) {
+        X = -X;
+        Y = -Y;
+        Remaining += (Remaining > 0) ? -FIXED_TRIG_HALF_CIRCLE : FIXED_TRIG_HALF_CIRCLE;
+    }
+    for (int i = 0; i < FIXED_TRIG_ITERATIONS; i++) {
+        int32_t NextX;
+        if (Remaining >= 0) {
+            NextX      = X - (Y >> i);
+            Y          = Y + (X >> i);
+            Remaining -= FIXED_TRIG_ATAN_TABLE[i];
+        } else {
+            NextX      = X + (Y >> i);
+            Y          = Y - (X >> i);
+            Remaining += FIXED_TRIG_ATAN_TABLE[i];
+        }
+        X = NextX;
+    }
+    X = (int32_t)(((int64_t)X * FIXED_TRIG_INVERSE_GAIN_Q15) >> 15);
+    Y = (int32_t)(((int64_t)Y * FIXED_TRIG_INVERSE_GAIN_Q15) >> 15);
+}
+
+#endif /* #ifndef __FIXED_TRIG_H__ */
@@ -0,0 +1,214 @@
+// Gesture Detector: Picks steps, shakes and taps out of the accelerometer sample stream
+#ifndef __GESTURE_DETECTOR_H__
+#define __GESTURE_DETECTOR_H__
+#include <stdint.h>
+#include "SensorFrame.h"
+
+// Events, also the first byte of the event notification
+const uint8_t GESTURE_NONE  = 0;
+const uint8_t GESTURE_STEP  = 1;
+const uint8_t GESTURE_SHAKE = 2;
+const uint8_t GESTURE_TAP   = 3;
+
+// The detector works on samples scaled to the 2g range of the MMA8653, 256 counts to 1g
+const int32_t GESTURE_ONE_G = 256;
+
+// Steps - The smoothed acceleration has to rise GESTURE_STEP_HIGH above 1g having dropped back under
+//         GESTURE_STEP_LOW since the last step, and no faster than 4 steps a second
+// Shake - GESTURE_SHAKE_JOLTS jolts of more than GESTURE_JOLT away from 1g inside GESTURE_SHAKE_WINDOW_US,
+//         a jolt ends once the acceleration is back within GESTURE_JOLT / 2 of 1g. Shaking that carries on
+//         is the same shake until there has been a whole window without a jolt
+// Tap   - A single jolt of more than GESTURE_TAP_HIGH that is over within GESTURE_TAP_MAX_US, coming out of
+//         a board that had been still for GESTURE_TAP_QUIET_US, anything longer is a knock or a throw and
+//         the first swing of a shake does not come out of a still board
+//         The tap is only reported once GESTURE_TAP_CONFIRM_US has gone by without another jolt, so the
+//         first swing of a shake that starts from still is not taken for one
+// A jolt throws the smoothed acceleration off for a while, steps are not counted for GESTURE_STEP_MIN_US after one
+const int32_t GESTURE_STEP_HIGH          = 51;  // 0.2g
+const int32_t GESTURE_STEP_LOW           = 13;  // 0.05g
+const uint32_t GESTURE_STEP_MIN_US       = 250000;
+const int32_t GESTURE_JOLT               = 256; // 1g
+const int GESTURE_SHAKE_JOLTS            = 4;
+const uint32_t GESTURE_SHAKE_WINDOW_US   = 1000000;
+const int32_t GESTURE_TAP_HIGH           = 192; // 0.75g
+const int32_t GESTURE_STILL              = 38;  // 0.15g
+const uint32_t GESTURE_TAP_MAX_US        = 120000;
+const uint32_t GESTURE_TAP_QUIET_US      = 200000;
+const uint32_t GESTURE_TAP_CONFIRM_US    = 150000;
+// Time constant of the smoothing in front of the step detection, worked from the sample timestamps
+// so the smoothing is the same whatever the output data rate
+const uint32_t GESTURE_SMOOTHING_US      = 40000;
+
+/// GestureMagnitude ///
+// Length of the acceleration vector in counts, an integer square root of X^2 + Y^2 + Z^2
+// The largest the sum can be is 3 * 2048^2 so it fits in 32 bits and the root in 12 bits
+inline int32_t GestureMagnitude(const SensorFrame &Frame)
+{
+    uint32_t Sum = (int32_t)Frame.X * Frame.X + (int32_t)Frame.Y * Frame.Y + (int32_t)Frame.Z * Frame.Z;
+    uint32_t Root = 0;
+    uint32_t Bit  = 1UL << 30;
+    while (Bit > Sum){
+        Bit >>= 2;
+        }
+    while (Bit != 0){
+        if (Sum >= (Root + Bit)){
+            Sum -= Root + Bit;
+            Root = (Root >> 1) + Bit;
+            }
+        else{
+            Root >>= 1;
+            }
+        Bit >>= 2;
+        }
+    return Root;
+}
+
+///GestureDetector///
+// Fed every sample the accelerometer service reads, before its filter or decimation
+// Only the length of the acceleration vector is used so the board can be held any way up
+// Its distance from 1g is how hard the board is being moved, walking gives a bump of a few tenths of
+// a g every step, a tap a short spike and a shake a run of large swings
+// The thresholds suit a sample rate of 25Hz or more for steps and 100Hz or more for taps, slower than
+// that a tap is usually over between two samples and is missed. While a client is subscribed to the
+// gesture events the accelerometer is held at 100Hz or faster, see ACCELService::RaiseRate()
+class GestureDetector {
+public:
+    GestureDetector() :
+        Smoothed(0), LastUs(0), StepArmed(false), LastStepUs(0), InJolt(false), JoltStartUs(0), JoltPeak(0), JoltFromStill(false),
+        Jolts(0), FirstJoltUs(0), LastJoltUs(0), Shaking(false), LastShakeJoltUs(0), MovedUs(0), TapPending(false), TapUs(0), TapStrength(0), Started(false)
+    {
+    }
+
+    /// process ///
+    // Takes one sample, returns the event it completes or GESTURE_NONE
+    // Strength is set to the peak distance from 1g of the event in 1/16g
+    uint8_t process(const SensorSample &Sample, uint8_t &Strength)
+    {
+        uint32_t Now = Sample.Timestamp;
+        int32_t Dynamic = GestureMagnitude(Sample.Frame) - GESTURE_ONE_G;
+        int32_t Distance = (Dynamic < 0) ? -Dynamic : Dynamic;
+        if (!Started){
+            // Start the smoothing from the first sample rather than from 0
+            Started    = true;
+            Smoothed   = Dynamic * 16;
+            LastUs     = Now;
+            LastStepUs = Now - GESTURE_STEP_MIN_US;
+            LastJoltUs = Now - GESTURE_STEP_MIN_US;
+            MovedUs    = Now;
+            }
+        uint8_t Event = GESTURE_NONE;
+
+        // Jolts, for shakes and taps
+        if (!InJolt && (Distance > GESTURE_TAP_HIGH)){
+            TapPending  = false;
+            InJolt      = true;
+            JoltStartUs = Now;
+            JoltPeak    = Distance;
+            JoltFromStill = (Now - MovedUs) >= GESTURE_TAP_QUIET_US;
+            }
+        else if (InJolt){
+            LastJoltUs = Now;
+            if (Distance > JoltPeak){
+                JoltPeak = Distance;
+                }
+            if (Distance < (GESTURE_JOLT / 2)){
+                InJolt = false;
+                Event = joltEnded(Now, Strength);
+                }
+            }
+        else if (TapPending && ((Now - TapUs) >= GESTURE_TAP_CONFIRM_US)){
+            TapPending = false;
+            Strength   = TapStrength;
+            Event      = GESTURE_TAP;
+            }
+        if (Distance >= GESTURE_STILL){
+            MovedUs = Now;
+            }
+
+        // Steps, on the smoothed acceleration, Smoothed is 16 times the running average of Dynamic
+        // Each sample moves it Dt / (GESTURE_SMOOTHING_US + Dt) of the way to the new value
+        uint32_t Dt = Now - LastUs;
+        LastUs = Now;
+        if (Dt > GESTURE_SHAKE_WINDOW_US){
+            Dt = GESTURE_SHAKE_WINDOW_US;
+            }
+        Smoothed += (int32_t)(((int64_t)(Dynamic * 16 - Smoothed) * Dt) / (GESTURE_SMOOTHING_US + Dt));
+        int32_t Average = Smoothed / 16;
+        if (Average < GESTURE_STEP_LOW){
+            StepArmed = true;
+            }
+        else if (StepArmed && (Average > GESTURE_STEP_HIGH) && ((Now - LastStepUs) >= GESTURE_STEP_MIN_US) &&
+                 !InJolt && ((Now - LastJoltUs) >= GESTURE_STEP_MIN_US) && (Event == GESTURE_NONE)){
+            StepArmed  = false;
+            LastStepUs = Now;
+            Strength   = clamp(Average);
+            Event      = GESTURE_STEP;
+            }
+        return Event;
+    }
+
+private:
+    // Decides what the jolt that just ended was
+    uint8_t joltEnded(uint32_t Now, uint8_t &Strength)
+    {
+        if (JoltPeak > GESTURE_JOLT){
+            if (Shaking && ((JoltStartUs - LastShakeJoltUs) <= GESTURE_SHAKE_WINDOW_US)){
+                // Still the same shake
+                LastShakeJoltUs = JoltStartUs;
+                return GESTURE_NONE;
+                }
+            Shaking = false;
+            if ((Jolts == 0) || ((Now - FirstJoltUs) > GESTURE_SHAKE_WINDOW_US)){
+                Jolts       = 0;
+                FirstJoltUs = JoltStartUs;
+                }
+            Jolts++;
+            if (Jolts == GESTURE_SHAKE_JOLTS){
+                Jolts           = 0;
+                Shaking         = true;
+                LastShakeJoltUs = JoltStartUs;
+                Strength        = clamp(JoltPeak);
+                return GESTURE_SHAKE;
+                }
+            }
+        if (JoltFromStill && ((Now - JoltStartUs) <= GESTURE_TAP_MAX_US)){
+            TapPending  = true;
+            TapUs       = Now;
+            TapStrength = clamp(JoltPeak);
+            }
+        return GESTURE_NONE;
+    }
+
+    // Counts to 1/16g, up to 255
+    static uint8_t clamp(int32_t Counts)
+    {
+        int32_t Sixteenths = Counts / (GESTURE_ONE_G / 16);
+        if (Sixteenths < 0){
+            return 0;
+            }
+        return (Sixteenths > 255) ? 255 : Sixteenths;
+    }
+
+    int32_t Smoothed;
+    uint32_t LastUs;
+    bool StepArmed;
+    uint32_t LastStepUs;
+    bool InJolt;
+    uint32_t JoltStartUs;
+    int32_t JoltPeak;
+    bool JoltFromStill;
+    int Jolts;
+    uint32_t FirstJoltUs;
+    uint32_t LastJoltUs;
+    bool Shaking;
+    uint32_t LastShakeJoltUs;
+    // Last time the board was not still
+    uint32_t MovedUs;
+    // A tap waiting to be confirmed
+    bool TapPending;
+    uint32_t TapUs;
+    uint8_t TapStrength;
+    bool Started;
+};
+
+#endif /* #ifndef __GESTURE_DETECTOR_H__ */
@@ -0,0 +1,124 @@
+// Gestures: Step, shake and tap events detected on the micro:bit, see GestureDetector.h
+#ifndef __BLE_GESTURE_SERVICE_H__
+#define __BLE_GESTURE_SERVICE_H__
+#include <mbed.h>
+#include "SensorFrame.h"
+#include "GestureDetector.h"
+
+///GestureEvent///
+// Value of the event characteristic, 6 bytes notified for every gesture
+// Type        - GESTURE_STEP, GESTURE_SHAKE or GESTURE_TAP
+// Strength    - How hard, the peak distance from 1g in 1/16g
+// Count       - Total of this type of event since power up, wraps at 65535, a client that missed a
+//               notification can tell from the gap
+// TimestampMs - Time of the sample that completed the event in milliseconds, wraps every 65 seconds
+struct GestureEvent {
+    uint8_t Type;
+    uint8_t Strength;
+    uint16_t Count;
+    uint16_t TimestampMs;
+};
+const int GESTURE_EVENT_LENGTH = 6;
+
+///GestureCounters///
+// Value of the counters characteristic, totals since power up, 8 bytes
+struct GestureCounters {
+    uint32_t Steps;
+    uint16_t Shakes;
+    uint16_t Taps;
+};
+
+///GestureService///
+// Runs the gesture detector over every sample the accelerometer service reads and only uses the
+// radio when something happens, a client that wants to count steps or react to a shake subscribes
+// to the event characteristic instead of streaming the accelerometer and working it out itself
+// The accelerometer service calls process() from publish() in the main loop, so the event is
+// notified straight away. If the bluetooth stack is out of buffers the event is held and sent by
+// the next call, a second event arriving before then replaces it and only shows up in the counters
+// Subscribing to the event characteristic raises the accelerometer to 100Hz or faster for the taps,
+// the config characteristic of the accelerometer shows the rate in use
+class GestureService {
+public:
+    //Universal Unique Identification numbers for gestures//
+    //The gesture service has a UUID of 0xA020
+    //UUID Event Characteristic    - 0xA021, notifies a GestureEvent for every step, shake or tap
+    //UUID Counters Characteristic - 0xA022, read the GestureCounters totals
+    const static uint16_t GESTURE_SERVICE_UUID = 0xA020;
+    const static uint16_t GESTURE_EVENT_CHARACTERISTIC_UUID = 0xA021;
+    const static uint16_t GESTURE_COUNTERS_CHARACTERISTIC_UUID = 0xA022;
+
+    ///GestureService Constructor///
+    // Will create the gesture service for bluetooth profile
+    GestureService(BLEDevice &_ble) :
+        ble(_ble), Event(GESTURE_EVENT_CHARACTERISTIC_UUID, &LastEvent, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        CountersCharacteristic(GESTURE_COUNTERS_CHARACTERISTIC_UUID, &Counters),
+        EventPending(false)
+    {
+        LastEvent.Type        = GESTURE_NONE;
+        LastEvent.Strength    = 0;
+        LastEvent.Count       = 0;
+        LastEvent.TimestampMs = 0;
+        Counters.Steps  = 0;
+        Counters.Shakes = 0;
+        Counters.Taps   = 0;
+
+        // Assign the gatt characteristics to a GattCharacteristic instance
+        GattCharacteristic *charTable[] = {&Event,&CountersCharacteristic};
+        // Create an instance of a service for gestures and associate the characteristics with it
+        GattService         gestureService(GESTURE_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+        // Add the service to the ble profile
+        ble.addService(gestureService);
+    }
+
+    GattAttribute::Handle_t getValueHandle() const {
+        return Event.getValueHandle();
+    }
+
+    /// process ///
+    // Called with every accelerometer sample, scaled to 256 counts to 1g
+    void process(const SensorSample &Sample)
+    {
+        uint8_t Strength = 0;
+        uint8_t Type = Detector.process(Sample, Strength);
+        if (Type != GESTURE_NONE){
+            uint16_t Count = count(Type);
+            LastEvent.Type        = Type;
+            LastEvent.Strength    = Strength;
+            LastEvent.Count       = Count;
+            LastEvent.TimestampMs = Sample.Timestamp / 1000;
+            EventPending = true;
+            ble.gattServer().write(CountersCharacteristic.getValueHandle(), (uint8_t *)&Counters, sizeof(GestureCounters));
+            }
+        if (EventPending){
+            if (ble.gattServer().write(Event.getValueHandle(), (uint8_t *)&LastEvent, GESTURE_EVENT_LENGTH) != BLE_STACK_BUSY){
+                EventPending = false;
+                }
+            }
+    }
+
+//Private variables
+private:
+    // Adds one to the total for Type and returns the new total
+    uint16_t count(uint8_t Type)
+    {
+        if (Type == GESTURE_STEP){
+            Counters.Steps++;
+            return Counters.Steps;
+            }
+        if (Type == GESTURE_SHAKE){
+            return ++Counters.Shakes;
+            }
+        return ++Counters.Taps;
+    }
+
+    BLEDevice &ble;
+    ReadOnlyGattCharacteristic<GestureEvent>    Event;
+    ReadOnlyGattCharacteristic<GestureCounters> CountersCharacteristic;
+    GestureEvent LastEvent;
+    GestureCounters Counters;
+    GestureDetector Detector;
+    bool EventPending;
+
+};
+
+#endif /* #ifndef __BLE_GESTURE_SERVICE_H__ */
@@ -0,0 +1,137 @@
+// Heading: Tilt compensated compass heading from the MAG3110 and MMA8653 samples
+// Tilt compensation - NXP AN4248: https://www.nxp.com/docs/en/application-note/AN4248.pdf
+#ifndef __BLE_HEADING_SERVICE_H__
+#define __BLE_HEADING_SERVICE_H__
+#include <mbed.h>
+#include "SensorFrame.h"
+#include "FixedTrig.h"
+#include "SampleCache.h"
+
+// The heading is worked out in the frame of AN4248, X forward towards the edge with the USB socket,
+// Y to the right and Z down through the board when it lies flat with the LEDs up
+// Both sensors sit on the back of the micro:bit with their Z axes pointing out of the back (down when
+// flat), each turned a quarter turn the other way round Z, so the MAG3110 axes are the MMA8653 axes
+// turned half a turn. The same mapping is used by the micro:bit runtime (microbit-dal) for its NED frame
+
+/// AlignAccelFrame ///
+// Gravity in the heading frame from a raw MMA8653 sample
+// The accelerometer measures the push holding the board up, the opposite of gravity, which AN4248 expects
+// flat to read +1g on Z. The MMA8653 Y axis points forward and X to the left
+inline SensorFrame AlignAccelFrame(const SensorFrame &Accel)
+{
+    SensorFrame Aligned;
+    Aligned.X = (int16_t)-Accel.Y;
+    Aligned.Y = Accel.X;
+    Aligned.Z = (int16_t)-Accel.Z;
+    return Aligned;
+}
+
+/// AlignMagFrame ///
+// The magnetic field in the heading frame from a calibrated MAG3110 sample
+// The MAG3110 Y axis points backwards and X to the right
+inline SensorFrame AlignMagFrame(const SensorFrame &Mag)
+{
+    SensorFrame Aligned;
+    Aligned.X = (int16_t)-Mag.Y;
+    Aligned.Y = Mag.X;
+    Aligned.Z = Mag.Z;
+    return Aligned;
+}
+
+///HeadingService///
+// Fuses the newest accelerometer and magnetometer samples into a single compass heading
+// The heading is computed on the micro:bit so a client only needs one 2 byte notification
+// instead of streaming all six X, Y and Z characteristics and doing the maths itself
+class HeadingService {
+public:
+    //Universal Unique Identification numbers for the heading//
+    //The heading service has a UUID of 0xA01A
+    //UUID Heading Characteristic - 0xA01B, uint16 heading from magnetic north in hundredths of a degree (0 to 35999)
+    const static uint16_t HEADING_SERVICE_UUID = 0xA01A;
+    const static uint16_t HEADING_CHARACTERISTIC_UUID = 0xA01B;
+
+    ///HeadingService Constructor///
+    // Will create the heading service for bluetooth profile
+    HeadingService(BLEDevice &_ble) :
+        ble(_ble), Heading(HEADING_CHARACTERISTIC_UUID, &CurrentHeading, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        CurrentHeading(0), AccelSequence(0), MagSequence(0)
+    {
+        // Assign the gatt characteristics to a GattCharacteristic instance
+        GattCharacteristic *charTable[] = {&Heading};
+        // Create an instance of a service for the heading and associate the characteristic with it
+        GattService         headingService(HEADING_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+        // Add the service to the ble profile
+        ble.addService(headingService);
+    }
+
+    GattAttribute::Handle_t getValueHandle() const {
+        return Heading.getValueHandle();
+    }
+
+    /// update ///
+    // Called from the main loop with the raw sample caches of both sensor services, see RawSample()
+    // The filtered samples are no good here, a high pass filter takes gravity out and the others add lag
+    // Nothing is done until one of the sensors has a new sample and the characteristic is only
+    // written when the heading has changed (reduces traffic)
+    void update(const SampleCache<SensorSample> &AccelCache, const SampleCache<SensorSample> &MagCache)
+    {
+        if ((AccelCache.sequence() == AccelSequence) && (MagCache.sequence() == MagSequence)){
+            return;
+            }
+        SensorSample Accel;
+        SensorSample Mag;
+        if (!AccelCache.read(Accel, AccelSequence) || !MagCache.read(Mag, MagSequence)){
+            return;
+            }
+
+        uint16_t NewHeading = ComputeHeading(AlignAccelFrame(Accel.Frame), AlignMagFrame(Mag.Frame));
+        if (NewHeading != CurrentHeading){
+            CurrentHeading = NewHeading;
+            ble.gattServer().write(Heading.getValueHandle(), (uint8_t *)&CurrentHeading, sizeof(uint16_t));
+            }
+    }
+
+    /// ComputeHeading ///
+    // Tilt compensated heading in hundredths of a degree, AN4248 equations 13 to 22 with CORDIC
+    // Accel is gravity and Mag the field, both in the heading frame, see AlignAccelFrame() and AlignMagFrame()
+    // Step 1. Roll is the angle of gravity in the Y Z plane, turning Y and Z of both sensors back by
+    //         the roll levels the board around its X axis
+    // Step 2. Pitch is then the angle of gravity in the X Z plane, turning X and Z of the magnetometer
+    //         back by the pitch levels it around its Y axis
+    // Step 3. The heading is the angle of the levelled magnetic field in the X Y plane
+    // Only the direction of the field matters so the raw magnetometer counts are used as they are,
+    // hard iron offsets must already be taken off for the heading to be right, see MagCalibration.h
+    static uint16_t ComputeHeading(const SensorFrame &Accel, const SensorFrame &Mag)
+    {
+        // Step 1. Roll
+        int16_t Roll = (int16_t)CordicAtan2(Accel.Y, Accel.Z);
+        int32_t GravityZ = Accel.Z;
+        int32_t GravityY = Accel.Y;
+        CordicRotate(GravityZ, GravityY, -Roll);
+        int32_t FieldZ = Mag.Z;
+        int32_t FieldY = Mag.Y;
+        CordicRotate(FieldZ, FieldY, -Roll);
+
+        // Step 2. Pitch
+        int16_t Pitch = (int16_t)CordicAtan2(-Accel.X, GravityZ);
+        int32_t FieldX = Mag.X;
+        CordicRotate(FieldX, FieldZ, -Pitch);
+
+        // Step 3. Heading, FieldX and FieldY are Bfx and Bfy of AN4248 and the heading is atan2(-Bfy, Bfx)
+        // A field to the left of the board, negative Y, is a heading east of north
+        uint16_t Angle = CordicAtan2(-FieldY, FieldX);
+        return (uint16_t)((((uint32_t)Angle * 36000) + FIXED_TRIG_HALF_CIRCLE) >> 16) % 36000;
+    }
+
+//Private variables
+private:
+    BLEDevice &ble;
+    ReadOnlyGattCharacteristic<uint16_t> Heading;
+    uint16_t CurrentHeading;
+
+    // Sequence numbers of the cached samples the current heading was worked out from
+    uint32_t AccelSequence;
+    uint32_t MagSequence;
+};
+
+#endif /* #ifndef __BLE_HEADING_SERVICE_H__ */
@@ -0,0 +1,208 @@
+// I2C Queue: Non blocking i2c transaction scheduler shared by all of the sensor services
+// MBED I2C API - https://os.mbed.com/docs/mbed-os/v5.14/apis/i2c.html
+#ifndef __I2C_QUEUE_H__
+#define __I2C_QUEUE_H__
+#include <mbed.h>
+#include "I2CStats.h"
+
+///I2CTransaction///
+// One queued i2c transaction
+// Tx       - The register number, followed by the value to write for a register write
+// TxLength - Number of bytes in Tx to send
+// Rx       - Where the bytes read are stored, NULL for a register write
+// RxLength - Number of bytes to read after a repeated start, 0 for a register write
+// Done     - Called once the transaction has finished with a status of 0 on success
+struct I2CTransaction {
+    int Address;
+    char Tx[2];
+    int TxLength;
+    char *Rx;
+    int RxLength;
+    event_callback_t Done;
+};
+
+///I2CQueue///
+// Sensor services queue register reads and writes here instead of using i2c.write and i2c.read directly
+// Queueing is safe from any context (ticker, pin interrupts, bluetooth callbacks or the main loop)
+// The transactions are run back to back in the order they were queued and the completed
+// frames are handed to the Done callback of each transaction
+//
+// If the target supports asynchronous i2c (DEVICE_I2C_ASYNCH) the transactions are chained
+// with I2C::transfer() from the i2c interrupt and the cpu never waits on the bus
+// The nRF51 on the micro:bit does not, so process() runs the queue from the main loop instead
+// The bus waits then happen in thread mode where they can be pre-empted by the bluetooth stack, the
+// tickers and the pin interrupts, rather than inside a ticker interrupt blocking all of them
+//
+// A transaction the device does not acknowledge is run again up to I2C_QUEUE_RETRIES times before
+// its owner is told it failed, a sensor busy with a conversion can miss the odd address byte
+// Every transaction is timed with us_ticker from its first attempt to its last and counted in Stats,
+// see I2CStats.h, which is what the diagnostics service and the serial dump report
+class I2CQueue {
+public:
+    // Maximum number of transactions that can be waiting at once, one slot is always left empty 
+    // The services queue all of their setup writes from bleInitComplete() before the main loop first 
+    // runs the queue, with data ready and motion wake that is up to 19 register writes 
+    const static int I2C_QUEUE_LENGTH = 24;
+    // Number of times a transaction is run again after a NACK
+    const static int I2C_QUEUE_RETRIES = 2;
+
+    I2CQueue(I2C &_bus) :
+        bus(_bus), Head(0), Tail(0), Busy(false), StartUs(0), Attempts(0)
+    {
+    }
+
+    // Counters and latency histograms of every transaction run so far
+    I2CStats Stats;
+
+    /// Write ///
+    // Queues a write of Value to the internal register number Register of the device at Address
+    // Returns false if the queue is full and the write was dropped
+    bool Write(int Address, char Register, char Value, const event_callback_t &Done = event_callback_t())
+    {
+        I2CTransaction Transaction;
+        Transaction.Address  = Address;
+        Transaction.Tx[0]    = Register;
+        Transaction.Tx[1]    = Value;
+        Transaction.TxLength = 2;
+        Transaction.Rx       = NULL;
+        Transaction.RxLength = 0;
+        Transaction.Done     = Done;
+        return enqueue(Transaction);
+    }
+
+    /// Read ///
+    // Queues a read of RxLength bytes starting at internal register number Register of the device at Address
+    // The register number auto increments so several registers can be read in the one transaction
+    // Rx must stay valid until Done has been called
+    // Returns false if the queue is full and the read was dropped
+    bool Read(int Address, char Register, char *Rx, int RxLength, const event_callback_t &Done)
+    {
+        I2CTransaction Transaction;
+        Transaction.Address  = Address;
+        Transaction.Tx[0]    = Register;
+        Transaction.TxLength = 1;
+        Transaction.Rx       = Rx;
+        Transaction.RxLength = RxLength;
+        Transaction.Done     = Done;
+        return enqueue(Transaction);
+    }
+
+    /// process ///
+    // Called from the main loop every time the micro:bit wakes up
+    // Without asynchronous i2c this runs every queued transaction, including any queued by the callbacks
+    // With asynchronous i2c the queue runs itself and there is nothing to do here
+    void process()
+    {
+#if !DEVICE_I2C_ASYNCH
+        while (Head != Tail) {
+            I2CTransaction &Transaction = Queue[Head];
+            int Status;
+
+            StartUs  = us_ticker_read();
+            Attempts = 0;
+            do {
+                // Write the register number (and value) then read back with a repeated start if needed
+                Attempts++;
+                Status = bus.write(Transaction.Address, Transaction.Tx, Transaction.TxLength, Transaction.RxLength > 0);
+                if ((Status == 0) && (Transaction.RxLength > 0)) {
+                    Status = bus.read(Transaction.Address, Transaction.Rx, Transaction.RxLength);
+                }
+            } while ((Status != 0) && (Attempts <= I2C_QUEUE_RETRIES));
+            finish(Status);
+        }
+#endif
+    }
+
+private:
+    /// enqueue ///
+    // Adds a transaction to the end of the queue, interrupts are disabled so any context can queue
+    bool enqueue(const I2CTransaction &Transaction)
+    {
+        bool Queued = false;
+        core_util_critical_section_enter();
+        int Next = (Tail + 1) % I2C_QUEUE_LENGTH;
+        if (Next != Head) {
+            Queue[Tail] = Transaction;
+            Tail = Next;
+            Queued = true;
+        }
+        core_util_critical_section_exit();
+#if DEVICE_I2C_ASYNCH
+        start();
+#endif
+        return Queued;
+    }
+
+    /// finish ///
+    // Removes the transaction at the head of the queue and tells its owner it has completed
+    // The callback is copied first so it can queue the next transaction from inside the callback
+    void finish(int Status)
+    {
+        I2CTransaction &Transaction = Queue[Head];
+        Stats.record(Transaction.Address, Transaction.TxLength + Transaction.RxLength, Attempts, Status, us_ticker_read() - StartUs);
+        event_callback_t Done = Transaction.Done;
+        core_util_critical_section_enter();
+        Head = (Head + 1) % I2C_QUEUE_LENGTH;
+        core_util_critical_section_exit();
+        if (Done) {
+            Done(Status);
+        }
+    }
+
+#if DEVICE_I2C_ASYNCH
+    /// start ///
+    // Starts the transaction at the head of the queue if the bus is free
+    void start()
+    {
+        core_util_critical_section_enter();
+        bool Start = !Busy && (Head != Tail);
+        if (Start) {
+            Busy = true;
+        }
+        core_util_critical_section_exit();
+
+        if (Start) {
+            StartUs  = us_ticker_read();
+            Attempts = 0;
+            transfer();
+        }
+    }
+
+    /// transfer ///
+    // Runs one attempt of the transaction at the head of the queue
+    void transfer()
+    {
+        I2CTransaction &Transaction = Queue[Head];
+        Attempts++;
+        bus.transfer(Transaction.Address, Transaction.Tx, Transaction.TxLength, Transaction.Rx, Transaction.RxLength,
+                     event_callback_t(this, &I2CQueue::onTransferDone), I2C_EVENT_ALL);
+    }
+
+    /// onTransferDone ///
+    // Called from the i2c interrupt when the transfer at the head of the queue has finished
+    // A failed transfer is run again while it has retries left, otherwise the result is handed
+    // to its owner and the next transaction is chained straight away
+    void onTransferDone(int Event)
+    {
+        int Status = (Event & I2C_EVENT_TRANSFER_COMPLETE) ? 0 : Event;
+        if ((Status != 0) && (Attempts <= I2C_QUEUE_RETRIES)) {
+            transfer();
+            return;
+        }
+        finish(Status);
+        Busy = false;
+        start();
+    }
+#endif
+
+    I2C &bus;
+    I2CTransaction Queue[I2C_QUEUE_LENGTH];
+    volatile int Head;
+    volatile int Tail;
+    volatile bool Busy;
+    // When the transaction at the head of the queue started and how many times it has been run
+    uint32_t StartUs;
+    int Attempts;
+};
+
+#endif /* #ifndef __I2C_QUEUE_H__ */
@@ -0,0 +1,177 @@
+// I2C Stats: Per device counters and latency histograms for the transactions run by I2CQueue
+#ifndef __I2C_STATS_H__
+#define __I2C_STATS_H__
+#include <stdint.h>
+
+// Number of devices on the bus that get their own counters, the micro:bit only has the MMA8653 and MAG3110
+const int I2C_STATS_MAX_DEVICES = 4;
+
+// Latency histogram buckets, bucket 0 counts transactions under I2C_STATS_FIRST_BUCKET_US and every bucket
+// after that is twice as wide as the one before, the last one counts everything slower
+// At 100kHz a register write takes about 0.3ms and a 6 byte frame read about 1ms, so the interesting
+// transactions land in the middle and anything in the top buckets has been held up by an interrupt
+// 0 - under 128us, 1 - under 256us, 2 - under 512us, 3 - under 1ms, 4 - under 2ms, 5 - under 4ms, 6 - under 8ms, 7 - 8ms or more
+const int I2C_STATS_BUCKETS = 8;
+const uint32_t I2C_STATS_FIRST_BUCKET_US = 128;
+
+///I2CDeviceStats///
+// Everything recorded for one device address
+// Transactions - Transactions completed, successful or not, retries are not counted again
+// Bytes        - Bytes moved in the successful transactions, the register number included
+// Nacks        - Attempts the device did not acknowledge
+// Retries      - Attempts run again after a NACK
+// Failures     - Transactions still failing after every retry, their owner was given a non zero status
+// MaxUs        - Longest transaction, from the first attempt starting to the last one finishing
+// TotalUs      - Time the bus was held for this device, divide by the time since reset() for the bus load
+// Histogram    - Number of transactions in each latency bucket
+struct I2CDeviceStats {
+    int Address;
+    uint32_t Transactions;
+    uint32_t Bytes;
+    uint32_t Nacks;
+    uint32_t Retries;
+    uint32_t Failures;
+    uint32_t MaxUs;
+    uint32_t TotalUs;
+    uint32_t Histogram[I2C_STATS_BUCKETS];
+};
+
+/// I2CStatsBucket ///
+// The histogram bucket a transaction taking Us microseconds is counted in
+inline int I2CStatsBucket(uint32_t Us)
+{
+    int Bucket = 0;
+    uint32_t Limit = I2C_STATS_FIRST_BUCKET_US;
+    while ((Bucket < (I2C_STATS_BUCKETS - 1)) && (Us >= Limit)) {
+        Bucket++;
+        Limit <<= 1;
+    }
+    return Bucket;
+}
+
+///I2CStats///
+// Kept by I2CQueue, record() is called once for every transaction it finishes
+// Devices get a slot the first time they are seen, a bus with more than I2C_STATS_MAX_DEVICES
+// addresses only has the first ones counted and the rest go into Untracked
+// Only I2CQueue writes the counters, from the main loop (or the i2c interrupt with asynchronous i2c),
+// readers may see one transaction half counted which does not matter for diagnostics
+class I2CStats {
+public:
+    I2CStats() {
+        reset(0);
+    }
+
+    /// record ///
+    // Counts one finished transaction
+    // Attempts - How many times it was run, 1 if it succeeded first time
+    // Status   - 0 if the last attempt succeeded
+    void record(int Address, int Length, int Attempts, int Status, uint32_t Us)
+    {
+        I2CDeviceStats *Device = find(Address);
+        if (Device == NULL) {
+            Untracked++;
+            return;
+        }
+        Device->Transactions++;
+        Device->Nacks   += (Status != 0) ? Attempts : (Attempts - 1);
+        Device->Retries += Attempts - 1;
+        if (Status == 0) {
+            Device->Bytes += Length;
+        } else {
+            Device->Failures++;
+        }
+        if (Us > Device->MaxUs) {
+            Device->MaxUs = Us;
+        }
+        Device->TotalUs += Us;
+        Device->Histogram[I2CStatsBucket(Us)]++;
+    }
+
+    /// reset ///
+    // Clears every counter, Now is the us_ticker time the new counts start from
+    void reset(uint32_t Now)
+    {
+        for (int i = 0; i < I2C_STATS_MAX_DEVICES; i++) {
+            I2CDeviceStats &Device = Devices[i];
+            Device.Address      = -1;
+            Device.Transactions = 0;
+            Device.Bytes        = 0;
+            Device.Nacks        = 0;
+            Device.Retries      = 0;
+            Device.Failures     = 0;
+            Device.MaxUs        = 0;
+            Device.TotalUs      = 0;
+            for (int b = 0; b < I2C_STATS_BUCKETS; b++) {
+                Device.Histogram[b] = 0;
+            }
+        }
+        DeviceCount = 0;
+        Untracked   = 0;
+        Since       = Now;
+    }
+
+    // Number of devices seen since the last reset, device(0) to device(count() - 1) are valid
+    int count() const {
+        return DeviceCount;
+    }
+    const I2CDeviceStats &device(int Index) const {
+        return Devices[Index];
+    }
+    // Transactions to addresses that did not get a slot
+    uint32_t untracked() const {
+        return Untracked;
+    }
+    // The us_ticker time of the last reset
+    uint32_t since() const {
+        return Since;
+    }
+
+    /// dump ///
+    // Prints every counter and histogram on the serial console, Out is the Serial to print on
+    template <typename Output>
+    void dump(Output &Out, uint32_t Now) const
+    {
+        uint32_t Elapsed = Now - Since;
+        Out.printf("i2c stats over %lu ms\n\r", (unsigned long)(Elapsed / 1000));
+        for (int i = 0; i < DeviceCount; i++) {
+            const I2CDeviceStats &Device = Devices[i];
+            Out.printf("0x%02x: %lu transactions %lu bytes %lu nacks %lu retries %lu failures, max %lu us, busy %lu us\n\r",
+                       Device.Address >> 1, (unsigned long)Device.Transactions, (unsigned long)Device.Bytes,
+                       (unsigned long)Device.Nacks, (unsigned long)Device.Retries, (unsigned long)Device.Failures,
+                       (unsigned long)Device.MaxUs, (unsigned long)Device.TotalUs);
+            Out.printf("      latency");
+            uint32_t Limit = I2C_STATS_FIRST_BUCKET_US;
+            for (int b = 0; b < I2C_STATS_BUCKETS; b++) {
+                Out.printf(" %s%lu:%lu", (b == (I2C_STATS_BUCKETS - 1)) ? ">=" : "<",
+                           (unsigned long)((b == (I2C_STATS_BUCKETS - 1)) ? (Limit >> 1) : Limit), (unsigned long)Device.Histogram[b]);
+                Limit <<= 1;
+            }
+            Out.printf("\n\r");
+        }
+        if (Untracked != 0) {
+            Out.printf("%lu transactions to other addresses\n\r", (unsigned long)Untracked);
+        }
+    }
+
+private:
+    I2CDeviceStats *find(int Address)
+    {
+        for (int i = 0; i < DeviceCount; i++) {
+            if (Devices[i].Address == Address) {
+                return &Devices[i];
+            }
+        }
+        if (DeviceCount == I2C_STATS_MAX_DEVICES) {
+            return NULL;
+        }
+        Devices[DeviceCount].Address = Address;
+        return &Devices[DeviceCount++];
+    }
+
+    I2CDeviceStats Devices[I2C_STATS_MAX_DEVICES];
+    int DeviceCount;
+    uint32_t Untracked;
+    uint32_t Since;
+};
+
+#endif /* #ifndef __I2C_STATS_H__ */
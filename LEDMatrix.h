@@ -0,0 +1,273 @@
+// LED Matrix: Drives the 5x5 LED display of the micro:bit from a frame buffer, refreshed from a ticker
+#ifndef __LED_MATRIX_H__
+#define __LED_MATRIX_H__
+#include <mbed.h>
+
+// The display is 5 rows of 5 LEDs, wired as 3 rows of 9 columns
+// Rows are the anodes, P0_13 to P0_15, high to light a LED
+// Columns are the cathodes, P0_4 to P0_12, low to light a LED
+// Only one row is lit at a time, the refresh moves on to the next one every LED_MATRIX_ROW_US
+// so every row gets a third of the time, 166 times a second, too fast to see it flicker
+const int LED_MATRIX_SIZE = 5;
+const int LED_MATRIX_ROWS = 3;
+const int LED_MATRIX_COLS = 9;
+const uint32_t LED_MATRIX_ROW_US = 2000;
+
+// Greyscale by bit angle modulation, every pixel has a level from 0 (off) to LED_MATRIX_MAX_LEVEL (full)
+// The time a row is lit is split into one slot per bit of the level, each twice as long as the one before,
+// a pixel is lit in the slots of the bits set in its level so it is lit for a time in proportion to its level
+// The slots add up to 7 units, a unit is set by the brightness and the rest of LED_MATRIX_ROW_US is dark
+// The us_ticker of the nRF51 counts the 32768Hz clock, so a unit is never shorter than LED_MATRIX_MIN_UNIT_US
+const int LED_MATRIX_PLANES      = 3;
+const uint8_t LED_MATRIX_MAX_LEVEL = (1 << LED_MATRIX_PLANES) - 1;
+const uint32_t LED_MATRIX_MIN_UNIT_US = 31;
+const uint8_t LED_MATRIX_MAX_BRIGHTNESS = 255;
+
+// GPIO bits of the rows and columns, all of them are on port 0 so one write to NRF_GPIO->OUT sets them all
+const int LED_MATRIX_FIRST_ROW_PIN = 13;
+const int LED_MATRIX_FIRST_COL_PIN = 4;
+const uint32_t LED_MATRIX_ROW_PINS = ((1UL << LED_MATRIX_ROWS) - 1) << LED_MATRIX_FIRST_ROW_PIN;
+const uint32_t LED_MATRIX_COL_PINS = ((1UL << LED_MATRIX_COLS) - 1) << LED_MATRIX_FIRST_COL_PIN;
+const uint32_t LED_MATRIX_PINS     = LED_MATRIX_ROW_PINS | LED_MATRIX_COL_PINS;
+
+// Where each LED of the display is in the matrix, row * 16 + column counting from 0, as laid out on the
+// micro:bit schematic. Columns 8 and 9 of the second row have no LED
+constexpr uint8_t LED_MATRIX_WIRING[LED_MATRIX_SIZE][LED_MATRIX_SIZE] = {
+    {0x00, 0x13, 0x01, 0x14, 0x02},
+    {0x23, 0x24, 0x25, 0x26, 0x27},
+    {0x11, 0x08, 0x12, 0x28, 0x10},
+    {0x07, 0x06, 0x05, 0x04, 0x03},
+    {0x22, 0x16, 0x20, 0x15, 0x21}
+};
+
+///LEDFrame///
+// One picture on the display, a byte per row from the top, bit 4 is the left hand LED and bit 0 the right hand one
+// Written out in binary a frame looks like the picture it shows
+struct LEDFrame {
+    uint8_t Rows[LED_MATRIX_SIZE];
+};
+
+// Every LED off
+constexpr LEDFrame LED_FRAME_BLANK = {{0, 0, 0, 0, 0}};
+
+///LEDGreyFrame///
+// One greyscale picture, the level of every pixel from the top left, 0 to LED_MATRIX_MAX_LEVEL
+struct LEDGreyFrame {
+    uint8_t Pixels[LED_MATRIX_SIZE][LED_MATRIX_SIZE];
+};
+
+///LEDMasks///
+// A frame as the refresh uses it, for each row of the matrix and each bit plane the GPIO bits of the
+// columns to pull low. An on/off frame has the same columns in every plane
+struct LEDMasks {
+    uint32_t Lit[LED_MATRIX_ROWS][LED_MATRIX_PLANES];
+};
+
+/// LEDMatrixMasks ///
+// Works out the masks of a frame, a constexpr so the masks of a fixed picture are worked out by the compiler:
+//   constexpr LEDMasks LED_ARROW_UP_MASKS = LEDMatrixMasks(LED_ARROW_UP);
+// It still works on a frame built at run time, show() calls it once per new frame rather than once per refresh
+constexpr LEDMasks LEDMatrixMasks(const LEDFrame &Frame)
+{
+    LEDMasks Masks = {};
+    for (int r = 0; r < LED_MATRIX_SIZE; r++){
+        for (int c = 0; c < LED_MATRIX_SIZE; c++){
+            if (Frame.Rows[r] & (1 << (LED_MATRIX_SIZE - 1 - c))){
+                uint8_t Wiring = LED_MATRIX_WIRING[r][c];
+                for (int p = 0; p < LED_MATRIX_PLANES; p++){
+                    Masks.Lit[Wiring >> 4][p] |= 1UL << (LED_MATRIX_FIRST_COL_PIN + (Wiring & 0x0f));
+                    }
+                }
+            }
+        }
+    return Masks;
+}
+
+/// LEDMatrixGreyMasks ///
+// The same for a greyscale frame, a pixel is in the plane of every bit set in its level
+// Levels above LED_MATRIX_MAX_LEVEL are taken as LED_MATRIX_MAX_LEVEL
+constexpr LEDMasks LEDMatrixGreyMasks(const LEDGreyFrame &Frame)
+{
+    LEDMasks Masks = {};
+    for (int r = 0; r < LED_MATRIX_SIZE; r++){
+        for (int c = 0; c < LED_MATRIX_SIZE; c++){
+            uint8_t Level = (Frame.Pixels[r][c] > LED_MATRIX_MAX_LEVEL) ? LED_MATRIX_MAX_LEVEL : Frame.Pixels[r][c];
+            uint8_t Wiring = LED_MATRIX_WIRING[r][c];
+            for (int p = 0; p < LED_MATRIX_PLANES; p++){
+                if (Level & (1 << p)){
+                    Masks.Lit[Wiring >> 4][p] |= 1UL << (LED_MATRIX_FIRST_COL_PIN + (Wiring & 0x0f));
+                    }
+                }
+            }
+        }
+    return Masks;
+}
+
+///LEDMatrix///
+// Owns the frame buffer of the display, the rest of the firmware draws by handing it a whole frame with show()
+// A chain of timeouts lights the rows one after another, for each row it goes through the bit planes and then
+// the dark part of the row. Every step writes the row and all nine columns to NRF_GPIO->OUT in one go, the pins
+// all change on the same clock edge so no LED is ever driven with the columns of another row and there is no
+// ghosting. Nothing waits, each interrupt does one step and sets the timeout for the next
+// There are never more than LED_MATRIX_PLANES + 1 interrupts per row whatever is on the display, 2000 a second
+// of a few microseconds each, the dark step is left out at full brightness
+// The frame is held as LEDMasks, so a step is a couple of loads, an OR and a store. The interrupt is
+// the only code that changes these pins, DigitalOut and the mbed GPIO functions are not used for them
+// show() writes the new frame into a back buffer, the refresh swaps it in as it starts on the first row, so
+// every refresh shows one whole frame and frames can be shown as fast as they arrive without tearing. A frame
+// shown before the last one was swapped in replaces it
+// The overlay is ORed on top of whatever frame is showing at full level, for single LEDs that show state
+// (the button, the LED characteristic) and have to stay lit whatever picture is drawn under them
+// Brightness scales the lit part of every row and so the current the display draws, at the lowest settings
+// the steps are as short as the us_ticker allows and the levels are less even
+// stop() ends the chain of timeouts and turns every row off so a blank display does not wake the micro:bit,
+// the overlay goes dark with it until start() is called again
+class LEDMatrix {
+public:
+    LEDMatrix() :
+        Masks(LEDMatrixMasks(LED_FRAME_BLANK)), Back(LEDMatrixMasks(LED_FRAME_BLANK)), SwapPending(false),
+        Overlay(LED_FRAME_BLANK), OverlayMasks(LEDMatrixMasks(LED_FRAME_BLANK)),
+        Row(0), Plane(0), Running(false), Brightness(LED_MATRIX_MAX_BRIGHTNESS), UnitUs(0)
+    {
+        brightness(LED_MATRIX_MAX_BRIGHTNESS);
+        // Every row off and every column high, then make them outputs
+        NRF_GPIO->OUTCLR = LED_MATRIX_ROW_PINS;
+        NRF_GPIO->OUTSET = LED_MATRIX_COL_PINS;
+        NRF_GPIO->DIRSET = LED_MATRIX_PINS;
+    }
+
+    /// start ///
+    // Starts the refresh, called from main() and again after stop(), does nothing if it is already running
+    void start()
+    {
+        if (Running){
+            return;
+            }
+        Running = true;
+        Row     = 0;
+        Plane   = 0;
+        step();
+    }
+
+    /// stop ///
+    // Stops the refresh and turns every row off, the frames shown while stopped are lit by the next start()
+    // Interrupts are off while the timeout is detached so a step can not set it again in between
+    void stop()
+    {
+        core_util_critical_section_enter();
+        Next.detach();
+        NRF_GPIO->OUT = (NRF_GPIO->OUT & ~LED_MATRIX_PINS) | LED_MATRIX_COL_PINS;
+        Running = false;
+        core_util_critical_section_exit();
+    }
+
+    // True from start() until stop()
+    bool running() const {
+        return Running;
+    }
+
+    /// show ///
+    // Replaces the frame on the display from the next refresh, from the main loop or an interrupt
+    // The copy into the back buffer is done with interrupts off so the refresh never swaps in half a frame
+    void show(const LEDMasks &NewMasks)
+    {
+        core_util_critical_section_enter();
+        Back        = NewMasks;
+        SwapPending = true;
+        core_util_critical_section_exit();
+    }
+    void show(const LEDFrame &NewFrame)
+    {
+        show(LEDMatrixMasks(NewFrame));
+    }
+    void show(const LEDGreyFrame &NewFrame)
+    {
+        show(LEDMatrixGreyMasks(NewFrame));
+    }
+
+    /// overlay ///
+    // Turns one LED of the overlay on or off, Row and Col count from the top left corner
+    void overlay(int Row, int Col, bool On)
+    {
+        uint8_t Bit = 1 << (LED_MATRIX_SIZE - 1 - Col);
+        // The button ticker and the bluetooth stack can both be in here, one must not undo the other's change
+        core_util_critical_section_enter();
+        if (On){
+            Overlay.Rows[Row] |= Bit;
+            }
+        else{
+            Overlay.Rows[Row] &= ~Bit;
+            }
+        OverlayMasks = LEDMatrixMasks(Overlay);
+        core_util_critical_section_exit();
+    }
+
+    /// brightness ///
+    // Sets the brightness of the whole display, 0 (off) to LED_MATRIX_MAX_BRIGHTNESS, taken up from the next row
+    void brightness(uint8_t Level)
+    {
+        uint32_t Unit = (LED_MATRIX_ROW_US * Level) / (LED_MATRIX_MAX_BRIGHTNESS * LED_MATRIX_MAX_LEVEL);
+        if ((Level != 0) && (Unit < LED_MATRIX_MIN_UNIT_US)){
+            Unit = LED_MATRIX_MIN_UNIT_US;
+            }
+        Brightness = Level;
+        UnitUs     = Unit;
+    }
+
+    uint8_t brightness() const {
+        return Brightness;
+    }
+
+private:
+    /// step ///
+    // Called by the timeout, lights the next bit plane of the row, or the dark part of the row once the planes are done
+    void step()
+    {
+        if ((Row == 0) && (Plane == 0) && SwapPending){
+            Masks       = Back;
+            SwapPending = false;
+            }
+        uint32_t Unit = UnitUs;
+        uint32_t Us;
+        uint32_t Pins;
+        if ((Plane < LED_MATRIX_PLANES) && (Unit != 0)){
+            uint32_t Columns = LED_MATRIX_COL_PINS & ~(Masks.Lit[Row][Plane] | OverlayMasks.Lit[Row][Plane]);
+            Pins = (1UL << (LED_MATRIX_FIRST_ROW_PIN + Row)) | Columns;
+            Us   = Unit << Plane;
+            Plane++;
+            }
+        else{
+            // The rest of the row is dark, left out if it is too short for the us_ticker
+            Pins = LED_MATRIX_COL_PINS;
+            Us   = LED_MATRIX_ROW_US - (Unit * LED_MATRIX_MAX_LEVEL);
+            if (Us < LED_MATRIX_MIN_UNIT_US){
+                Us = 0;
+                }
+            Plane = 0;
+            Row   = (Row + 1) % LED_MATRIX_ROWS;
+            }
+        NRF_GPIO->OUT = (NRF_GPIO->OUT & ~LED_MATRIX_PINS) | Pins;
+        if (Us == 0){
+            step();
+            return;
+            }
+        Next.attach_us(callback(this, &LEDMatrix::step), Us);
+    }
+
+    Timeout Next;
+    // The frame being refreshed and the one to swap in at the start of the next refresh
+    LEDMasks Masks;
+    LEDMasks Back;
+    volatile bool SwapPending;
+    LEDFrame Overlay;
+    LEDMasks OverlayMasks;
+    // Where the refresh is, the matrix row and the bit plane lit next
+    int Row;
+    int Plane;
+    volatile bool Running;
+    uint8_t Brightness;
+    // Length of the shortest plane
+    volatile uint32_t UnitUs;
+};
+
+#endif /* #ifndef __LED_MATRIX_H__ */
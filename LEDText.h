@@ -0,0 +1,255 @@
+// LED Text: Scrolls text across the LED display, the font and the masks it is drawn with are worked out by the compiler
+#ifndef __LED_TEXT_H__
+#define __LED_TEXT_H__
+#include <mbed.h>
+#include "LEDMatrix.h"
+
+// The font covers the printable ASCII characters, anything else is drawn as a '?'
+const char LED_FONT_FIRST = ' ';
+const char LED_FONT_LAST  = '~';
+const int LED_FONT_GLYPHS = LED_FONT_LAST - LED_FONT_FIRST + 1;
+// Blank columns between two characters, and the width of a character with nothing lit (the space)
+const int LED_TEXT_GAP         = 1;
+const int LED_TEXT_SPACE_WIDTH = 2;
+// Longest text laid out, in columns of the display. A character is up to 6 columns with the gap after it so
+// this is at least 19 characters, longer text is cut short
+const int LED_TEXT_MAX_COLUMNS = 128;
+
+///LED_FONT///
+// One LEDFrame per character from LED_FONT_FIRST, drawn against the left hand side, in binary like the arrows
+// Most characters are 4 columns wide, a character is as wide as the right most column it lights
+constexpr LEDFrame LED_FONT[LED_FONT_GLYPHS] = {
+    {{0b00000, 0b00000, 0b00000, 0b00000, 0b00000}}, // space
+    {{0b10000, 0b10000, 0b10000, 0b00000, 0b10000}}, // !
+    {{0b10100, 0b10100, 0b00000, 0b00000, 0b00000}}, // "
+    {{0b01010, 0b11111, 0b01010, 0b11111, 0b01010}}, // #
+    {{0b01111, 0b10100, 0b01110, 0b00101, 0b11110}}, // $
+    {{0b10001, 0b00010, 0b00100, 0b01000, 0b10001}}, // %
+    {{0b01100, 0b10010, 0b01100, 0b10010, 0b01101}}, // &
+    {{0b10000, 0b10000, 0b00000, 0b00000, 0b00000}}, // '
+    {{0b01000, 0b10000, 0b10000, 0b10000, 0b01000}}, // (
+    {{0b10000, 0b01000, 0b01000, 0b01000, 0b10000}}, // )
+    {{0b00000, 0b10100, 0b01000, 0b10100, 0b00000}}, // *
+    {{0b00000, 0b01000, 0b11100, 0b01000, 0b00000}}, // +
+    {{0b00000, 0b00000, 0b00000, 0b01000, 0b10000}}, // ,
+    {{0b00000, 0b00000, 0b11100, 0b00000, 0b00000}}, // -
+    {{0b00000, 0b00000, 0b00000, 0b00000, 0b10000}}, // .
+    {{0b00001, 0b00010, 0b00100, 0b01000, 0b10000}}, // /
+    {{0b01100, 0b10010, 0b10010, 0b10010, 0b01100}}, // 0
+    {{0b01000, 0b11000, 0b01000, 0b01000, 0b11100}}, // 1
+    {{0b11100, 0b00010, 0b01100, 0b10000, 0b11110}}, // 2
+    {{0b11100, 0b00010, 0b01100, 0b00010, 0b11100}}, // 3
+    {{0b00100, 0b01100, 0b10100, 0b11110, 0b00100}}, // 4
+    {{0b11110, 0b10000, 0b11100, 0b00010, 0b11100}}, // 5
+    {{0b01100, 0b10000, 0b11100, 0b10010, 0b01100}}, // 6
+    {{0b11110, 0b00010, 0b00100, 0b01000, 0b01000}}, // 7
+    {{0b01100, 0b10010, 0b01100, 0b10010, 0b01100}}, // 8
+    {{0b01100, 0b10010, 0b01110, 0b00010, 0b01100}}, // 9
+    {{0b00000, 0b10000, 0b00000, 0b10000, 0b00000}}, // :
+    {{0b00000, 0b01000, 0b00000, 0b01000, 0b10000}}, // ;
+    {{0b00100, 0b01000, 0b10000, 0b01000, 0b00100}}, // <
+    {{0b00000, 0b11100, 0b00000, 0b11100, 0b00000}}, // =
+    {{0b10000, 0b01000, 0b00100, 0b01000, 0b10000}}, // >
+    {{0b11100, 0b00010, 0b01100, 0b00000, 0b01000}}, // ?
+    {{0b01110, 0b10001, 0b10111, 0b10101, 0b01110}}, // @
+    {{0b01100, 0b10010, 0b11110, 0b10010, 0b10010}}, // A
+    {{0b11100, 0b10010, 0b11100, 0b10010, 0b11100}}, // B
+    {{0b01110, 0b10000, 0b10000, 0b10000, 0b01110}}, // C
+    {{0b11100, 0b10010, 0b10010, 0b10010, 0b11100}}, // D
+    {{0b11110, 0b10000, 0b11100, 0b10000, 0b11110}}, // E
+    {{0b11110, 0b10000, 0b11100, 0b10000, 0b10000}}, // F
+    {{0b01110, 0b10000, 0b10110, 0b10010, 0b01110}}, // G
+    {{0b10010, 0b10010, 0b11110, 0b10010, 0b10010}}, // H
+    {{0b11100, 0b01000, 0b01000, 0b01000, 0b11100}}, // I
+    {{0b11110, 0b00010, 0b00010, 0b10010, 0b01100}}, // J
+    {{0b10010, 0b10100, 0b11000, 0b10100, 0b10010}}, // K
+    {{0b10000, 0b10000, 0b10000, 0b10000, 0b11110}}, // L
+    {{0b10001, 0b11011, 0b10101, 0b10001, 0b10001}}, // M
+    {{0b10001, 0b11001, 0b10101, 0b10011, 0b10001}}, // N
+    {{0b01100, 0b10010, 0b10010, 0b10010, 0b01100}}, // O
+    {{0b11100, 0b10010, 0b11100, 0b10000, 0b10000}}, // P
+    {{0b01100, 0b10010, 0b10010, 0b10100, 0b01101}}, // Q
+    {{0b11100, 0b10010, 0b11100, 0b10100, 0b10010}}, // R
+    {{0b01110, 0b10000, 0b01100, 0b00010, 0b11100}}, // S
+    {{0b11111, 0b00100, 0b00100, 0b00100, 0b00100}}, // T
+    {{0b10010, 0b10010, 0b10010, 0b10010, 0b01100}}, // U
+    {{0b10001, 0b10001, 0b10001, 0b01010, 0b00100}}, // V
+    {{0b10001, 0b10001, 0b10101, 0b11011, 0b10001}}, // W
+    {{0b10001, 0b01010, 0b00100, 0b01010, 0b10001}}, // X
+    {{0b10001, 0b01010, 0b00100, 0b00100, 0b00100}}, // Y
+    {{0b11110, 0b00010, 0b01100, 0b10000, 0b11110}}, // Z
+    {{0b11000, 0b10000, 0b10000, 0b10000, 0b11000}}, // [
+    {{0b10000, 0b01000, 0b00100, 0b00010, 0b00001}}, // backslash
+    {{0b11000, 0b01000, 0b01000, 0b01000, 0b11000}}, // ]
+    {{0b01000, 0b10100, 0b00000, 0b00000, 0b00000}}, // ^
+    {{0b00000, 0b00000, 0b00000, 0b00000, 0b11110}}, // _
+    {{0b10000, 0b01000, 0b00000, 0b00000, 0b00000}}, // `
+    {{0b00000, 0b01110, 0b10010, 0b10010, 0b01110}}, // a
+    {{0b10000, 0b11100, 0b10010, 0b10010, 0b11100}}, // b
+    {{0b00000, 0b01110, 0b10000, 0b10000, 0b01110}}, // c
+    {{0b00010, 0b01110, 0b10010, 0b10010, 0b01110}}, // d
+    {{0b01100, 0b10010, 0b11110, 0b10000, 0b01110}}, // e
+    {{0b01100, 0b10000, 0b11000, 0b10000, 0b10000}}, // f
+    {{0b01110, 0b10010, 0b01110, 0b00010, 0b01100}}, // g
+    {{0b10000, 0b11100, 0b10010, 0b10010, 0b10010}}, // h
+    {{0b10000, 0b00000, 0b10000, 0b10000, 0b10000}}, // i
+    {{0b01000, 0b00000, 0b01000, 0b01000, 0b10000}}, // j
+    {{0b10000, 0b10100, 0b11000, 0b10100, 0b10100}}, // k
+    {{0b10000, 0b10000, 0b10000, 0b10000, 0b10000}}, // l
+    {{0b00000, 0b11010, 0b10101, 0b10101, 0b10101}}, // m
+    {{0b00000, 0b11100, 0b10010, 0b10010, 0b10010}}, // n
+    {{0b00000, 0b01100, 0b10010, 0b10010, 0b01100}}, // o
+    {{0b00000, 0b11100, 0b10010, 0b11100, 0b10000}}, // p
+    {{0b00000, 0b01110, 0b10010, 0b01110, 0b00010}}, // q
+    {{0b00000, 0b10100, 0b11000, 0b10000, 0b10000}}, // r
+    {{0b00000, 0b01110, 0b11000, 0b00110, 0b11100}}, // s
+    {{0b10000, 0b11100, 0b10000, 0b10000, 0b01100}}, // t
+    {{0b00000, 0b10010, 0b10010, 0b10010, 0b01110}}, // u
+    {{0b00000, 0b10100, 0b10100, 0b10100, 0b01000}}, // v
+    {{0b00000, 0b10001, 0b10101, 0b10101, 0b01010}}, // w
+    {{0b00000, 0b10100, 0b01000, 0b01000, 0b10100}}, // x
+    {{0b00000, 0b10100, 0b10100, 0b01000, 0b10000}}, // y
+    {{0b00000, 0b11110, 0b00100, 0b01000, 0b11110}}, // z
+    {{0b01100, 0b01000, 0b10000, 0b01000, 0b01100}}, // {
+    {{0b10000, 0b10000, 0b10000, 0b10000, 0b10000}}, // |
+    {{0b11000, 0b01000, 0b00100, 0b01000, 0b11000}}, // }
+    {{0b00000, 0b01010, 0b10100, 0b00000, 0b00000}} // ~
+};
+
+///LEDFontTable///
+// The font turned on its side for scrolling, every character as its columns from the left, bit 0 the top row,
+// and its width in columns
+struct LEDFontTable {
+    uint8_t Columns[LED_FONT_GLYPHS][LED_MATRIX_SIZE];
+    uint8_t Width[LED_FONT_GLYPHS];
+};
+
+/// LEDFontColumns ///
+// Works out the LEDFontTable of LED_FONT, only ever called by the compiler for LED_FONT_TABLE
+constexpr LEDFontTable LEDFontColumns()
+{
+    LEDFontTable Table = {};
+    for (int g = 0; g < LED_FONT_GLYPHS; g++){
+        for (int c = 0; c < LED_MATRIX_SIZE; c++){
+            for (int r = 0; r < LED_MATRIX_SIZE; r++){
+                if (LED_FONT[g].Rows[r] & (1 << (LED_MATRIX_SIZE - 1 - c))){
+                    Table.Columns[g][c] |= 1 << r;
+                    }
+                }
+            if (Table.Columns[g][c] != 0){
+                Table.Width[g] = c + 1;
+                }
+            }
+        if (Table.Width[g] == 0){
+            Table.Width[g] = LED_TEXT_SPACE_WIDTH;
+            }
+        }
+    return Table;
+}
+
+constexpr LEDFontTable LED_FONT_TABLE = LEDFontColumns();
+
+///LEDColumnTable///
+// For every column of the display and every one of the 32 ways a column can be lit, the GPIO bits of the
+// matrix columns to pull low in each matrix row. A frame of scrolling text is the OR of five entries
+struct LEDColumnTable {
+    uint32_t Lit[LED_MATRIX_SIZE][1 << LED_MATRIX_SIZE][LED_MATRIX_ROWS];
+};
+
+/// LEDTextColumnMasks ///
+// Works out the LEDColumnTable from the wiring of the display, only ever called by the compiler
+constexpr LEDColumnTable LEDTextColumnMasks()
+{
+    LEDColumnTable Table = {};
+    for (int c = 0; c < LED_MATRIX_SIZE; c++){
+        for (int v = 0; v < (1 << LED_MATRIX_SIZE); v++){
+            for (int r = 0; r < LED_MATRIX_SIZE; r++){
+                if (v & (1 << r)){
+                    uint8_t Wiring = LED_MATRIX_WIRING[r][c];
+                    Table.Lit[c][v][Wiring >> 4] |= 1UL << (LED_MATRIX_FIRST_COL_PIN + (Wiring & 0x0f));
+                    }
+                }
+            }
+        }
+    return Table;
+}
+
+// 1920 bytes, in flash with the font
+constexpr LEDColumnTable LED_TEXT_COLUMN_MASKS = LEDTextColumnMasks();
+
+///LEDText///
+// Scrolls a line of text from right to left, one column of the display per step()
+// set() lays the text out once as a strip of columns, with a display of blank columns before and after it
+// so it scrolls on from the right and off to the left. A step is then five lookups into
+// LED_TEXT_COLUMN_MASKS for the window of the strip on the display, nothing is worked out from the font and
+// nothing is allocated while the text scrolls
+// The steps are timed by whoever calls step(), the display service calls it from a ticker
+// set() must not run at the same time as step(), stop the ticker first
+class LEDText {
+public:
+    LEDText() :
+        Length(0), Offset(0)
+    {
+        memset(Columns, 0, LED_TEXT_MAX_COLUMNS);
+    }
+
+    /// set ///
+    // Lays out up to Count characters of Text, fewer if it ends in a zero first, and starts from the beginning
+    void set(const char *Text, int Count)
+    {
+        memset(Columns, 0, LED_TEXT_MAX_COLUMNS);
+        Length = LED_MATRIX_SIZE;
+        for (int i = 0; (i < Count) && (Text[i] != 0); i++){
+            char Character = Text[i];
+            if ((Character < LED_FONT_FIRST) || (Character > LED_FONT_LAST)){
+                Character = '?';
+                }
+            int Glyph = Character - LED_FONT_FIRST;
+            int Width = LED_FONT_TABLE.Width[Glyph];
+            int Gap   = (i == 0) ? 0 : LED_TEXT_GAP;
+            if ((Length + Gap + Width + LED_MATRIX_SIZE) > LED_TEXT_MAX_COLUMNS){
+                break;
+                }
+            Length += Gap;
+            memcpy(&Columns[Length], LED_FONT_TABLE.Columns[Glyph], Width);
+            Length += Width;
+            }
+        Length += LED_MATRIX_SIZE;
+        Offset  = 0;
+    }
+
+    /// step ///
+    // Shows the next position of the text on Matrix, returns false once it has scrolled off
+    // With Loop it starts again from the right instead
+    bool step(LEDMatrix &Matrix, bool Loop)
+    {
+        if ((Offset + LED_MATRIX_SIZE) > Length){
+            if (!Loop){
+                return false;
+                }
+            // The blank window at the end is the same as the one at the start
+            Offset = 1;
+            }
+        const uint8_t *Window = &Columns[Offset++];
+        LEDMasks Masks;
+        for (int r = 0; r < LED_MATRIX_ROWS; r++){
+            uint32_t Lit = LED_TEXT_COLUMN_MASKS.Lit[0][Window[0]][r] | LED_TEXT_COLUMN_MASKS.Lit[1][Window[1]][r] |
+                           LED_TEXT_COLUMN_MASKS.Lit[2][Window[2]][r] | LED_TEXT_COLUMN_MASKS.Lit[3][Window[3]][r] |
+                           LED_TEXT_COLUMN_MASKS.Lit[4][Window[4]][r];
+            for (int p = 0; p < LED_MATRIX_PLANES; p++){
+                Masks.Lit[r][p] = Lit;
+                }
+            }
+        Matrix.show(Masks);
+        return true;
+    }
+
+private:
+    // The text laid out as columns, bit 0 the top row, and how many of them there are
+    uint8_t Columns[LED_TEXT_MAX_COLUMNS];
+    int Length;
+    // The column at the left hand side of the display on the next step
+    int Offset;
+};
+
+#endif /* #ifndef __LED_TEXT_H__ */
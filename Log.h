@@ -0,0 +1,193 @@
+// Log: Deferred logging to the serial console, records are queued in RAM from any context and printed from the main loop
+#ifndef __LOG_H__
+#define __LOG_H__
+#include <mbed.h>
+#include <stdio.h>
+
+// Log levels, a record is only compiled in if its level is LOG_LEVEL or lower
+// LOG_LEVEL_NONE  - Nothing is logged, every LOG_ call compiles to nothing
+// LOG_LEVEL_ERROR - Something failed and was given up on
+// LOG_LEVEL_WARN  - Something failed and was retried or worked around
+// LOG_LEVEL_INFO  - State changes, going idle and waking up
+// LOG_LEVEL_DEBUG - Every sample published, fills the ring quickly at high output data rates
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// Build with -DLOG_LEVEL=LOG_LEVEL_INFO to leave the sample records out
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Records held until the main loop prints them, must be a power of 2. At 9600 baud a record takes
+// about 30ms to print, so the ring covers half a second of logging faster than that
+#ifndef LOG_RING_LENGTH
+#define LOG_RING_LENGTH 16
+#endif
+
+// Longest line printed for one record, a longer one is cut short
+const int LOG_LINE_LENGTH = 64;
+
+///LogRecord///
+// What is queued for every call, the format is not applied until the record is printed
+// Format must be a string literal (it stays in flash, only the pointer is kept) with up to three %d
+struct LogRecord {
+    uint32_t Timestamp;
+    const char *Format;
+    int Args[3];
+    uint8_t Level;
+};
+
+///LogBuffer///
+// printf on the serial console waits for every character to go out, at 9600 baud a line of 20 characters
+// holds up whatever called it for 20ms. write() copies the arguments into a ring of LogRecords instead and
+// returns straight away, drain() does the formatting and printing later in the main loop
+// write() can be called from the main loop, a ticker or a pin interrupt, the slot is taken in a short
+// critical section like I2CQueue::enqueue() since the Cortex-M0 has no exclusive loads and stores
+// When the ring is full the record is dropped and counted, drain() prints how many went missing once it
+// has caught up, so a gap in the log is never silent
+// drain() only hands the serial port as many characters as it will take without waiting (writeable()),
+// a line longer than that is finished by the next call. It can also be called from the TX interrupt of a
+// RawSerial, Serial locks a mutex and must stay in the main loop
+class LogBuffer {
+public:
+    LogBuffer() :
+        Head(0), Tail(0), Dropped(0), Reported(0), LineLength(0), LinePosition(0)
+    {
+        static_assert((LOG_RING_LENGTH & (LOG_RING_LENGTH - 1)) == 0, "LOG_RING_LENGTH must be a power of 2");
+    }
+
+    /// write ///
+    // Queues one record, use the LOG_ macros below so records above LOG_LEVEL are compiled out
+    void write(uint8_t Level, const char *Format, int A = 0, int B = 0, int C = 0)
+    {
+        uint32_t Now = us_ticker_read();
+        core_util_critical_section_enter();
+        if ((Head - Tail) >= LOG_RING_LENGTH){
+            Dropped++;
+            }
+        else{
+            LogRecord &Record = Ring[Head & (LOG_RING_LENGTH - 1)];
+            Record.Timestamp = Now;
+            Record.Format    = Format;
+            Record.Args[0]   = A;
+            Record.Args[1]   = B;
+            Record.Args[2]   = C;
+            Record.Level     = Level;
+            Head++;
+            }
+        core_util_critical_section_exit();
+    }
+
+    /// drain ///
+    // Prints what it can of the queued records on Out without waiting, returns true once everything has gone
+    // Out is the Serial or RawSerial to print on, it needs writeable() and putc()
+    template <typename Output>
+    bool drain(Output &Out)
+    {
+        while (true){
+            while (LinePosition < LineLength){
+                if (!Out.writeable()){
+                    return false;
+                    }
+                Out.putc(Line[LinePosition++]);
+                }
+            if (!format()){
+                return true;
+                }
+            }
+    }
+
+    // Records dropped because the ring was full
+    uint32_t dropped() const {
+        return Dropped;
+    }
+
+private:
+    // Formats the next thing to print into Line, returns false if there is nothing
+    bool format()
+    {
+        int Length;
+        uint32_t Missing = Dropped - Reported;
+        if ((Missing != 0) && (Head == Tail)){
+            // Only once the backlog has gone, otherwise the count goes up again straight away
+            Reported += Missing;
+            Length = snprintf(Line, LOG_LINE_LENGTH, "log: %lu records dropped\n\r", (unsigned long)Missing);
+            }
+        else if (Head != Tail){
+            LogRecord Record = Ring[Tail & (LOG_RING_LENGTH - 1)];
+            // The record must be copied out before write() can reuse its slot
+            __sync_synchronize();
+            Tail = Tail + 1;
+            int Prefix = snprintf(Line, LOG_LINE_LENGTH, "%lu %c ", (unsigned long)(Record.Timestamp / 1000), level(Record.Level));
+            Length = Prefix + snprintf(Line + Prefix, LOG_LINE_LENGTH - Prefix, Record.Format, Record.Args[0], Record.Args[1], Record.Args[2]);
+            if (Length > (LOG_LINE_LENGTH - 3)){
+                Length = LOG_LINE_LENGTH - 3;
+                }
+            Line[Length++] = '\n';
+            Line[Length++] = '\r';
+            }
+        else{
+            return false;
+            }
+        LineLength   = Length;
+        LinePosition = 0;
+        return true;
+    }
+
+    static char level(uint8_t Level)
+    {
+        switch (Level){
+            case LOG_LEVEL_ERROR:
+                return 'E';
+            case LOG_LEVEL_WARN:
+                return 'W';
+            case LOG_LEVEL_INFO:
+                return 'I';
+            default:
+                return 'D';
+            }
+    }
+
+    LogRecord Ring[LOG_RING_LENGTH];
+    // Head - Records ever queued, Tail - Records ever taken off to be printed
+    volatile uint32_t Head;
+    volatile uint32_t Tail;
+    volatile uint32_t Dropped;
+    // Dropped records already reported
+    uint32_t Reported;
+    // The line being printed
+    char Line[LOG_LINE_LENGTH];
+    int LineLength;
+    int LinePosition;
+};
+
+// The log every service writes to, main.cpp drains it onto pc
+LogBuffer Log;
+
+// Logging calls, LOG_INFO("Woken after %d ms", Ms) and so on with up to three int arguments
+// Calls above LOG_LEVEL compile to nothing, their arguments are not even worked out
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(Format, ...) Log.write(LOG_LEVEL_ERROR, Format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(Format, ...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(Format, ...) Log.write(LOG_LEVEL_WARN, Format, ##__VA_ARGS__)
+#else
+#define LOG_WARN(Format, ...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(Format, ...) Log.write(LOG_LEVEL_INFO, Format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(Format, ...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(Format, ...) Log.write(LOG_LEVEL_DEBUG, Format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(Format, ...) ((void)0)
+#endif
+
+#endif /* #ifndef __LOG_H__ */
@@ -0,0 +1,281 @@
+// Mag Calibration: Hard and soft iron calibration of the MAG3110, kept in flash between power cycles
+// Hard and soft iron - NXP AN4246: https://www.nxp.com/docs/en/application-note/AN4246.pdf
+// Persistent storage - https://infocenter.nordicsemi.com/topic/com.nordic.infocenter.sdk51.v10.0.0/lib_pstorage.html
+#ifndef __MAG_CALIBRATION_H__
+#define __MAG_CALIBRATION_H__
+#include <stdint.h>
+#include "SensorFrame.h"
+#include "nrf_error.h"
+#include "pstorage.h"
+
+// Commands written to the calibration control characteristic
+// MAG_CALIBRATION_START - Forget the previous minimum and maximum and start collecting, rotate the board
+//                         slowly through every orientation while collecting
+// MAG_CALIBRATION_STOP  - Work out the coefficients from what was collected and save them to flash
+// MAG_CALIBRATION_CLEAR - Go back to raw counts and erase the saved coefficients
+const uint8_t MAG_CALIBRATION_START = 1;
+const uint8_t MAG_CALIBRATION_STOP  = 2;
+const uint8_t MAG_CALIBRATION_CLEAR = 3;
+
+// State of the calibration, the value read back from the control characteristic
+// MAG_CALIBRATION_UNCALIBRATED - Raw counts are published
+// MAG_CALIBRATION_COLLECTING   - Collecting the minimum and maximum of every axis
+// MAG_CALIBRATION_CALIBRATED   - The coefficients are applied to every sample
+// MAG_CALIBRATION_FAILED       - The board was not turned far enough, the previous coefficients are still applied
+// MAG_CALIBRATION_NOT_SAVED    - The new coefficients are applied but writing or erasing the flash failed, the
+//                                previous coefficients come back at the next power cycle
+const uint8_t MAG_CALIBRATION_UNCALIBRATED = 0;
+const uint8_t MAG_CALIBRATION_COLLECTING   = 1;
+const uint8_t MAG_CALIBRATION_CALIBRATED   = 2;
+const uint8_t MAG_CALIBRATION_FAILED       = 3;
+const uint8_t MAG_CALIBRATION_NOT_SAVED    = 4;
+
+// Every axis must have swung through at least this many counts for a calibration to be accepted
+// The MAG3110 reads 0.1uT per count and the earth's field is 25 to 65uT, a full turn spans 500 counts or more
+const int32_t MAG_CALIBRATION_MIN_SPAN = 200;
+
+// The scale of each axis is a fixed point number with 14 fractional bits, 16384 is a scale of 1
+const uint8_t  MAG_CALIBRATION_SCALE_SHIFT = 14;
+const uint16_t MAG_CALIBRATION_SCALE_ONE   = 1 << MAG_CALIBRATION_SCALE_SHIFT;
+
+// Marks a block of flash as holding coefficients, erased flash reads back as 0xffffffff
+const uint32_t MAG_CALIBRATION_MAGIC = 0x3147414d; // "MAG1"
+
+///MagCalibrationCoefficients///
+// What is kept in flash, 16 bytes so it fills exactly one pstorage block (PSTORAGE_MIN_BLOCK_SIZE)
+// Magic  - MAG_CALIBRATION_MAGIC if the block holds coefficients
+// Offset - Hard iron offset of each axis in counts, the centre of the sphere traced out by the field
+// Scale  - Soft iron scale of each axis, stretches the squashed sphere back into a sphere
+struct MagCalibrationCoefficients {
+    uint32_t Magic;
+    int16_t  Offset[3];
+    uint16_t Scale[3];
+};
+
+// Length of the offsets and scales read from the coefficients characteristic
+const uint16_t MAG_CALIBRATION_COEFFICIENTS_LENGTH = sizeof(MagCalibrationCoefficients) - sizeof(uint32_t);
+
+// Flash operations finish some time after they are started, pstorage tells us through this callback
+// from the soft device system event handler. No new operation is started until the last has finished
+// as pstorage writes straight from the buffer it was given. pstorage_load() calls back straight away and
+// never fails, only a write or an erase can go wrong
+volatile bool MagCalibrationFlashBusy = false;
+volatile bool MagCalibrationFlashFailed = false;
+
+void MagCalibrationFlashCallback(pstorage_handle_t *, uint8_t OpCode, uint32_t Result, uint8_t *, uint32_t)
+{
+    if (OpCode == PSTORAGE_LOAD_OP_CODE){
+        return;
+        }
+    if (Result != NRF_SUCCESS){
+        MagCalibrationFlashFailed = true;
+        }
+    MagCalibrationFlashBusy = false;
+}
+
+///MagCalibration///
+// Collects the minimum and maximum of each axis while the board is turned, then works out an offset and
+// a scale for each axis. The scale only corrects soft iron along the sensor axes, an ellipsoid tilted
+// away from the axes needs a full matrix which is left to a client that really needs it
+// command() may be called from the bluetooth callbacks, everything else runs in the main loop
+class MagCalibration {
+public:
+    MagCalibration() :
+        PendingCommand(0), State(MAG_CALIBRATION_UNCALIBRATED), FlashRequest(0), Registered(false)
+    {
+        setIdentity(Coefficients);
+    }
+
+    /// begin ///
+    // Registers a block of flash with pstorage and loads any coefficients saved in it
+    // The bluetooth stack only calls pstorage_init() itself when security is enabled, which this
+    // firmware never does, so it is done here. pstorage is set up for a single user (PSTORAGE_NUM_OF_PAGES)
+    void begin()
+    {
+        pstorage_module_param_t Param;
+        Param.cb          = MagCalibrationFlashCallback;
+        Param.block_size  = sizeof(MagCalibrationCoefficients);
+        Param.block_count = 1;
+        if ((pstorage_init() != NRF_SUCCESS) || (pstorage_register(&Param, &Handle) != NRF_SUCCESS)){
+            return;
+            }
+        Registered = true;
+
+        MagCalibrationCoefficients Loaded;
+        if ((pstorage_load((uint8_t *)&Loaded, &Handle, sizeof(Loaded), 0) == NRF_SUCCESS) && valid(Loaded)){
+            Coefficients = Loaded;
+            State = MAG_CALIBRATION_CALIBRATED;
+            }
+    }
+
+    /// command ///
+    // Queues one of the MAG_CALIBRATION_ commands for the next update()
+    void command(uint8_t Command)
+    {
+        PendingCommand = Command;
+    }
+
+    /// update ///
+    // Carries out a queued command and starts any flash operation waiting for the last one to finish
+    // Returns true if the state or the coefficients changed so the characteristics need rewriting
+    bool update()
+    {
+        bool Changed = false;
+        uint8_t Command = PendingCommand;
+        PendingCommand = 0;
+        // Only one flash operation is outstanding so the flag can not be set again until startFlash()
+        // A calibration started since the write is left collecting, it will be saved again when it stops
+        if (MagCalibrationFlashFailed){
+            MagCalibrationFlashFailed = false;
+            if (State != MAG_CALIBRATION_COLLECTING){
+                State = MAG_CALIBRATION_NOT_SAVED;
+                Changed = true;
+                }
+            }
+        if (Command == MAG_CALIBRATION_START){
+            for (int Axis = 0; Axis < 3; Axis++){
+                Minimum[Axis] = INT16_MAX;
+                Maximum[Axis] = INT16_MIN;
+                }
+            State = MAG_CALIBRATION_COLLECTING;
+            Changed = true;
+            }
+        else if ((Command == MAG_CALIBRATION_STOP) && (State == MAG_CALIBRATION_COLLECTING)){
+            if (solve()){
+                State = MAG_CALIBRATION_CALIBRATED;
+                FlashRequest = MAG_CALIBRATION_STOP;
+                }
+            else{
+                State = MAG_CALIBRATION_FAILED;
+                }
+            Changed = true;
+            }
+        else if (Command == MAG_CALIBRATION_CLEAR){
+            setIdentity(Coefficients);
+            State = MAG_CALIBRATION_UNCALIBRATED;
+            FlashRequest = MAG_CALIBRATION_CLEAR;
+            Changed = true;
+            }
+
+        if (FlashRequest && Registered && !MagCalibrationFlashBusy){
+            startFlash();
+            }
+        return Changed;
+    }
+
+    /// process ///
+    // Called with every raw sample, collects it if calibrating and then corrects it in place
+    // Corrected = (Raw - Offset) * Scale / 16384, all in integer maths
+    void process(SensorFrame &Frame)
+    {
+        int16_t *Axes[3] = {&Frame.X, &Frame.Y, &Frame.Z};
+        for (int Axis = 0; Axis < 3; Axis++){
+            int32_t Raw = *Axes[Axis];
+            if (State == MAG_CALIBRATION_COLLECTING){
+                if (Raw < Minimum[Axis]) Minimum[Axis] = Raw;
+                if (Raw > Maximum[Axis]) Maximum[Axis] = Raw;
+                }
+            int32_t Corrected = (int32_t)(((int64_t)(Raw - Coefficients.Offset[Axis]) * Coefficients.Scale[Axis]) >> MAG_CALIBRATION_SCALE_SHIFT);
+            if (Corrected > INT16_MAX){
+                Corrected = INT16_MAX;
+                }
+            else if (Corrected < INT16_MIN){
+                Corrected = INT16_MIN;
+                }
+            *Axes[Axis] = (int16_t)Corrected;
+            }
+    }
+
+    // One of the MAG_CALIBRATION_ states
+    uint8_t state() const {
+        return State;
+    }
+
+    // The offsets and scales being applied, MAG_CALIBRATION_COEFFICIENTS_LENGTH bytes
+    const uint8_t *coefficients() const {
+        return (const uint8_t *)Coefficients.Offset;
+    }
+
+private:
+    /// solve ///
+    // The field traces out a sphere as the board turns, the hard iron moves its centre and the soft iron
+    // squashes it into an ellipsoid. The centre of each axis is halfway between its minimum and maximum,
+    // each axis is then scaled so its radius matches the average radius of all three
+    // Returns false and leaves the coefficients alone if any axis was not turned far enough
+    bool solve()
+    {
+        int32_t Radius[3];
+        int32_t AverageRadius = 0;
+        for (int Axis = 0; Axis < 3; Axis++){
+            int32_t Span = Maximum[Axis] - Minimum[Axis];
+            if (Span < MAG_CALIBRATION_MIN_SPAN){
+                return false;
+                }
+            Radius[Axis] = Span / 2;
+            AverageRadius += Radius[Axis];
+            }
+        AverageRadius /= 3;
+
+        Coefficients.Magic = MAG_CALIBRATION_MAGIC;
+        for (int Axis = 0; Axis < 3; Axis++){
+            int32_t Scale = (AverageRadius << MAG_CALIBRATION_SCALE_SHIFT) / Radius[Axis];
+            Coefficients.Offset[Axis] = (int16_t)((Maximum[Axis] + Minimum[Axis]) / 2);
+            Coefficients.Scale[Axis]  = (Scale > UINT16_MAX) ? UINT16_MAX : (uint16_t)Scale;
+            }
+        return true;
+    }
+
+    /// startFlash ///
+    // Saves or erases the coefficients, pstorage_update() erases the page through the swap page first
+    // Saved is only touched again once MagCalibrationFlashCallback() says the write has finished
+    void startFlash()
+    {
+        uint32_t Error;
+        MagCalibrationFlashBusy = true;
+        if (FlashRequest == MAG_CALIBRATION_CLEAR){
+            Error = pstorage_clear(&Handle, sizeof(MagCalibrationCoefficients));
+            }
+        else{
+            Saved = Coefficients;
+            Error = pstorage_update(&Handle, (uint8_t *)&Saved, sizeof(Saved), 0);
+            }
+        if (Error != NRF_SUCCESS){
+            // The pstorage command queue is full, try again on the next update()
+            MagCalibrationFlashBusy = false;
+            return;
+            }
+        FlashRequest = 0;
+    }
+
+    // Coefficients that leave the counts as they are
+    static void setIdentity(MagCalibrationCoefficients &Identity)
+    {
+        Identity.Magic = 0;
+        for (int Axis = 0; Axis < 3; Axis++){
+            Identity.Offset[Axis] = 0;
+            Identity.Scale[Axis]  = MAG_CALIBRATION_SCALE_ONE;
+            }
+    }
+
+    // True if a block loaded from flash holds usable coefficients
+    static bool valid(const MagCalibrationCoefficients &Loaded)
+    {
+        return (Loaded.Magic == MAG_CALIBRATION_MAGIC) && Loaded.Scale[0] && Loaded.Scale[1] && Loaded.Scale[2];
+    }
+
+    volatile uint8_t PendingCommand;
+    uint8_t State;
+    uint8_t FlashRequest;
+    bool Registered;
+    pstorage_handle_t Handle;
+
+    // Coefficients being applied and the copy being written to flash
+    MagCalibrationCoefficients Coefficients;
+    MagCalibrationCoefficients Saved;
+
+    // Smallest and largest count seen on each axis while collecting
+    int32_t Minimum[3];
+    int32_t Maximum[3];
+};
+
+#endif /* #ifndef __MAG_CALIBRATION_H__ */
@@ -0,0 +1,241 @@
+// Motion Wake: Lets the micro:bit idle while the board sits still, using the MMA8653 motion detection and auto-sleep
+// Datasheet:   https://www.nxp.com/docs/en/data-sheet/MMA8653FC.pdf
+// Motion detection - NXP AN4070: https://www.nxp.com/docs/en/application-note/AN4070.pdf
+// Auto-sleep       - NXP AN4074: https://www.nxp.com/docs/en/application-note/AN4074.pdf
+#ifndef __MOTION_WAKE_H__
+#define __MOTION_WAKE_H__
+#include <stdint.h>
+
+// Registers of the MMA8653 used for motion detection and auto-sleep
+// SYSMOD      - bits 1:0 are 00 standby, 01 wake and 10 sleep, reading it clears the auto-sleep interrupt
+// INT_SOURCE  - bit 7 auto-sleep/wake, bit 2 motion, bit 0 data ready
+// FF_MT_CFG   - bit 7 latches the event (ELE), bit 6 motion rather than freefall (OAE), bits 5:3 enable Z, Y and X
+// FF_MT_SRC   - Which axes moved, reading it clears the motion interrupt
+// FF_MT_THS   - bits 6:0 threshold in 0.063g steps
+// FF_MT_COUNT - Number of samples past the threshold before the event fires (debounce)
+// ASLP_COUNT  - Time without an event before the part drops to its sleep rate, 320ms steps
+// CTRL_REG3   - bit 3 lets a motion event wake the part from sleep
+const char MMA8653_SYSMOD = 0x0b;
+const char MMA8653_INT_SOURCE = 0x0c;
+const char MMA8653_FF_MT_CFG = 0x15;
+const char MMA8653_FF_MT_SRC = 0x16;
+const char MMA8653_FF_MT_THS = 0x17;
+const char MMA8653_FF_MT_COUNT = 0x18;
+const char MMA8653_ASLP_COUNT = 0x29;
+const char MMA8653_CTRL_REG3 = 0x2c;
+
+// Register bits
+const uint8_t MMA8653_SYSMOD_SLEEP    = 0x02;
+const uint8_t MMA8653_SRC_ASLP        = 0x80;
+const uint8_t MMA8653_SRC_FF_MT       = 0x04;
+const uint8_t MMA8653_INT_EN_ASLP     = 0x80;
+const uint8_t MMA8653_INT_EN_FF_MT    = 0x04;
+const uint8_t MMA8653_WAKE_FF_MT      = 0x08;
+const uint8_t MMA8653_SLPE            = 0x04;
+// CTRL_REG1 bits 7:6 = 11, 1.56Hz while asleep, CTRL_REG2 bits 4:3 = 11, low power oversampling while asleep
+const uint8_t MMA8653_ASLP_RATE_1HZ56 = 0xc0;
+const uint8_t MMA8653_SMODS_LOW_POWER = 0x18;
+// Motion on the X or Y axis, latched. The MMA8653 has no high pass filter in front of the motion detection
+// so Z would always see gravity with the board lying flat, tilting or shaking it shows up on X and Y
+const uint8_t MMA8653_FF_MT_MOTION_XY = 0x80 | 0x40 | 0x10 | 0x08;
+
+// Motion wake states, also the first byte of the status characteristic
+// MOTION_WAKE_AWAKE  - Sampling and streaming at the configured rate
+// MOTION_WAKE_ASLEEP - The board has been still for SleepAfter seconds, sampling has stopped until it moves
+const uint8_t MOTION_WAKE_AWAKE  = 0;
+const uint8_t MOTION_WAKE_ASLEEP = 1;
+
+///MotionConfig///
+// Written by a client to the motion config characteristic, 4 bytes
+// Enabled    - 1 to let the micro:bit idle while the board is still, 0 to sample all the time
+// Threshold  - Acceleration on X or Y that counts as motion in 0.063g steps, 1 to 127
+// Count      - Samples at the active output data rate the threshold must be passed for, 0 to 255
+// SleepAfter - Seconds without motion before sampling stops, 1 to 81
+struct MotionConfig {
+    uint8_t Enabled;
+    uint8_t Threshold;
+    uint8_t Count;
+    uint8_t SleepAfter;
+};
+const int MOTION_CONFIG_LENGTH = 4;
+
+// The starting configuration, off, 0.5g for 2 samples and asleep after 10 seconds still
+const uint8_t MOTION_CONFIG_DEFAULT_THRESHOLD   = 8;
+const uint8_t MOTION_CONFIG_DEFAULT_COUNT       = 2;
+const uint8_t MOTION_CONFIG_DEFAULT_SLEEP_AFTER = 10;
+const uint8_t MOTION_CONFIG_MAX_SLEEP_AFTER     = 81;
+
+/// MotionConfigValid ///
+// Returns true if every field of Config is in range
+inline bool MotionConfigValid(const MotionConfig &Config)
+{
+    return (Config.Enabled <= 1) &&
+           (Config.Threshold >= 1) && (Config.Threshold <= 127) &&
+           (Config.SleepAfter >= 1) && (Config.SleepAfter <= MOTION_CONFIG_MAX_SLEEP_AFTER);
+}
+
+///MotionStatus///
+// Value of the motion status characteristic, notified on every change, 8 bytes
+// State         - MOTION_WAKE_AWAKE or MOTION_WAKE_ASLEEP
+// Wakes         - Number of times motion has woken the micro:bit
+// WakeLatencyUs - Time from the MMA8653 signalling motion to the first accelerometer batch being notified
+//                 after the last wake, 0 until the first one
+struct MotionStatus {
+    uint8_t State;
+    uint8_t Reserved;
+    uint16_t Wakes;
+    uint32_t WakeLatencyUs;
+};
+
+///MotionWake///
+// The state machine behind the low power mode, owned by the accelerometer service
+// With motion wake enabled the MMA8653 does the watching itself
+// - Auto-sleep drops it to 1.56Hz once nothing has passed the motion threshold for SleepAfter seconds
+// - Motion past the threshold wakes it back up to the configured output data rate
+// Both raise an interrupt on INT2 (P0_27), kept apart from the data ready interrupt on INT1
+// The accelerometer service reads SYSMOD and INT_SOURCE when INT2 goes low and hands them to onSource(),
+// SYSMOD says which state the part is now in. The main loop picks the change up with update() and
+// stops or restarts the polling tickers and the magnetometer, while asleep the micro:bit only wakes
+// for the bluetooth stack, the button and the INT2 pin
+//
+// The time INT2 went low is kept so the wake latency can be measured up to the first notification
+// of the accelerometer batch characteristic, the first data a client sees after the board moves
+class MotionWake {
+public:
+    MotionWake() :
+        State(MOTION_WAKE_AWAKE), Changed(false), EdgeUs(0), HaveEdge(false), WakeUs(0), LatencyPending(false)
+    {
+        Config.Enabled    = 0;
+        Config.Threshold  = MOTION_CONFIG_DEFAULT_THRESHOLD;
+        Config.Count      = MOTION_CONFIG_DEFAULT_COUNT;
+        Config.SleepAfter = MOTION_CONFIG_DEFAULT_SLEEP_AFTER;
+        Status.State         = MOTION_WAKE_AWAKE;
+        Status.Reserved      = 0;
+        Status.Wakes         = 0;
+        Status.WakeLatencyUs = 0;
+    }
+
+    /// configure ///
+    // Takes a new configuration, the accelerometer service then rewrites the registers below
+    // Turning motion wake off while asleep wakes straight away
+    void configure(const MotionConfig &NewConfig)
+    {
+        Config = NewConfig;
+        if (!Config.Enabled && (State == MOTION_WAKE_ASLEEP)){
+            setState(MOTION_WAKE_AWAKE);
+            }
+    }
+
+    const MotionConfig &config() const {
+        return Config;
+    }
+
+    // Bits to OR into CTRL_REG1 to CTRL_REG4 and the values of the motion registers for the configuration
+    uint8_t ctrlReg1() const {
+        return Config.Enabled ? MMA8653_ASLP_RATE_1HZ56 : 0;
+    }
+    uint8_t ctrlReg2() const {
+        return Config.Enabled ? (MMA8653_SLPE | MMA8653_SMODS_LOW_POWER) : 0;
+    }
+    uint8_t ctrlReg3() const {
+        return Config.Enabled ? MMA8653_WAKE_FF_MT : 0;
+    }
+    uint8_t ctrlReg4() const {
+        return Config.Enabled ? (MMA8653_INT_EN_ASLP | MMA8653_INT_EN_FF_MT) : 0;
+    }
+    uint8_t ffMtCfg() const {
+        return Config.Enabled ? MMA8653_FF_MT_MOTION_XY : 0;
+    }
+    uint8_t ffMtThs() const {
+        return Config.Threshold;
+    }
+    uint8_t ffMtCount() const {
+        return Config.Count;
+    }
+    // 320ms steps, 81 seconds is 253
+    uint8_t aslpCount() const {
+        return ((uint16_t)Config.SleepAfter * 25) / 8;
+    }
+
+    /// onInterrupt ///
+    // Called on the falling edge of INT2, the first edge since the last onSource() is when the motion started
+    void onInterrupt(uint32_t Now)
+    {
+        if (!HaveEdge){
+            EdgeUs   = Now;
+            HaveEdge = true;
+            }
+    }
+
+    /// onSource ///
+    // Called with SYSMOD and INT_SOURCE once they have been read
+    // Returns true if a motion event is latched and FF_MT_SRC must be read to clear it
+    bool onSource(uint8_t Sysmod, uint8_t Source, uint32_t Now)
+    {
+        uint32_t Edge = HaveEdge ? EdgeUs : Now;
+        HaveEdge = false;
+        if (Config.Enabled && (Source & MMA8653_SRC_ASLP)){
+            if ((Sysmod & 3) == MMA8653_SYSMOD_SLEEP){
+                setState(MOTION_WAKE_ASLEEP);
+                }
+            else if (State == MOTION_WAKE_ASLEEP){
+                WakeUs = Edge;
+                LatencyPending = true;
+                Status.Wakes++;
+                setState(MOTION_WAKE_AWAKE);
+                }
+            }
+        return (Source & MMA8653_SRC_FF_MT) != 0;
+    }
+
+    /// notified ///
+    // Called every time the accelerometer batch is notified, the first one after a wake ends the latency measurement
+    void notified(uint32_t Now)
+    {
+        if (LatencyPending){
+            LatencyPending = false;
+            Status.WakeLatencyUs = Now - WakeUs;
+            Changed = true;
+            }
+    }
+
+    /// update ///
+    // Called from the main loop, returns true once for every change to the status
+    bool update()
+    {
+        if (!Changed){
+            return false;
+            }
+        Changed = false;
+        return true;
+    }
+
+    bool asleep() const {
+        return State == MOTION_WAKE_ASLEEP;
+    }
+
+    const MotionStatus &status() const {
+        return Status;
+    }
+
+private:
+    void setState(uint8_t NewState)
+    {
+        State        = NewState;
+        Status.State = NewState;
+        Changed      = true;
+    }
+
+    MotionConfig Config;
+    MotionStatus Status;
+    volatile uint8_t State;
+    bool Changed;
+    // Time INT2 last went low, set from the pin interrupt
+    volatile uint32_t EdgeUs;
+    volatile bool HaveEdge;
+    // Time of the last wake and whether its first notification is still to come
+    uint32_t WakeUs;
+    bool LatencyPending;
+};
+
+#endif /* #ifndef __MOTION_WAKE_H__ */
@@ -0,0 +1,120 @@
+// Sample Batch: Packs several consecutive timestamped samples into one bluetooth notification
+#ifndef __SAMPLE_BATCH_H__
+#define __SAMPLE_BATCH_H__
+#include <stdint.h>
+#include "SensorFrame.h"
+#include "SampleCodec.h"
+
+// The largest notification payload, the default ATT MTU of 23 bytes less the 3 byte ATT header
+// The S110/S130 soft devices used on the micro:bit never negotiate a larger MTU
+const uint16_t SAMPLE_BATCH_MAX_LENGTH = 20;
+
+// Batch layout, all values little endian
+// Bytes 0-1  - Header, bits 13:0 timestamp of the first sample in milliseconds (wraps every 16.384 seconds)
+//                      bits 15:14 encoding of the samples that follow, see SampleCodec.h
+// Bytes 2-19 - Samples, for SAMPLE_CODEC_RAW each sample is int16 X, Y and Z so 3 samples fit
+//              For SAMPLE_CODEC_DELTA the first sample is raw and the rest are varint differences,
+//              DecodeSampleBatch() in SampleCodec.h unpacks either
+// Samples are consecutive, the sample period is the difference between the timestamps of two batches
+// divided by the number of samples in the first
+// Samples dropped on the micro:bit never fall inside a batch, the batch before the drop is sent short and
+// the first sample after it starts the next one, so the period worked out across a drop comes out long
+
+// A part filled batch is sent anyway once its first sample is this old, so slow sensors still update
+const uint32_t SAMPLE_BATCH_MAX_LATENCY_US = 200000;
+
+///SampleBatch///
+// Collects samples until the notification is full, then the owning service sends it
+class SampleBatch {
+public:
+    SampleBatch() :
+        Length(0), FirstTimestamp(0), Encoding(SAMPLE_CODEC_RAW), RequestedEncoding(SAMPLE_CODEC_RAW)
+    {
+    }
+
+    /// setEncoding ///
+    // Selects the encoding of the samples, may be called from any context
+    // A batch already being filled keeps its encoding, the next batch uses the new one
+    void setEncoding(uint16_t NewEncoding)
+    {
+        RequestedEncoding = NewEncoding;
+    }
+
+    /// append ///
+    // Adds a sample to the batch, returns false if there is no room left for it
+    bool append(const SensorSample &Sample)
+    {
+        if (empty()) {
+            Encoding = RequestedEncoding;
+            uint16_t Header = ((Sample.Timestamp / 1000) & SAMPLE_CODEC_TIMESTAMP_MASK) |
+                              (Encoding << SAMPLE_CODEC_ENCODING_SHIFT);
+            FirstTimestamp = Sample.Timestamp;
+            Length = 0;
+            put(Header);
+            Length += PutRaw(Value + Length, Sample.Frame);
+        }
+        else if (Encoding == SAMPLE_CODEC_DELTA) {
+            if ((Length + DeltaLength(Previous, Sample.Frame)) > SAMPLE_BATCH_MAX_LENGTH) {
+                return false;
+            }
+            Length += PutDelta(Value + Length, Previous, Sample.Frame);
+        }
+        else {
+            if (full()) {
+                return false;
+            }
+            Length += PutRaw(Value + Length, Sample.Frame);
+        }
+        Previous = Sample.Frame;
+        return true;
+    }
+
+    // True if not even the shortest sample will fit
+    bool full() const {
+        uint16_t Shortest = (Encoding == SAMPLE_CODEC_DELTA) ? SAMPLE_CODEC_MIN_DELTA_LENGTH : SAMPLE_CODEC_RAW_LENGTH;
+        return !empty() && ((Length + Shortest) > SAMPLE_BATCH_MAX_LENGTH);
+    }
+
+    // True if no samples have been added since the last clear
+    bool empty() const {
+        return Length == 0;
+    }
+
+    // True if the batch holds samples and the first was taken at least SAMPLE_BATCH_MAX_LATENCY_US before Now
+    bool due(uint32_t Now) const {
+        return !empty() && ((Now - FirstTimestamp) >= SAMPLE_BATCH_MAX_LATENCY_US);
+    }
+
+    // The payload to notify and its length in bytes
+    const uint8_t *data() const {
+        return Value;
+    }
+    uint16_t length() const {
+        return Length;
+    }
+
+    // Empties the batch once it has been sent
+    void clear() {
+        Length = 0;
+    }
+
+private:
+    // Appends a 16 bit value little endian
+    void put(uint16_t Item)
+    {
+        Value[Length++] = Item & 0xff;
+        Value[Length++] = Item >> 8;
+    }
+
+    uint8_t Value[SAMPLE_BATCH_MAX_LENGTH];
+    uint16_t Length;
+    uint32_t FirstTimestamp;
+
+    // Encoding of the batch being filled, the encoding the next batch will use and the last sample
+    // added, which the next delta is taken from
+    uint16_t Encoding;
+    volatile uint16_t RequestedEncoding;
+    SensorFrame Previous;
+};
+
+#endif /* #ifndef __SAMPLE_BATCH_H__ */
@@ -0,0 +1,71 @@
+// Sample Cache: The newest sample of a sensor, written by its service and read by everything else
+#ifndef __SAMPLE_CACHE_H__
+#define __SAMPLE_CACHE_H__
+#include <stdint.h>
+#include <atomic>
+
+// Number of times read() tries before giving up on a cache that is being written
+const int SAMPLE_CACHE_READ_TRIES = 4;
+
+///SampleCache///
+// Holds one value and a sequence number that goes up by two every time the value is written
+// The sensor service is the only writer, every consumer (the LED arrow, the heading, the
+// characteristics and the serial log) reads the cached sample instead of reading the sensor again
+//
+// The writer makes the sequence number odd while it copies the new value in, a reader copies the value
+// out and only keeps it if the sequence number was even and unchanged either side of the copy (a seqlock)
+// Neither side ever turns the interrupts off, so a ticker can read the cache while the main loop is writing it
+// A reader that has interrupted the writer half way cannot wait for it to finish, read() then gives up
+// and returns false rather than spinning, the reader uses the sample it had last time
+// The micro:bit has one core so only the compiler has to be kept from reordering the copies,
+// std::atomic_signal_fence does that without any instructions
+template <typename T>
+class SampleCache {
+public:
+    SampleCache() :
+        Sequence(0), Value()
+    {
+    }
+
+    /// write ///
+    // Replaces the cached value, only ever called from one context
+    void write(const T &NewValue)
+    {
+        Sequence = Sequence + 1;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        Value = NewValue;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        Sequence = Sequence + 1;
+    }
+
+    /// read ///
+    // Copies the cached value into Out and its sequence number into ReadSequence
+    // Returns false and leaves Out and ReadSequence alone if a write was in progress every time it looked
+    bool read(T &Out, uint32_t &ReadSequence) const
+    {
+        for (int i = 0; i < SAMPLE_CACHE_READ_TRIES; i++) {
+            uint32_t Before = Sequence;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            T Copy = Value;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            if (((Before & 1) == 0) && (Sequence == Before)) {
+                Out = Copy;
+                ReadSequence = Before;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The sequence number of the newest value, 0 until the first write, compare it with the one
+    // returned by the last read() to see if there is anything new without copying the value
+    uint32_t sequence() const {
+        return Sequence;
+    }
+
+private:
+    volatile uint32_t Sequence;
+    T Value;
+};
+
+#endif /* #ifndef __SAMPLE_CACHE_H__ */
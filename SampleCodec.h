@@ -0,0 +1,167 @@
+// Sample Codec: Delta and zigzag varint packing of the samples in a SampleBatch
+// Varints and zigzag - https://developers.google.com/protocol-buffers/docs/encoding
+// Only needs stdint.h so a client or a PC tool can include it to unpack the batch characteristic
+#ifndef __SAMPLE_CODEC_H__
+#define __SAMPLE_CODEC_H__
+#include <stdint.h>
+#include "SensorFrame.h"
+
+// Encodings of the samples in a batch, held in bits 15:14 of the batch header
+// SAMPLE_CODEC_RAW   - Every sample is int16 X, Y and Z, little endian, 6 bytes each
+// SAMPLE_CODEC_DELTA - The first sample is raw, every sample after it is the difference from the one
+//                      before for X, Y and Z, each zigzag encoded and then written as a varint
+// Consecutive samples usually differ by a few counts so a delta sample is 3 bytes instead of 6,
+// a 20 byte notification then holds 5 or more samples instead of 3
+const uint16_t SAMPLE_CODEC_RAW   = 0;
+const uint16_t SAMPLE_CODEC_DELTA = 1;
+const uint16_t SAMPLE_CODEC_COUNT = 2;
+
+// Batch header, bits 13:0 timestamp of the first sample in milliseconds, bits 15:14 encoding
+const uint16_t SAMPLE_CODEC_HEADER_LENGTH  = 2;
+const uint16_t SAMPLE_CODEC_TIMESTAMP_MASK = 0x3fff;
+const uint8_t  SAMPLE_CODEC_ENCODING_SHIFT = 14;
+
+// Length of a raw sample and the shortest and longest delta samples in bytes
+// A 16 bit zigzag value needs at most 3 varint bytes of 7 bits each
+const uint16_t SAMPLE_CODEC_RAW_LENGTH       = 3 * sizeof(int16_t);
+const uint16_t SAMPLE_CODEC_MIN_DELTA_LENGTH = 3;
+const uint16_t SAMPLE_CODEC_MAX_DELTA_LENGTH = 9;
+
+/// ZigZag ///
+// Folds a signed difference into an unsigned number with small magnitudes first, 0, -1, 1, -2, 2 ...
+// become 0, 1, 2, 3, 4 ... so a small negative difference still fits in one varint byte
+// The difference is taken modulo 2^16 so even a swing from -32768 to 32767 comes back exactly
+inline uint16_t ZigZag(int16_t Value)
+{
+    return (uint16_t)(((uint16_t)Value << 1) ^ (uint16_t)(Value >> 15));
+}
+
+/// UnZigZag ///
+inline int16_t UnZigZag(uint16_t Value)
+{
+    return (int16_t)((Value >> 1) ^ (uint16_t)(-(int16_t)(Value & 1)));
+}
+
+/// VarintLength ///
+// Number of bytes PutVarint() takes for Value, 7 bits go in each byte
+inline uint16_t VarintLength(uint16_t Value)
+{
+    return (Value < 0x80) ? 1 : ((Value < 0x4000) ? 2 : 3);
+}
+
+/// PutVarint ///
+// Writes Value 7 bits at a time, lowest bits first, bit 7 of each byte is set if another byte follows
+// Returns the number of bytes written
+inline uint16_t PutVarint(uint8_t *Out, uint16_t Value)
+{
+    uint16_t Length = 0;
+    while (Value >= 0x80) {
+        Out[Length++] = (uint8_t)(Value | 0x80);
+        Value >>= 7;
+    }
+    Out[Length++] = (uint8_t)Value;
+    return Length;
+}
+
+/// GetVarint ///
+// Reads a varint written by PutVarint() from at most Available bytes
+// Returns the number of bytes read, or 0 if the varint runs off the end, is longer than 3 bytes or
+// does not fit in 16 bits
+inline uint16_t GetVarint(const uint8_t *In, uint16_t Available, uint16_t &Value)
+{
+    uint32_t Result = 0;
+    for (uint16_t i = 0; (i < Available) && (i < 3); i++) {
+        Result |= (uint32_t)(In[i] & 0x7f) << (7 * i);
+        if ((In[i] & 0x80) == 0) {
+            if (Result > 0xffff) {
+                return 0;
+            }
+            Value = (uint16_t)Result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/// DeltaLength ///
+// Number of bytes the delta encoding of Current takes when it follows Previous
+inline uint16_t DeltaLength(const SensorFrame &Previous, const SensorFrame &Current)
+{
+    return VarintLength(ZigZag((int16_t)(Current.X - Previous.X))) +
+           VarintLength(ZigZag((int16_t)(Current.Y - Previous.Y))) +
+           VarintLength(ZigZag((int16_t)(Current.Z - Previous.Z)));
+}
+
+/// PutDelta ///
+// Writes the delta encoding of Current following Previous, returns the number of bytes written
+inline uint16_t PutDelta(uint8_t *Out, const SensorFrame &Previous, const SensorFrame &Current)
+{
+    uint16_t Length = PutVarint(Out, ZigZag((int16_t)(Current.X - Previous.X)));
+    Length += PutVarint(Out + Length, ZigZag((int16_t)(Current.Y - Previous.Y)));
+    Length += PutVarint(Out + Length, ZigZag((int16_t)(Current.Z - Previous.Z)));
+    return Length;
+}
+
+/// PutRaw ///
+// Writes X, Y and Z as little endian int16, returns the number of bytes written
+inline uint16_t PutRaw(uint8_t *Out, const SensorFrame &Frame)
+{
+    const int16_t Axes[3] = {Frame.X, Frame.Y, Frame.Z};
+    for (int Axis = 0; Axis < 3; Axis++) {
+        Out[2 * Axis]     = (uint8_t)((uint16_t)Axes[Axis] & 0xff);
+        Out[2 * Axis + 1] = (uint8_t)((uint16_t)Axes[Axis] >> 8);
+    }
+    return SAMPLE_CODEC_RAW_LENGTH;
+}
+
+/// DecodeSampleBatch ///
+// Unpacks a whole batch notification of either encoding into at most MaxFrames frames
+// TimestampMs is set to bits 13:0 of the header, the time of the first sample in milliseconds
+// Returns the number of frames, or -1 if the payload is malformed, has an unknown encoding or holds more than MaxFrames
+inline int DecodeSampleBatch(const uint8_t *Data, uint16_t Length, SensorFrame *Frames, int MaxFrames, uint16_t &TimestampMs)
+{
+    if (Length < SAMPLE_CODEC_HEADER_LENGTH) {
+        return -1;
+    }
+    uint16_t Header   = (uint16_t)(Data[0] | (Data[1] << 8));
+    uint16_t Encoding = Header >> SAMPLE_CODEC_ENCODING_SHIFT;
+    TimestampMs = Header & SAMPLE_CODEC_TIMESTAMP_MASK;
+    if (Encoding >= SAMPLE_CODEC_COUNT) {
+        return -1;
+    }
+
+    uint16_t Position = SAMPLE_CODEC_HEADER_LENGTH;
+    int Count = 0;
+    while (Position < Length) {
+        if (Count >= MaxFrames) {
+            return -1;
+        }
+        SensorFrame &Frame = Frames[Count];
+        if ((Encoding == SAMPLE_CODEC_RAW) || (Count == 0)) {
+            if ((Length - Position) < SAMPLE_CODEC_RAW_LENGTH) {
+                return -1;
+            }
+            Frame.X = (int16_t)(Data[Position]     | (Data[Position + 1] << 8));
+            Frame.Y = (int16_t)(Data[Position + 2] | (Data[Position + 3] << 8));
+            Frame.Z = (int16_t)(Data[Position + 4] | (Data[Position + 5] << 8));
+            Position += SAMPLE_CODEC_RAW_LENGTH;
+        } else {
+            const SensorFrame &Previous = Frames[Count - 1];
+            int16_t *Axes[3] = {&Frame.X, &Frame.Y, &Frame.Z};
+            const int16_t Before[3] = {Previous.X, Previous.Y, Previous.Z};
+            for (int Axis = 0; Axis < 3; Axis++) {
+                uint16_t Value;
+                uint16_t Used = GetVarint(Data + Position, Length - Position, Value);
+                if (Used == 0) {
+                    return -1;
+                }
+                *Axes[Axis] = (int16_t)(Before[Axis] + UnZigZag(Value));
+                Position += Used;
+            }
+        }
+        Count++;
+    }
+    return Count;
+}
+
+#endif /* #ifndef __SAMPLE_CODEC_H__ */
@@ -0,0 +1,79 @@
+// Sample Ring: Lock free single producer, single consumer ring buffer of timestamped samples
+// Sits between the sensor reads and the bluetooth publishing so each can run at its own rate
+#ifndef __SAMPLE_RING_H__
+#define __SAMPLE_RING_H__
+#include <stdint.h>
+
+///SampleRing///
+// Works like mbed's CircularBuffer (mbed/platform/CircularBuffer.h) with push, pop and empty
+// but never disables interrupts. CircularBuffer wraps every push and pop in a critical section and
+// overwrites the oldest item when full, here there is exactly one producer (the sensor read completing)
+// and one consumer (the publisher in the main loop) so neither needs to lock the other out
+// Head - Only written by the producer, the number of items ever pushed
+// Tail - Only written by the consumer, the number of items ever popped
+// When the ring is full the new item is dropped and counted in Overruns, the consumer owns the
+// oldest items so the producer can not overwrite them
+// Size must be a power of 2 so the free running counters wrap cleanly
+template <typename T, uint32_t Size>
+class SampleRing {
+public:
+    SampleRing() :
+        Head(0), Tail(0), OverrunCount(0)
+    {
+        static_assert((Size & (Size - 1)) == 0, "SampleRing size must be a power of 2");
+    }
+
+    /// push ///
+    // Producer only, returns false and counts an overrun if the ring is full
+    bool push(const T &Item)
+    {
+        uint32_t CurrentHead = Head;
+        if ((CurrentHead - Tail) >= Size) {
+            OverrunCount = OverrunCount + 1;
+            return false;
+        }
+        Buffer[CurrentHead & (Size - 1)] = Item;
+        // The item must be in the buffer before the consumer can see the new Head
+        __sync_synchronize();
+        Head = CurrentHead + 1;
+        return true;
+    }
+
+    /// pop ///
+    // Consumer only, returns false if the ring is empty
+    bool pop(T &Item)
+    {
+        uint32_t CurrentTail = Tail;
+        if (CurrentTail == Head) {
+            return false;
+        }
+        Item = Buffer[CurrentTail & (Size - 1)];
+        // The item must be copied out before the producer can reuse its slot
+        __sync_synchronize();
+        Tail = CurrentTail + 1;
+        return true;
+    }
+
+    // True if there is nothing waiting to be popped
+    bool empty() const {
+        return Head == Tail;
+    }
+
+    // Number of items waiting to be popped
+    uint32_t size() const {
+        return Head - Tail;
+    }
+
+    // Number of items dropped because the consumer fell behind
+    uint32_t overruns() const {
+        return OverrunCount;
+    }
+
+private:
+    T Buffer[Size];
+    volatile uint32_t Head;
+    volatile uint32_t Tail;
+    volatile uint32_t OverrunCount;
+};
+
+#endif /* #ifndef __SAMPLE_RING_H__ */
@@ -0,0 +1,92 @@
+// Sensor Config: Output data rate, range, oversampling and active/standby settings written over bluetooth
+// MMA8653 Datasheet: https://www.nxp.com/docs/en/data-sheet/MMA8653FC.pdf
+// MAG3110 Datasheet: https://www.nxp.com/docs/en/data-sheet/MAG3110.pdf
+#ifndef __SENSOR_CONFIG_H__
+#define __SENSOR_CONFIG_H__
+#include <stdint.h>
+#include "SensorFilter.h"
+#include "SampleCodec.h"
+
+// Length of the configuration characteristic of each sensor service in bytes
+// Clients written against the earlier settings may still write SENSOR_CONFIG_SENSOR_LENGTH,
+// SENSOR_CONFIG_FILTER_LENGTH or SENSOR_CONFIG_DEADBAND_LENGTH bytes, the settings after those are then left as they are
+const uint16_t SENSOR_CONFIG_LENGTH          = 9;
+const uint16_t SENSOR_CONFIG_SENSOR_LENGTH   = 4;
+const uint16_t SENSOR_CONFIG_FILTER_LENGTH   = 6;
+const uint16_t SENSOR_CONFIG_DEADBAND_LENGTH = 8;
+
+///SensorConfig///
+// The value of the configuration characteristic, one byte per setting
+// Rate         - Output data rate, the DR bits of CTRL_REG1 of the sensor (0 to 7)
+//                MMA8653: 800, 400, 200, 100, 50, 12.5, 6.25, 1.56Hz
+//                MAG3110: 80Hz halved for every step of Rate and of Oversampling
+// Range        - MMA8653 full scale range, the FS bits of XYZ_DATA_CFG, 0 = 2g, 1 = 4g, 2 = 8g
+//                The MAG3110 has a fixed range so this is always 0
+// Oversampling - MMA8653 MODS bits of CTRL_REG2, 0 = normal, 1 = low noise low power, 2 = high resolution, 3 = low power
+//                MAG3110 OS bits of CTRL_REG1, 16, 32, 64 or 128 A/D samples per output sample
+// Active       - 1 to sample, 0 to leave the sensor in standby
+// Filter       - Filter run over the samples before they are published, see SensorFilter.h
+//                0 = none, 1 = moving average, 2 = low pass, 3 = high pass
+// Decimation   - Publish every Nth filtered sample (1 to 16), 1 publishes every sample
+// Deadband     - The X, Y and Z characteristics are only written when they move more than this many counts,
+//                0 writes every change, see DeadbandPublisher.h
+// MaxSilence   - Seconds after which the X, Y and Z characteristics are written even if they have not moved,
+//                0 never writes an unchanged value
+// Encoding     - Encoding of the samples in the batch characteristic, see SampleCodec.h
+//                0 = raw int16, 1 = delta and zigzag varint
+struct SensorConfig {
+    uint8_t Rate;
+    uint8_t Range;
+    uint8_t Oversampling;
+    uint8_t Active;
+    uint8_t Filter;
+    uint8_t Decimation;
+    uint8_t Deadband;
+    uint8_t MaxSilence;
+    uint8_t Encoding;
+};
+
+// The default deadband keeps the last bit or so of sensor noise off the air when the board is still
+const uint8_t SENSOR_CONFIG_DEFAULT_DEADBAND    = 2;
+const uint8_t SENSOR_CONFIG_DEFAULT_MAX_SILENCE = 5;
+
+/// SensorConfigLengthValid ///
+// A client may write the whole configuration or just the settings it knows about
+inline bool SensorConfigLengthValid(uint16_t Length)
+{
+    return (Length == SENSOR_CONFIG_LENGTH) || (Length == SENSOR_CONFIG_DEADBAND_LENGTH) ||
+           (Length == SENSOR_CONFIG_FILTER_LENGTH) || (Length == SENSOR_CONFIG_SENSOR_LENGTH);
+}
+
+// Sample period in microseconds for each MMA8653 Rate setting
+const uint32_t MMA8653_SAMPLE_PERIOD_US[8] = {1250, 2500, 5000, 10000, 20000, 80000, 160000, 640000};
+
+/// StreamConfigValid ///
+// The filter and encoding settings are the same for both sensors, any deadband and silence is allowed
+inline bool StreamConfigValid(const SensorConfig &Config)
+{
+    return (Config.Filter < SENSOR_FILTER_COUNT) && (Config.Decimation >= 1) && (Config.Decimation <= SENSOR_FILTER_MAX_DECIMATION) &&
+           (Config.Encoding < SAMPLE_CODEC_COUNT);
+}
+
+/// MMA8653ConfigValid ///
+// Checks every setting written by a client is in range before it is sent to the sensor
+inline bool MMA8653ConfigValid(const SensorConfig &Config)
+{
+    return (Config.Rate < 8) && (Config.Range < 3) && (Config.Oversampling < 4) && (Config.Active < 2) && StreamConfigValid(Config);
+}
+
+/// MAG3110ConfigValid ///
+inline bool MAG3110ConfigValid(const SensorConfig &Config)
+{
+    return (Config.Rate < 8) && (Config.Range == 0) && (Config.Oversampling < 4) && (Config.Active < 2) && StreamConfigValid(Config);
+}
+
+/// MAG3110SamplePeriodUs ///
+// The MAG3110 runs at 80Hz (12.5ms) with Rate and Oversampling 0, each step of either doubles the period
+inline uint32_t MAG3110SamplePeriodUs(const SensorConfig &Config)
+{
+    return 12500UL << (Config.Rate + Config.Oversampling);
+}
+
+#endif /* #ifndef __SENSOR_CONFIG_H__ */
@@ -0,0 +1,204 @@
+// Sensor Filter: Fixed point filter stage between the sensor reads and bluetooth publishing
+// CMSIS DSP Biquad - https://arm-software.github.io/CMSIS_5/DSP/html/group__BiquadCascadeDF1.html
+#ifndef __SENSOR_FILTER_H__
+#define __SENSOR_FILTER_H__
+#include <stdint.h>
+#include "SensorFrame.h"
+#ifdef SENSOR_FILTER_USE_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+// Filters that can be selected with the Filter byte of the config characteristic
+// SENSOR_FILTER_NONE           - Samples are passed straight through
+// SENSOR_FILTER_MOVING_AVERAGE - Average of the last SENSOR_FILTER_AVERAGE_LENGTH samples
+// SENSOR_FILTER_LOW_PASS       - 2nd order Butterworth low pass, cut off at 1/10 of the output data rate
+// SENSOR_FILTER_HIGH_PASS      - 2nd order Butterworth high pass, cut off at 1/50 of the output data rate,
+//                                removes gravity from the accelerometer and the earth's field from the magnetometer
+const uint8_t SENSOR_FILTER_NONE           = 0;
+const uint8_t SENSOR_FILTER_MOVING_AVERAGE = 1;
+const uint8_t SENSOR_FILTER_LOW_PASS       = 2;
+const uint8_t SENSOR_FILTER_HIGH_PASS      = 3;
+const uint8_t SENSOR_FILTER_COUNT          = 4;
+
+// Number of samples in the moving average, a power of 2 so the sum can be shifted instead of divided
+const uint8_t SENSOR_FILTER_AVERAGE_SHIFT  = 3;
+const uint8_t SENSOR_FILTER_AVERAGE_LENGTH = 1 << SENSOR_FILTER_AVERAGE_SHIFT;
+
+// Largest decimation, only every Nth filtered sample is published
+const uint8_t SENSOR_FILTER_MAX_DECIMATION = 16;
+
+// Biquad coefficients in the arm_biquad_cascade_df1_q15 layout {b0, 0, b1, b2, a1, a2}
+// Stored as Q1.14 (value * 16384) with a post shift of 1 so coefficients above 1.0 fit in a q15
+// The feedback coefficients a1 and a2 are already negated as CMSIS expects
+const uint8_t SENSOR_FILTER_POST_SHIFT = 1;
+const int16_t SENSOR_FILTER_LOW_PASS_COEFFS[6]  = {1105, 0, 2210, 1105, 18727, -6763};
+const int16_t SENSOR_FILTER_HIGH_PASS_COEFFS[6] = {14991, 0, -29982, 14991, 29863, -13716};
+
+///SensorFilter///
+// Filters the X, Y and Z planes of a sample stream independently with the same settings
+// configure() may be called from any context, the new settings are picked up by the next process()
+// so the filter state is only ever touched by the consumer of the samples
+class SensorFilter {
+public:
+    SensorFilter() :
+        Kind(SENSOR_FILTER_NONE), Decimation(1), PendingKind(SENSOR_FILTER_NONE), PendingDecimation(1), ConfigPending(true)
+    {
+    }
+
+    /// configure ///
+    // Selects the filter and decimation, the filter state is restarted from the next sample when it is applied
+    void configure(uint8_t NewKind, uint8_t NewDecimation)
+    {
+        PendingKind       = NewKind;
+        PendingDecimation = NewDecimation;
+        ConfigPending     = true;
+    }
+
+    /// process ///
+    // Runs one sample through the filter, returns false if the output was dropped by decimation
+    bool process(const SensorFrame &In, SensorFrame &Out)
+    {
+        if (ConfigPending) {
+            reset(In);
+        }
+
+        SensorFrame Filtered;
+        Filtered.X = processAxis(0, In.X);
+        Filtered.Y = processAxis(1, In.Y);
+        Filtered.Z = processAxis(2, In.Z);
+
+        DecimationCount = DecimationCount + 1;
+        if (DecimationCount < Decimation) {
+            return false;
+        }
+        DecimationCount = 0;
+        Out = Filtered;
+        return true;
+    }
+
+private:
+    /// reset ///
+    // Applies the pending settings and fills the history of every axis as if First had always been the input
+    // Cleared history would make the output start from 0, every new rate or wake from sleep would then put a
+    // step into the stream that the low pass and moving average take several samples to climb out of
+    void reset(const SensorFrame &First)
+    {
+        const int16_t Values[3] = {First.X, First.Y, First.Z};
+        ConfigPending   = false;
+        Kind            = PendingKind;
+        Decimation      = PendingDecimation;
+        DecimationCount = 0;
+        AverageIndex    = 0;
+        for (int Axis = 0; Axis < 3; Axis++) {
+            AverageSum[Axis] = (int32_t)Values[Axis] << SENSOR_FILTER_AVERAGE_SHIFT;
+            for (int i = 0; i < SENSOR_FILTER_AVERAGE_LENGTH; i++) {
+                AverageHistory[Axis][i] = Values[Axis];
+            }
+#ifdef SENSOR_FILTER_USE_CMSIS_DSP
+            // The init clears the state so it is filled in afterwards, CMSIS uses the same state layout
+            arm_biquad_cascade_df1_init_q15(&Biquad[Axis], 1, (q15_t *)coefficients(), BiquadState[Axis], SENSOR_FILTER_POST_SHIFT);
+#endif
+            BiquadState[Axis][0] = Values[Axis];
+            BiquadState[Axis][1] = Values[Axis];
+            BiquadState[Axis][2] = settled(Values[Axis]);
+            BiquadState[Axis][3] = BiquadState[Axis][2];
+        }
+    }
+
+    // Coefficients of the biquad selected by Kind
+    const int16_t *coefficients() const
+    {
+        return (Kind == SENSOR_FILTER_HIGH_PASS) ? SENSOR_FILTER_HIGH_PASS_COEFFS : SENSOR_FILTER_LOW_PASS_COEFFS;
+    }
+
+    /// settled ///
+    // Output of the biquad once a constant Value has been the input for ever, Value times the gain at 0Hz
+    // (b0 + b1 + b2) / (1 - a1 - a2), which is Value for the low pass and 0 for the high pass
+    int16_t settled(int16_t Value) const
+    {
+        const int16_t *Coeffs = coefficients();
+        int32_t Gain     = (int32_t)Coeffs[0] + Coeffs[2] + Coeffs[3];
+        int32_t Feedback = (1 << (15 - SENSOR_FILTER_POST_SHIFT)) - Coeffs[4] - Coeffs[5];
+        return (int16_t)((Value * Gain) / Feedback);
+    }
+
+    /// processAxis ///
+    // Filters one value of one axis
+    int16_t processAxis(int Axis, int16_t Value)
+    {
+        switch (Kind) {
+            case SENSOR_FILTER_MOVING_AVERAGE:
+                return movingAverage(Axis, Value);
+            case SENSOR_FILTER_LOW_PASS:
+            case SENSOR_FILTER_HIGH_PASS:
+                return biquad(Axis, Value);
+            default:
+                return Value;
+        }
+    }
+
+    /// movingAverage ///
+    // Keeps a running sum, the oldest value is taken off as the new one is added
+    int16_t movingAverage(int Axis, int16_t Value)
+    {
+        AverageSum[Axis] += Value - AverageHistory[Axis][AverageIndex];
+        AverageHistory[Axis][AverageIndex] = Value;
+        if (Axis == 2) {
+            AverageIndex = (AverageIndex + 1) & (SENSOR_FILTER_AVERAGE_LENGTH - 1);
+        }
+        return AverageSum[Axis] >> SENSOR_FILTER_AVERAGE_SHIFT;
+    }
+
+    /// biquad ///
+    // One direct form 1 biquad stage, the same arithmetic as arm_biquad_cascade_df1_q15()
+    // The state is {x[n-1], x[n-2], y[n-1], y[n-2]}, the products are summed in a 64 bit accumulator,
+    // shifted back down to a q15 and saturated
+    // The CMSIS DSP library is not linked into this project, define SENSOR_FILTER_USE_CMSIS_DSP and add
+    // the arm_cortexM0l_math library to use arm_biquad_cascade_df1_q15() itself, the coefficients were
+    // then handed over by reset()
+    int16_t biquad(int Axis, int16_t Value)
+    {
+#ifdef SENSOR_FILTER_USE_CMSIS_DSP
+        q15_t Out;
+        arm_biquad_cascade_df1_q15(&Biquad[Axis], (q15_t *)&Value, &Out, 1);
+        return Out;
+#else
+        const int16_t *Coeffs = coefficients();
+        int16_t *State = BiquadState[Axis];
+        int64_t Accumulator = (int64_t)Coeffs[0] * Value +
+                              (int64_t)Coeffs[2] * State[0] +
+                              (int64_t)Coeffs[3] * State[1] +
+                              (int64_t)Coeffs[4] * State[2] +
+                              (int64_t)Coeffs[5] * State[3];
+        int32_t Out = (int32_t)(Accumulator >> (15 - SENSOR_FILTER_POST_SHIFT));
+        if (Out > INT16_MAX) {
+            Out = INT16_MAX;
+        } else if (Out < INT16_MIN) {
+            Out = INT16_MIN;
+        }
+        State[1] = State[0];
+        State[0] = Value;
+        State[3] = State[2];
+        State[2] = (int16_t)Out;
+        return (int16_t)Out;
+#endif
+    }
+
+    uint8_t Kind;
+    uint8_t Decimation;
+    uint8_t DecimationCount;
+    volatile uint8_t PendingKind;
+    volatile uint8_t PendingDecimation;
+    volatile bool ConfigPending;
+
+    int32_t AverageSum[3];
+    int16_t AverageHistory[3][SENSOR_FILTER_AVERAGE_LENGTH];
+    uint8_t AverageIndex;
+
+    int16_t BiquadState[3][4];
+#ifdef SENSOR_FILTER_USE_CMSIS_DSP
+    arm_biquad_casd_df1_inst_q15 Biquad[3];
+#endif
+};
+
+#endif /* #ifndef __SENSOR_FILTER_H__ */
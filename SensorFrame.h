@@ -0,0 +1,55 @@
+// Sensor Frame: X, Y and Z sample read from the MMA8653 or MAG3110 in one i2c transaction
+// MMA8653 Datasheet: https://www.nxp.com/docs/en/data-sheet/MMA8653FC.pdf
+// MAG3110 Datasheet: https://www.nxp.com/docs/en/data-sheet/MAG3110.pdf
+#ifndef __SENSOR_FRAME_H__
+#define __SENSOR_FRAME_H__
+#include <stdint.h>
+
+// Both sensors keep their output registers back to back starting at register 0x01
+// OUT_X_MSB, OUT_X_LSB, OUT_Y_MSB, OUT_Y_LSB, OUT_Z_MSB, OUT_Z_LSB
+// The register pointer auto increments after every byte read, so a single write of 0x01
+// followed by a 6 byte read returns all three axes in one transaction
+// The raw register contents are then turned into a SensorFrame with the decoder for the sensor
+const char SENSOR_FRAME_FIRST_REGISTER = 0x01;
+const int  SENSOR_FRAME_LENGTH         = 6;
+
+///SensorFrame///
+// One sample of the X, Y and Z planes from either sensor
+struct SensorFrame {
+    int16_t X;
+    int16_t Y;
+    int16_t Z;
+};
+
+///SensorSample///
+// A SensorFrame along with the time it was taken
+// Timestamp - Microseconds from us_ticker_read() when the read was requested
+struct SensorSample {
+    uint32_t Timestamp;
+    SensorFrame Frame;
+};
+
+/// DecodeMMA8653Frame ///
+// The MMA8653 has a 10 bit A/D converter, each axis is left justified across the MSB and LSB registers
+// Join the two bytes into a 16 bit number and shift right by 6 to get the signed 10 bit number
+inline SensorFrame DecodeMMA8653Frame(const char *Data)
+{
+    SensorFrame Frame;
+    Frame.X = (int16_t)(((uint8_t)Data[0] << 8) | (uint8_t)Data[1]) >> 6;
+    Frame.Y = (int16_t)(((uint8_t)Data[2] << 8) | (uint8_t)Data[3]) >> 6;
+    Frame.Z = (int16_t)(((uint8_t)Data[4] << 8) | (uint8_t)Data[5]) >> 6;
+    return Frame;
+}
+
+/// DecodeMAG3110Frame ///
+// The MAG3110 gives a full 16 bit signed number for each axis, MSB first
+inline SensorFrame DecodeMAG3110Frame(const char *Data)
+{
+    SensorFrame Frame;
+    Frame.X = (int16_t)(((uint8_t)Data[0] << 8) | (uint8_t)Data[1]);
+    Frame.Y = (int16_t)(((uint8_t)Data[2] << 8) | (uint8_t)Data[3]);
+    Frame.Z = (int16_t)(((uint8_t)Data[4] << 8) | (uint8_t)Data[5]);
+    return Frame;
+}
+
+#endif /* #ifndef __SENSOR_FRAME_H__ */
@@ -0,0 +1,81 @@
+// Sensor Registers: i2c addresses, control registers and the register setup of the MMA8653 and MAG3110
+// MMA8653 Datasheet: https://www.nxp.com/docs/en/data-sheet/MMA8653FC.pdf
+// MAG3110 Datasheet: https://www.nxp.com/docs/en/data-sheet/MAG3110.pdf
+// The sensor services and host/sensor_bench.cpp both queue their register writes through here, so the
+// bench sets the simulated parts up exactly as the firmware sets up the real ones
+#ifndef __SENSOR_REGISTERS_H__
+#define __SENSOR_REGISTERS_H__
+#include <stdint.h>
+#include "I2CQueue.h"
+#include "SensorConfig.h"
+#include "MotionWake.h"
+
+// The standard i2c slave address for MMA8653FC is 0x1D or 0011101 - reference section 5.8, page 18 of data sheet
+// The MMA8653_ID refers to the value of the WHOAMI byte in the register 0x0D, it has a hex value of 0x5a
+const int MMA8653_ADDRESS = (0x1d<<1);
+const int MMA8653_ID = 0x5a;
+
+// Control registers of the MMA8653 used to configure the output data rate, range and interrupts
+// XYZ_DATA_CFG - bits 1:0 select the full scale range
+// CTRL_REG1    - bits 5:3 select the output data rate (ODR), bit 0 sets the part active
+// CTRL_REG2    - bits 1:0 select the oversampling mode (MODS)
+// CTRL_REG4    - bit 0 enables the data ready interrupt, the motion and auto-sleep bits are in MotionWake.h
+// CTRL_REG5    - bit 0 routes the data ready interrupt to the INT1 pin, otherwise it goes to INT2,
+//                the motion and auto-sleep interrupts are always left on INT2
+const char MMA8653_XYZ_DATA_CFG = 0x0e;
+const char MMA8653_CTRL_REG1 = 0x2a;
+const char MMA8653_CTRL_REG2 = 0x2b;
+const char MMA8653_CTRL_REG4 = 0x2d;
+const char MMA8653_CTRL_REG5 = 0x2e;
+
+// The standard i2c slave address for MAG3110 is 0x0e
+const int MAG3110_ADDRESS = (0x0e<<1);
+
+// CTRL_REG1 of the MAG3110 - bits 7:5 data rate (DR), bits 4:3 over sampling ratio (OS), bit 0 active
+// CTRL_REG2 of the MAG3110 - bit 7 enables the automatic magnetic sensor reset
+// The MAG3110 always drives its INT1 pin high when new data is ready and low again once the data has been read
+const char MAG3110_CTRL_REG1 = 0x10;
+const char MAG3110_CTRL_REG2 = 0x11;
+const char MAG3110_AUTO_MRST_EN = 0x80;
+
+/// WriteMMA8653Config ///
+// Queues the writes to put Config into the MMA8653, with Rate in place of Config.Rate
+// The control registers can only be changed in standby, so the part is put in standby first and
+// CTRL_REG1 is written last with the output data rate and the active bit
+// The interrupt and motion wake registers are rewritten every time as they share the control registers,
+// the motion detection registers are left alone while it is off
+// DataReady routes the data ready interrupt to INT1, otherwise the samples are polled
+inline void WriteMMA8653Config(I2CQueue &Queue, const SensorConfig &Config, uint8_t Rate, bool DataReady, const MotionWake &Motion)
+{
+    Queue.Write(MMA8653_ADDRESS, MMA8653_CTRL_REG1, 0);
+    Queue.Write(MMA8653_ADDRESS, MMA8653_XYZ_DATA_CFG, Config.Range);
+    Queue.Write(MMA8653_ADDRESS, MMA8653_CTRL_REG2, Config.Oversampling | Motion.ctrlReg2());
+    Queue.Write(MMA8653_ADDRESS, MMA8653_CTRL_REG3, Motion.ctrlReg3());
+    Queue.Write(MMA8653_ADDRESS, MMA8653_CTRL_REG4, (DataReady ? 1 : 0) | Motion.ctrlReg4());
+    Queue.Write(MMA8653_ADDRESS, MMA8653_CTRL_REG5, DataReady ? 1 : 0);
+    if (Motion.config().Enabled){
+        Queue.Write(MMA8653_ADDRESS, MMA8653_FF_MT_CFG, Motion.ffMtCfg());
+        Queue.Write(MMA8653_ADDRESS, MMA8653_FF_MT_THS, Motion.ffMtThs());
+        Queue.Write(MMA8653_ADDRESS, MMA8653_FF_MT_COUNT, Motion.ffMtCount());
+        Queue.Write(MMA8653_ADDRESS, MMA8653_ASLP_COUNT, Motion.aslpCount());
+        }
+    Queue.Write(MMA8653_ADDRESS, MMA8653_CTRL_REG1, Motion.ctrlReg1() | (Rate << 3) | Config.Active);
+}
+
+/// WriteMAG3110Reset ///
+// Queues the one off setup of the MAG3110, the automatic magnetic sensor reset before every reading
+inline void WriteMAG3110Reset(I2CQueue &Queue)
+{
+    Queue.Write(MAG3110_ADDRESS, MAG3110_CTRL_REG2, MAG3110_AUTO_MRST_EN);
+}
+
+/// WriteMAG3110Config ///
+// Queues the writes to put Config into the MAG3110, Active in place of Config.Active
+// The part is put in standby first as the data rate and over sampling can only be changed in standby
+inline void WriteMAG3110Config(I2CQueue &Queue, const SensorConfig &Config, bool Active)
+{
+    Queue.Write(MAG3110_ADDRESS, MAG3110_CTRL_REG1, 0);
+    Queue.Write(MAG3110_ADDRESS, MAG3110_CTRL_REG1, (Config.Rate << 5) | (Config.Oversampling << 3) | (Active ? 1 : 0));
+}
+
+#endif /* #ifndef __SENSOR_REGISTERS_H__ */
@@ -0,0 +1,167 @@
+// Serial Stream: Every sensor sample framed in binary on the serial port, for capturing the full sample rate on a PC
+// Decode the capture with host/stream_capture.cpp
+#ifndef __SERIAL_STREAM_H__
+#define __SERIAL_STREAM_H__
+#include <mbed.h>
+#include "SensorFrame.h"
+#include "crc16.h"
+
+// Sensors, the first byte of every packet
+const uint8_t SERIAL_STREAM_ACCEL = 1;
+const uint8_t SERIAL_STREAM_MAG   = 2;
+
+// Packet before framing, little endian
+// Type      - SERIAL_STREAM_ACCEL or SERIAL_STREAM_MAG
+// Sequence  - Goes up by one for every packet of that sensor, a gap is a packet dropped on the micro:bit
+//             or lost on the line
+// Timestamp - When the sample was read in microseconds (uint32)
+// X, Y, Z   - The sample (int16 each), 256 counts to 1g for the accelerometer and 0.1uT for the magnetometer
+// Crc       - CRC-16/CCITT (polynomial 0x1021, starting at 0xffff) of the 12 bytes before it (uint16)
+const int SERIAL_STREAM_PACKET_LENGTH = 14;
+
+// Framing, the packet is COBS encoded so it has no zero bytes in it and a zero byte ends it
+// COBS adds one byte to a packet this short, with the zero each packet is 16 bytes on the line
+const int SERIAL_STREAM_FRAME_LENGTH = SERIAL_STREAM_PACKET_LENGTH + 2;
+
+// Bytes waiting for the UART, must be a power of 2. 16 packets, 14ms of the line at 115200 baud
+const uint32_t SERIAL_STREAM_BUFFER_LENGTH = 256;
+
+/// SerialStreamCobs ///
+// Consistent Overhead Byte Stuffing, writes Length bytes of In to Out with every zero replaced by the distance
+// to the next one, the first byte is the distance to the first zero. Returns the length written, Length + 1
+// Only for packets under 254 bytes, which is all this stream sends
+inline int SerialStreamCobs(const uint8_t *In, int Length, uint8_t *Out)
+{
+    int Code = 0;
+    int Written = 1;
+    for (int i = 0; i < Length; i++){
+        if (In[i] == 0){
+            Out[Code] = Written - Code;
+            Code = Written++;
+            }
+        else{
+            Out[Written++] = In[i];
+            }
+        }
+    Out[Code] = Written - Code;
+    return Written;
+}
+
+///SerialStream///
+// Bluetooth tops out at a few hundred samples a second across all of the notifications, the UART does not
+// At 115200 baud the line carries 11520 bytes a second, a packet takes 1.4ms. The accelerometer at 400Hz
+// and the magnetometer at 80Hz are 480 packets or 7680 bytes a second, two thirds of the line
+// Faster output data rates need a faster SERIAL_STREAM_BAUD in main.cpp
+// The nRF51 UART holds one byte, writeable() only goes true again once it has gone 87us later, so handing it
+// bytes from the main loop sends one per wake up, about 2000 a second with the LED refresh waking it
+// Instead write() frames a sample into a buffer and pump() turns on the TX interrupt of the RawSerial, which
+// puts the next byte in the UART every time the last one has gone and turns itself off once the buffer is
+// empty. A packet that does not fit in the buffer is dropped and counted, the gap shows up in its sequence
+// numbers at the other end
+// write() and pump() are called from the main loop, the sample hooks of the sensor services call write()
+class SerialStream {
+public:
+    SerialStream() :
+        Port(NULL), Head(0), Tail(0), Dropped(0), Sending(false)
+    {
+        static_assert((SERIAL_STREAM_BUFFER_LENGTH & (SERIAL_STREAM_BUFFER_LENGTH - 1)) == 0, "SERIAL_STREAM_BUFFER_LENGTH must be a power of 2");
+        Sequence[0] = 0;
+        Sequence[1] = 0;
+    }
+
+    /// write ///
+    // Frames one sample of sensor Type, returns false if the buffer had no room for it
+    bool write(uint8_t Type, const SensorSample &Sample)
+    {
+        if ((SERIAL_STREAM_BUFFER_LENGTH - (Head - Tail)) < SERIAL_STREAM_FRAME_LENGTH){
+            Dropped++;
+            Sequence[Type - 1]++;
+            return false;
+            }
+        uint8_t Packet[SERIAL_STREAM_PACKET_LENGTH];
+        Packet[0] = Type;
+        Packet[1] = Sequence[Type - 1]++;
+        put32(&Packet[2], Sample.Timestamp);
+        put16(&Packet[6], Sample.Frame.X);
+        put16(&Packet[8], Sample.Frame.Y);
+        put16(&Packet[10], Sample.Frame.Z);
+        put16(&Packet[12], crc16_compute(Packet, SERIAL_STREAM_PACKET_LENGTH - 2, NULL));
+
+        uint8_t Frame[SERIAL_STREAM_FRAME_LENGTH];
+        int Length = SerialStreamCobs(Packet, SERIAL_STREAM_PACKET_LENGTH, Frame);
+        Frame[Length++] = 0;
+        // The frame is copied in before Head moves past it, so the TX interrupt never sends half a frame
+        uint32_t Position = Head;
+        for (int i = 0; i < Length; i++){
+            Buffer[(Position + i) & (SERIAL_STREAM_BUFFER_LENGTH - 1)] = Frame[i];
+            }
+        Head = Position + Length;
+        return true;
+    }
+
+    /// start ///
+    // Sends the stream on Out, a RawSerial as its putc() is safe in an interrupt
+    void start(RawSerial &Out)
+    {
+        Port = &Out;
+    }
+
+    /// pump ///
+    // Turns the TX interrupt on if there are bytes waiting and it is off, never waits
+    // If the interrupt found the buffer empty and turned itself off just as write() added to it, the bytes
+    // wait for the next call, the main loop makes one every time it wakes
+    void pump()
+    {
+        if ((Port == NULL) || Sending || (Tail == Head)){
+            return;
+            }
+        Sending = true;
+        Port->attach(callback(this, &SerialStream::onTxReady), SerialBase::TxIrq);
+    }
+
+    // Packets dropped because the UART fell behind
+    uint32_t dropped() const {
+        return Dropped;
+    }
+
+private:
+    /// onTxReady ///
+    // The TX interrupt, the UART has room for the next byte
+    void onTxReady()
+    {
+        if (Tail == Head){
+            Port->attach(Callback<void()>(), SerialBase::TxIrq);
+            Sending = false;
+            return;
+            }
+        Port->putc(Buffer[Tail & (SERIAL_STREAM_BUFFER_LENGTH - 1)]);
+        Tail = Tail + 1;
+    }
+
+    static void put32(uint8_t *Data, uint32_t Value)
+    {
+        Data[0] = Value;
+        Data[1] = Value >> 8;
+        Data[2] = Value >> 16;
+        Data[3] = Value >> 24;
+    }
+
+    static void put16(uint8_t *Data, uint16_t Value)
+    {
+        Data[0] = Value;
+        Data[1] = Value >> 8;
+    }
+
+    RawSerial *Port;
+    uint8_t Buffer[SERIAL_STREAM_BUFFER_LENGTH];
+    // Head - Bytes ever written by write(), Tail - Bytes ever sent by the TX interrupt
+    volatile uint32_t Head;
+    volatile uint32_t Tail;
+    uint32_t Dropped;
+    // True while the TX interrupt is on
+    volatile bool Sending;
+    // Next sequence number of each sensor
+    uint8_t Sequence[2];
+};
+
+#endif /* #ifndef __SERIAL_STREAM_H__ */
@@ -0,0 +1,288 @@
+// Spectrum Analyzer: Fixed point real FFT over a window of accelerometer samples, picks out the strongest vibrations
+#ifndef __SPECTRUM_ANALYZER_H__
+#define __SPECTRUM_ANALYZER_H__
+#include <stdint.h>
+#include "SensorFrame.h"
+#include "GestureDetector.h"
+#ifdef SPECTRUM_USE_CMSIS_DSP
+#include "arm_math.h"
+#endif
+
+// Samples in each window, also the length of the FFT. Bin k of the spectrum is k * SampleRate / 64 Hz,
+// at 100Hz that is a resolution of 1.56Hz up to 50Hz and a new spectrum every 0.64 seconds
+const int SPECTRUM_LENGTH = 64;
+const int SPECTRUM_STAGES = 6;
+const int SPECTRUM_BINS   = SPECTRUM_LENGTH / 2;
+
+// Number of peaks reported for every window
+const int SPECTRUM_PEAKS = 5;
+
+// What the spectrum is taken of, also the first byte of the config and peaks characteristics
+// SPECTRUM_AXIS_MAGNITUDE - Length of the acceleration vector, the board can be mounted any way up
+// SPECTRUM_AXIS_X, _Y, _Z - One axis, for a board mounted so the vibration lines up with it
+const uint8_t SPECTRUM_AXIS_MAGNITUDE = 0;
+const uint8_t SPECTRUM_AXIS_X         = 1;
+const uint8_t SPECTRUM_AXIS_Y         = 2;
+const uint8_t SPECTRUM_AXIS_Z         = 3;
+
+// Samples are scaled to 256 counts to 1g and are never more than 2048 from the window mean,
+// shifting them up by 3 uses most of a q15 and leaves the FFT no room to overflow
+const int SPECTRUM_INPUT_SHIFT = 3;
+
+// cos(2 * pi * k / 64) in q15 for the first half turn, sin(2 * pi * k / 64) is cos(2 * pi * (k - 16) / 64)
+const int16_t SPECTRUM_COS[SPECTRUM_BINS] = {
+    32767, 32609, 32137, 31356, 30273, 28898, 27245, 25329, 23170, 20787, 18204, 15446, 12539, 9512, 6393, 3212,
+    0, -3212, -6393, -9512, -12539, -15446, -18204, -20787, -23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609
+};
+
+// Hann window in q15 for the first half of the window, the second half is its mirror image
+// A vibration that does not fit a whole number of times into the window leaks into every bin without it
+const int16_t SPECTRUM_HANN[SPECTRUM_BINS + 1] = {
+    0, 79, 315, 705, 1247, 1935, 2761, 3719, 4799, 5990, 7281, 8660, 10114, 11628, 13187, 14778,
+    16383, 17989, 19580, 21139, 22653, 24107, 25486, 26777, 27968, 29048, 30006, 30832, 31520, 32062, 32452, 32688,
+    32767
+};
+
+///SpectrumPeak///
+// One of the strongest bins of a spectrum
+// Bin         - 1 to 31, the frequency is Bin * SampleRate / 64
+// AmplitudeMg - Amplitude of the vibration at that frequency in mg
+struct SpectrumPeak {
+    uint8_t Bin;
+    uint16_t AmplitudeMg;
+};
+
+///SpectrumAnalyzer///
+// Collects SPECTRUM_LENGTH samples of the selected axis, then takes the mean off, applies the window and runs
+// a 64 point real FFT on them. The windows do not overlap, every sample is used once
+// Only the SPECTRUM_PEAKS largest local maxima of the spectrum are kept, the bins either side of a peak are
+// the same vibration leaking through the window and are not reported again
+// The FFT is the same radix 2 decimation in time as the CMSIS DSP q15 FFT, every stage halves its output so
+// the result is scaled down by 64 and cannot overflow
+// The CMSIS DSP library is not linked into this project, define SPECTRUM_USE_CMSIS_DSP and add the
+// arm_cortexM0l_math library to use arm_rfft_q15() itself
+class SpectrumAnalyzer {
+public:
+    SpectrumAnalyzer() :
+        Axis(SPECTRUM_AXIS_MAGNITUDE), Count(0), FirstUs(0), LastUs(0), PeakCount(0), RateDeciHz(0)
+    {
+#ifdef SPECTRUM_USE_CMSIS_DSP
+        arm_rfft_init_q15(&Fft, SPECTRUM_LENGTH, 0, 1);
+#endif
+    }
+
+    /// select ///
+    // Changes the axis the spectrum is taken of and starts a new window, returns false if Axis is not one of the above
+    bool select(uint8_t NewAxis)
+    {
+        if (NewAxis > SPECTRUM_AXIS_Z){
+            return false;
+            }
+        Axis  = NewAxis;
+        Count = 0;
+        return true;
+    }
+
+    uint8_t axis() const {
+        return Axis;
+    }
+
+    /// process ///
+    // Takes one sample scaled to 256 counts to 1g, returns true when it completes a window and there is a new
+    // set of peaks
+    bool process(const SensorSample &Sample)
+    {
+        if (Count == 0){
+            FirstUs = Sample.Timestamp;
+            }
+        LastUs = Sample.Timestamp;
+        Window[Count++] = value(Sample.Frame);
+        if (Count < SPECTRUM_LENGTH){
+            return false;
+            }
+        Count = 0;
+        transform();
+        findPeaks();
+        // The samples were read in batches, the spread of the timestamps over the whole window gives the
+        // average rate
+        uint32_t Span = LastUs - FirstUs;
+        RateDeciHz = (Span != 0) ? (uint16_t)(((uint64_t)(SPECTRUM_LENGTH - 1) * 10000000) / Span) : 0;
+        return true;
+    }
+
+    // Number of peaks found in the last window, fewer than SPECTRUM_PEAKS for a spectrum with few maxima
+    int peakCount() const {
+        return PeakCount;
+    }
+    // Peaks of the last window, largest first
+    const SpectrumPeak &peak(int Index) const {
+        return Peaks[Index];
+    }
+    // Sample rate over the last window in tenths of a Hz
+    uint16_t rateDeciHz() const {
+        return RateDeciHz;
+    }
+
+private:
+    int16_t value(const SensorFrame &Frame) const
+    {
+        switch (Axis){
+            case SPECTRUM_AXIS_X:
+                return Frame.X;
+            case SPECTRUM_AXIS_Y:
+                return Frame.Y;
+            case SPECTRUM_AXIS_Z:
+                return Frame.Z;
+            default:
+                return GestureMagnitude(Frame);
+            }
+    }
+
+    // Takes the mean off the window, applies the Hann window and leaves the spectrum in Re and Im
+    void transform()
+    {
+        int32_t Sum = 0;
+        for (int n = 0; n < SPECTRUM_LENGTH; n++){
+            Sum += Window[n];
+            }
+        int32_t Mean = Sum / SPECTRUM_LENGTH;
+        for (int n = 0; n < SPECTRUM_LENGTH; n++){
+            int32_t Centred = (Window[n] - Mean) << SPECTRUM_INPUT_SHIFT;
+            if (Centred > INT16_MAX){
+                Centred = INT16_MAX;
+                }
+            else if (Centred < INT16_MIN){
+                Centred = INT16_MIN;
+                }
+            int16_t Weight = SPECTRUM_HANN[(n <= SPECTRUM_BINS) ? n : (SPECTRUM_LENGTH - n)];
+            Window[n] = (int16_t)((Centred * Weight) >> 15);
+            }
+#ifdef SPECTRUM_USE_CMSIS_DSP
+        // arm_rfft_q15() writes the full complex spectrum interleaved and scales it by 1/64 like the local FFT
+        arm_rfft_q15(&Fft, Window, Spectrum);
+        for (int k = 0; k < SPECTRUM_BINS; k++){
+            Re[k] = Spectrum[2 * k];
+            Im[k] = Spectrum[2 * k + 1];
+            }
+#else
+        fft();
+#endif
+    }
+
+#ifndef SPECTRUM_USE_CMSIS_DSP
+    // In place radix 2 decimation in time FFT of Window with the imaginary parts all 0, the bins up to
+    // SPECTRUM_BINS are left in Re and Im, the rest are the mirror image of those for a real input
+    void fft()
+    {
+        for (int n = 0; n < SPECTRUM_LENGTH; n++){
+            int Reversed = 0;
+            for (int b = 0; b < SPECTRUM_STAGES; b++){
+                Reversed |= ((n >> b) & 1) << (SPECTRUM_STAGES - 1 - b);
+                }
+            FullRe[Reversed] = Window[n];
+            FullIm[Reversed] = 0;
+            }
+        for (int Size = 2; Size <= SPECTRUM_LENGTH; Size <<= 1){
+            int Half = Size / 2;
+            int Step = SPECTRUM_LENGTH / Size;
+            for (int Start = 0; Start < SPECTRUM_LENGTH; Start += Size){
+                for (int j = 0; j < Half; j++){
+                    // Twiddle factor cos - j sin of 2 * pi * j * Step / 64
+                    int k = j * Step;
+                    int32_t Cos = SPECTRUM_COS[k];
+                    int32_t Sin = SPECTRUM_COS[(k >= 16) ? (k - 16) : (16 - k)];
+                    int Top    = Start + j;
+                    int Bottom = Top + Half;
+                    int32_t TRe = (FullRe[Bottom] * Cos + FullIm[Bottom] * Sin) >> 15;
+                    int32_t TIm = (FullIm[Bottom] * Cos - FullRe[Bottom] * Sin) >> 15;
+                    int32_t ARe = FullRe[Top];
+                    int32_t AIm = FullIm[Top];
+                    FullRe[Top]    = (ARe + TRe) >> 1;
+                    FullIm[Top]    = (AIm + TIm) >> 1;
+                    FullRe[Bottom] = (ARe - TRe) >> 1;
+                    FullIm[Bottom] = (AIm - TIm) >> 1;
+                    }
+                }
+            }
+        for (int k = 0; k < SPECTRUM_BINS; k++){
+            Re[k] = FullRe[k];
+            Im[k] = FullIm[k];
+            }
+    }
+#endif
+
+    // Keeps the largest local maxima of the power spectrum, bin 0 is the mean and is left out
+    void findPeaks()
+    {
+        uint32_t Power[SPECTRUM_BINS];
+        for (int k = 0; k < SPECTRUM_BINS; k++){
+            Power[k] = (uint32_t)((int32_t)Re[k] * Re[k]) + (uint32_t)((int32_t)Im[k] * Im[k]);
+            }
+        uint32_t PeakPower[SPECTRUM_PEAKS];
+        PeakCount = 0;
+        for (int k = 1; k < SPECTRUM_BINS; k++){
+            uint32_t Next = (k < (SPECTRUM_BINS - 1)) ? Power[k + 1] : 0;
+            if ((Power[k] == 0) || (Power[k] <= Power[k - 1]) || (Power[k] < Next)){
+                continue;
+                }
+            // Insert it in order, dropping the smallest once the list is full
+            int i = (PeakCount < SPECTRUM_PEAKS) ? PeakCount++ : SPECTRUM_PEAKS;
+            while ((i > 0) && (PeakPower[i - 1] < Power[k])){
+                if (i < SPECTRUM_PEAKS){
+                    PeakPower[i] = PeakPower[i - 1];
+                    Peaks[i]     = Peaks[i - 1];
+                    }
+                i--;
+                }
+            if (i < SPECTRUM_PEAKS){
+                PeakPower[i]      = Power[k];
+                Peaks[i].Bin      = k;
+                Peaks[i].AmplitudeMg = amplitude(Power[k]);
+                }
+            }
+    }
+
+    // The FFT output of a vibration A counts high is A * 2^SPECTRUM_INPUT_SHIFT * 64 / 4 / 64, the 4 being 2 for the
+    // half of it that lands in the mirror image bin and 2 for the window. 256 counts is 1000mg
+    static uint16_t amplitude(uint32_t Power)
+    {
+        uint32_t Root = 0;
+        uint32_t Bit  = 1UL << 30;
+        while (Bit > Power){
+            Bit >>= 2;
+            }
+        while (Bit != 0){
+            if (Power >= (Root + Bit)){
+                Power -= Root + Bit;
+                Root = (Root >> 1) + Bit;
+                }
+            else{
+                Root >>= 1;
+                }
+            Bit >>= 2;
+            }
+        uint32_t Mg = (Root * 4 * 1000) / ((1 << SPECTRUM_INPUT_SHIFT) * 256);
+        return (Mg > 0xffff) ? 0xffff : Mg;
+    }
+
+    uint8_t Axis;
+    int16_t Window[SPECTRUM_LENGTH];
+    int Count;
+    uint32_t FirstUs;
+    uint32_t LastUs;
+#ifdef SPECTRUM_USE_CMSIS_DSP
+    arm_rfft_instance_q15 Fft;
+    q15_t Spectrum[SPECTRUM_LENGTH * 2];
+#else
+    int16_t FullRe[SPECTRUM_LENGTH];
+    int16_t FullIm[SPECTRUM_LENGTH];
+#endif
+    // Bins 0 to SPECTRUM_BINS - 1 of the last spectrum
+    int16_t Re[SPECTRUM_BINS];
+    int16_t Im[SPECTRUM_BINS];
+    SpectrumPeak Peaks[SPECTRUM_PEAKS];
+    int PeakCount;
+    uint16_t RateDeciHz;
+};
+
+#endif /* #ifndef __SPECTRUM_ANALYZER_H__ */
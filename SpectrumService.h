@@ -0,0 +1,131 @@
+// Spectrum: The strongest vibration frequencies seen by the accelerometer, see SpectrumAnalyzer.h
+#ifndef __BLE_SPECTRUM_SERVICE_H__
+#define __BLE_SPECTRUM_SERVICE_H__
+#include <mbed.h>
+#include "SensorFrame.h"
+#include "SpectrumAnalyzer.h"
+
+// Value of the peaks characteristic, notified at the end of every window, little endian
+// Axis       - The SPECTRUM_AXIS_ the spectrum was taken of
+// Count      - Number of peaks that follow, up to SPECTRUM_PEAKS
+// RateDeciHz - Sample rate over the window in tenths of a Hz (uint16), bin k is k * RateDeciHz / 640 Hz
+// Then Count peaks, largest first, of 3 bytes each, the Bin (uint8) and the AmplitudeMg (uint16)
+const int SPECTRUM_HEADER_LENGTH = 4;
+const int SPECTRUM_PEAK_LENGTH   = 3;
+const int SPECTRUM_MAX_LENGTH    = SPECTRUM_HEADER_LENGTH + SPECTRUM_PEAKS * SPECTRUM_PEAK_LENGTH;
+
+///SpectrumService///
+// Vibration monitoring needs far more samples than can be streamed, a 64 sample window is 8 notifications
+// of the accelerometer batch characteristic, where the peaks of its spectrum fit into one of 19 bytes
+// The analyzer is fed every sample the accelerometer service reads, before its filter and decimation, so the
+// spectrum goes up to half the output data rate set on the accelerometer config characteristic
+// While a client is subscribed to the peaks the accelerometer runs at 100Hz or faster, so the spectrum
+// reaches 50Hz even when the accelerometer is configured slower
+// Writing one of the SPECTRUM_AXIS_ values to the config characteristic picks what the spectrum is taken of,
+// the window in progress is thrown away and the next one starts with the new axis
+class SpectrumService {
+public:
+    //Universal Unique Identification numbers for the spectrum//
+    //The spectrum service has a UUID of 0xA023
+    //UUID Peaks Characteristic  - 0xA024, notifies the peaks of every window, see above
+    //UUID Config Characteristic - 0xA025, read or write the axis the spectrum is taken of
+    const static uint16_t SPECTRUM_SERVICE_UUID = 0xA023;
+    const static uint16_t SPECTRUM_PEAKS_CHARACTERISTIC_UUID = 0xA024;
+    const static uint16_t SPECTRUM_CONFIG_CHARACTERISTIC_UUID = 0xA025;
+
+    ///SpectrumService Constructor///
+    // Will create the spectrum service for bluetooth profile
+    SpectrumService(BLEDevice &_ble) :
+        ble(_ble),
+        PeaksCharacteristic(SPECTRUM_PEAKS_CHARACTERISTIC_UUID, Record, 0, SPECTRUM_MAX_LENGTH,
+                            GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        ConfigCharacteristic(SPECTRUM_CONFIG_CHARACTERISTIC_UUID, &ConfigValue),
+        Length(0), NotifyPending(false), NewAxis(SPECTRUM_AXIS_MAGNITUDE), AxisPending(false)
+    {
+        ConfigValue = Analyzer.axis();
+
+        // Assign the gatt characteristics to a GattCharacteristic instance
+        GattCharacteristic *charTable[] = {&PeaksCharacteristic,&ConfigCharacteristic};
+        // Create an instance of a service for the spectrum and associate the characteristics with it
+        GattService         spectrumService(SPECTRUM_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+        // Add the service to the ble profile
+        ble.addService(spectrumService);
+    }
+
+    GattAttribute::Handle_t getValueHandle() const {
+        return PeaksCharacteristic.getValueHandle();
+    }
+
+    /// onDataWritten ///
+    // Called when a client writes to any characteristic, returns true if it was the config characteristic
+    // The new axis is picked up by the next call to process() in the main loop, an axis that is out of
+    // range is put back to the one in use
+    bool onDataWritten(const GattWriteCallbackParams *params)
+    {
+        if (params->handle != ConfigCharacteristic.getValueHandle()){
+            return false;
+            }
+        if (params->len == 1){
+            NewAxis     = params->data[0];
+            AxisPending = true;
+            }
+        return true;
+    }
+
+    /// process ///
+    // Called with every accelerometer sample, scaled to 256 counts to 1g
+    void process(const SensorSample &Sample)
+    {
+        if (AxisPending){
+            AxisPending = false;
+            Analyzer.select(NewAxis);
+            ConfigValue = Analyzer.axis();
+            ble.gattServer().write(ConfigCharacteristic.getValueHandle(), &ConfigValue, 1);
+            }
+        if (Analyzer.process(Sample)){
+            pack();
+            NotifyPending = true;
+            }
+        if (NotifyPending){
+            if (ble.gattServer().write(PeaksCharacteristic.getValueHandle(), Record, Length) != BLE_STACK_BUSY){
+                NotifyPending = false;
+                }
+            }
+    }
+
+//Private variables
+private:
+    // Fills Record with the peaks of the last window
+    void pack()
+    {
+        uint16_t Rate = Analyzer.rateDeciHz();
+        Record[0] = Analyzer.axis();
+        Record[1] = Analyzer.peakCount();
+        Record[2] = Rate;
+        Record[3] = Rate >> 8;
+        Length = SPECTRUM_HEADER_LENGTH;
+        for (int i = 0; i < Analyzer.peakCount(); i++){
+            const SpectrumPeak &Peak = Analyzer.peak(i);
+            Record[Length]     = Peak.Bin;
+            Record[Length + 1] = Peak.AmplitudeMg;
+            Record[Length + 2] = Peak.AmplitudeMg >> 8;
+            Length += SPECTRUM_PEAK_LENGTH;
+            }
+    }
+
+    BLEDevice &ble;
+    uint8_t Record[SPECTRUM_MAX_LENGTH];
+    uint8_t ConfigValue;
+    GattCharacteristic PeaksCharacteristic;
+    ReadWriteGattCharacteristic<uint8_t> ConfigCharacteristic;
+    SpectrumAnalyzer Analyzer;
+    int Length;
+    // A window finished while the bluetooth stack was out of buffers, sent by the next call
+    bool NotifyPending;
+    // Set by a write to the config characteristic
+    volatile uint8_t NewAxis;
+    volatile bool AxisPending;
+
+};
+
+#endif /* #ifndef __BLE_SPECTRUM_SERVICE_H__ */
@@ -0,0 +1,183 @@
+// Stats: Per axis summaries of the accelerometer and magnetometer over a window, see WindowStats.h
+#ifndef __BLE_STATS_SERVICE_H__
+#define __BLE_STATS_SERVICE_H__
+#include <mbed.h>
+#include "SensorFrame.h"
+#include "WindowStats.h"
+
+// Summary records, one per axis at the end of every window, little endian
+// Axis     - 0 X, 1 Y, 2 Z
+// Sequence - The window the record belongs to, the same for all three axes of a window
+// Count    - Samples in the window (uint16, stops at 65535)
+// Min, Max, Mean (int16), Rms (uint16) and Variance (uint32) in the units of the samples, 256 counts to 1g for
+// the accelerometer and 0.1uT for the magnetometer
+const int STATS_RECORD_LENGTH = 16;
+
+// Value of the config characteristic, the window of the accelerometer then the magnetometer in milliseconds
+// (uint16 each), WINDOW_STATS_MIN_MS to WINDOW_STATS_MAX_MS or 0 to turn the summaries of that sensor off
+const int STATS_CONFIG_LENGTH = 4;
+
+// The sensors summarised, index into the arrays below
+const int STATS_ACCEL   = 0;
+const int STATS_MAG     = 1;
+const int STATS_SENSORS = 2;
+
+///StatsService///
+// Most clients only want to know how much a sensor moved over the last second or so, not every sample
+// The service is fed every sample of both sensors, before their filters and decimation, and sends three
+// records per window, one for each axis, in place of the whole stream. The min and max keep the envelope
+// of the signal, the mean and variance its level and how much it moves around it
+// The accelerometer samples are scaled to the 2g range like the other services see them, the magnetometer
+// samples have the hard iron calibration taken off
+class StatsService {
+public:
+    //Universal Unique Identification numbers for the stats//
+    //The stats service has a UUID of 0xA026
+    //UUID Accel Characteristic  - 0xA027, notifies the accelerometer summary records
+    //UUID Mag Characteristic    - 0xA028, notifies the magnetometer summary records
+    //UUID Config Characteristic - 0xA029, read or write the windows, see above
+    const static uint16_t STATS_SERVICE_UUID = 0xA026;
+    const static uint16_t STATS_ACCEL_CHARACTERISTIC_UUID = 0xA027;
+    const static uint16_t STATS_MAG_CHARACTERISTIC_UUID = 0xA028;
+    const static uint16_t STATS_CONFIG_CHARACTERISTIC_UUID = 0xA029;
+
+    ///StatsService Constructor///
+    // Will create the stats service for bluetooth profile
+    StatsService(BLEDevice &_ble) :
+        ble(_ble),
+        AccelSummary(STATS_ACCEL_CHARACTERISTIC_UUID, Record[STATS_ACCEL], STATS_RECORD_LENGTH, STATS_RECORD_LENGTH,
+                     GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        MagSummary(STATS_MAG_CHARACTERISTIC_UUID, Record[STATS_MAG], STATS_RECORD_LENGTH, STATS_RECORD_LENGTH,
+                   GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        StatsConfig(STATS_CONFIG_CHARACTERISTIC_UUID, ConfigValue),
+        ConfigPending(false)
+    {
+        for (int i = 0; i < STATS_SENSORS; i++){
+            NextAxis[i] = 3;
+            memset(Record[i], 0, STATS_RECORD_LENGTH);
+            }
+        packConfig();
+
+        // Assign the gatt characteristics to a GattCharacteristic instance
+        GattCharacteristic *charTable[] = {&AccelSummary,&MagSummary,&StatsConfig};
+        // Create an instance of a service for the stats and associate the characteristics with it
+        GattService         statsService(STATS_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+        // Add the service to the ble profile
+        ble.addService(statsService);
+    }
+
+    /// onDataWritten ///
+    // Called when a client writes to any characteristic, returns true if it was the config characteristic
+    // The new windows are picked up by the next call to update() in the main loop
+    bool onDataWritten(const GattWriteCallbackParams *params)
+    {
+        if (params->handle != StatsConfig.getValueHandle()){
+            return false;
+            }
+        if (params->len == STATS_CONFIG_LENGTH){
+            memcpy(NewConfig, params->data, STATS_CONFIG_LENGTH);
+            ConfigPending = true;
+            }
+        return true;
+    }
+
+    // Called with every accelerometer sample, scaled to 256 counts to 1g
+    void processAccel(const SensorSample &Sample)
+    {
+        process(STATS_ACCEL, Sample);
+    }
+    // Called with every calibrated magnetometer sample
+    void processMag(const SensorSample &Sample)
+    {
+        process(STATS_MAG, Sample);
+    }
+
+    /// update ///
+    // Called from the main loop, takes any new windows and notifies the records still to go
+    // A record the bluetooth stack has no buffer for is sent by the next call, if the next window closes first
+    // the rest of the old one is dropped and the client sees the gap in the sequence
+    void update()
+    {
+        if (ConfigPending){
+            ConfigPending = false;
+            for (int i = 0; i < STATS_SENSORS; i++){
+                uint16_t WindowMs = NewConfig[i * 2] | (NewConfig[i * 2 + 1] << 8);
+                if ((WindowMs == 0) || ((WindowMs >= WINDOW_STATS_MIN_MS) && (WindowMs <= WINDOW_STATS_MAX_MS))){
+                    Stats[i].configure(WindowMs);
+                    NextAxis[i] = 3;
+                    }
+                }
+            packConfig();
+            ble.gattServer().write(StatsConfig.getValueHandle(), ConfigValue, STATS_CONFIG_LENGTH);
+            }
+        send(STATS_ACCEL, AccelSummary.getValueHandle());
+        send(STATS_MAG, MagSummary.getValueHandle());
+    }
+
+//Private variables
+private:
+    void process(int Sensor, const SensorSample &Sample)
+    {
+        if (Stats[Sensor].process(Sample)){
+            NextAxis[Sensor] = 0;
+            }
+    }
+
+    void send(int Sensor, GattAttribute::Handle_t Handle)
+    {
+        while (NextAxis[Sensor] < 3){
+            pack(Sensor, NextAxis[Sensor]);
+            if (ble.gattServer().write(Handle, Record[Sensor], STATS_RECORD_LENGTH) == BLE_STACK_BUSY){
+                return;
+                }
+            NextAxis[Sensor]++;
+            }
+    }
+
+    // Fills the record of Sensor with the summary of Axis
+    void pack(int Sensor, int Axis)
+    {
+        const WindowStats &Window = Stats[Sensor];
+        const AxisSummary &Summary = Window.summary(Axis);
+        uint32_t Count = Window.summaryCount();
+        uint8_t *Data = Record[Sensor];
+        Data[0] = Axis;
+        Data[1] = Window.sequence();
+        put16(&Data[2], (Count > 0xffff) ? 0xffff : Count);
+        put16(&Data[4], Summary.Min);
+        put16(&Data[6], Summary.Max);
+        put16(&Data[8], Summary.Mean);
+        put16(&Data[10], Summary.Rms);
+        put16(&Data[12], Summary.Variance);
+        put16(&Data[14], Summary.Variance >> 16);
+    }
+
+    void packConfig()
+    {
+        for (int i = 0; i < STATS_SENSORS; i++){
+            put16(&ConfigValue[i * 2], Stats[i].windowMs());
+            }
+    }
+
+    static void put16(uint8_t *Data, uint16_t Value)
+    {
+        Data[0] = Value;
+        Data[1] = Value >> 8;
+    }
+
+    BLEDevice &ble;
+    WindowStats Stats[STATS_SENSORS];
+    uint8_t Record[STATS_SENSORS][STATS_RECORD_LENGTH];
+    uint8_t ConfigValue[STATS_CONFIG_LENGTH];
+    GattCharacteristic AccelSummary;
+    GattCharacteristic MagSummary;
+    ReadWriteArrayGattCharacteristic<uint8_t, STATS_CONFIG_LENGTH> StatsConfig;
+    // The axis of the last window to send next for each sensor, 3 once all of them have gone
+    int NextAxis[STATS_SENSORS];
+    // Set by a write to the config characteristic
+    uint8_t NewConfig[STATS_CONFIG_LENGTH];
+    volatile bool ConfigPending;
+
+};
+
+#endif /* #ifndef __BLE_STATS_SERVICE_H__ */
@@ -0,0 +1,161 @@
+// Window Stats: Minimum, maximum, mean, RMS and variance of each axis over a window of samples
+#ifndef __WINDOW_STATS_H__
+#define __WINDOW_STATS_H__
+#include <stdint.h>
+#include "SensorFrame.h"
+
+// Window lengths a client can set, 0 turns the statistics off
+const uint16_t WINDOW_STATS_MIN_MS     = 100;
+const uint16_t WINDOW_STATS_MAX_MS     = 60000;
+const uint16_t WINDOW_STATS_DEFAULT_MS = 1000;
+
+///AxisSummary///
+// The statistics of one axis over one window, in the units of the samples
+// Variance is the population variance, the square of the standard deviation
+struct AxisSummary {
+    int16_t Min;
+    int16_t Max;
+    int16_t Mean;
+    uint16_t Rms;
+    uint32_t Variance;
+};
+
+/// WindowStatsRoot ///
+// Integer square root, rounded down
+inline uint32_t WindowStatsRoot(uint64_t Value)
+{
+    uint64_t Root = 0;
+    uint64_t Bit  = 1ULL << 62;
+    while (Bit > Value){
+        Bit >>= 2;
+        }
+    while (Bit != 0){
+        if (Value >= (Root + Bit)){
+            Value -= Root + Bit;
+            Root = (Root >> 1) + Bit;
+            }
+        else{
+            Root >>= 1;
+            }
+        Bit >>= 2;
+        }
+    return (uint32_t)Root;
+}
+
+///WindowStats///
+// Adds up every sample of a sensor until the window is over, then works out the summary of each axis
+// Only integers are used, the sum of each axis in 32 bits and the sum of the squares in 64 bits, which at
+// the fastest output data rate of 800Hz and the longest window of 60 seconds is 48000 samples of up to 2^22
+// The window is timed from the sample timestamps, it closes with the first sample WindowMs or more after
+// the first one and that sample starts the next window, so no sample is lost between windows
+// No samples while the sensor is idle means no windows either, the window in progress carries on when it wakes
+class WindowStats {
+public:
+    WindowStats() :
+        WindowUs((uint32_t)WINDOW_STATS_DEFAULT_MS * 1000), StartUs(0), Count(0), SummaryCount(0), Sequence(0)
+    {
+        clear();
+    }
+
+    /// configure ///
+    // Sets the window length in milliseconds and starts a new window, 0 turns the statistics off
+    void configure(uint16_t WindowMs)
+    {
+        WindowUs = (uint32_t)WindowMs * 1000;
+        clear();
+    }
+
+    uint16_t windowMs() const {
+        return WindowUs / 1000;
+    }
+
+    /// process ///
+    // Takes one sample, returns true if it closed a window and summary() has the statistics of that window
+    bool process(const SensorSample &Sample)
+    {
+        if (WindowUs == 0){
+            return false;
+            }
+        bool Closed = false;
+        if ((Count != 0) && ((Sample.Timestamp - StartUs) >= WindowUs)){
+            summarise();
+            clear();
+            Closed = true;
+            }
+        if (Count == 0){
+            StartUs = Sample.Timestamp;
+            }
+        add(0, Sample.Frame.X);
+        add(1, Sample.Frame.Y);
+        add(2, Sample.Frame.Z);
+        Count++;
+        return Closed;
+    }
+
+    // Summary of Axis (0 X, 1 Y, 2 Z) for the last window
+    const AxisSummary &summary(int Axis) const {
+        return Summary[Axis];
+    }
+    // Number of samples in the last window
+    uint32_t summaryCount() const {
+        return SummaryCount;
+    }
+    // Goes up by one for every window, a client can tell a window was missed from the gap
+    uint8_t sequence() const {
+        return Sequence;
+    }
+
+private:
+    void add(int Axis, int16_t Value)
+    {
+        if (Value < Min[Axis]){
+            Min[Axis] = Value;
+            }
+        if (Value > Max[Axis]){
+            Max[Axis] = Value;
+            }
+        Sum[Axis] += Value;
+        SumSquares[Axis] += (uint32_t)((int32_t)Value * Value);
+    }
+
+    void clear()
+    {
+        for (int Axis = 0; Axis < 3; Axis++){
+            Min[Axis]        = INT16_MAX;
+            Max[Axis]        = INT16_MIN;
+            Sum[Axis]        = 0;
+            SumSquares[Axis] = 0;
+            }
+        Count = 0;
+    }
+
+    // Variance is (Count * SumSquares - Sum^2) / Count^2, worked out in one division so nothing is lost to rounding
+    void summarise()
+    {
+        for (int Axis = 0; Axis < 3; Axis++){
+            AxisSummary &Out = Summary[Axis];
+            int64_t Total = Sum[Axis];
+            Out.Min  = Min[Axis];
+            Out.Max  = Max[Axis];
+            Out.Mean = (Total >= 0) ? ((Total + Count / 2) / (int64_t)Count) : -((-Total + Count / 2) / (int64_t)Count);
+            Out.Rms  = WindowStatsRoot(SumSquares[Axis] / Count);
+            uint64_t Spread = (uint64_t)Count * SumSquares[Axis] - (uint64_t)(Total * Total);
+            Out.Variance = Spread / ((uint64_t)Count * Count);
+            }
+        SummaryCount = Count;
+        Sequence++;
+    }
+
+    uint32_t WindowUs;
+    uint32_t StartUs;
+    uint32_t Count;
+    int16_t Min[3];
+    int16_t Max[3];
+    int32_t Sum[3];
+    uint64_t SumSquares[3];
+    AxisSummary Summary[3];
+    uint32_t SummaryCount;
+    uint8_t Sequence;
+};
+
+#endif /* #ifndef __WINDOW_STATS_H__ */
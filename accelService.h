@@ -3,6 +3,18 @@
 #ifndef __BLE_ACCEL_SERVICE_H__
 #define __BLE_ACCEL_SERVICE_H__
 #include <mbed.h>
+#include "SensorFrame.h"
+#include "I2CQueue.h"
+#include "SampleRing.h"
+#include "BatchQueue.h"
+#include "SensorConfig.h"
+#include "SensorRegisters.h"
+#include "SensorFilter.h"
+#include "DeadbandPublisher.h"
+#include "SampleCache.h"
+#include "MotionWake.h"
+#include "Log.h"
+#include "LEDMatrix.h"
 
 
 // This enables the i2c bus using mbeds i2c api 
@@ -13,36 +25,38 @@
 // SCL - P0_0
 I2C i2c(P0_30, P0_0); 
 
+// All of the sensor services queue their register reads and writes on i2cQueue
+// The queue runs them back to back on the i2c bus without blocking the tickers or the bluetooth stack 
+I2CQueue i2cQueue(i2c);
+
 // Enable Universal Asynchronous Receiver/Transmitter (UART)
 // UART enables the bbc to communicate with the PC  
 // Two channels are set up to transmit(USBTX) and recive data(USBRX) 
-Serial pc(USBTX,USBRX);
+// A RawSerial rather than a Serial so the binary sample stream can feed it from its TX interrupt, see SerialStream.h 
+RawSerial pc(USBTX,USBRX);
+
+// Rate used in data ready mode, ODR of 12.5Hz (DR = 101) 
+// The default of 800Hz would swamp the bus and the bluetooth link with samples 
+const uint8_t MMA8653_DATA_READY_RATE = 5;
 
-// The standard i2c slave address for MMA8653FC is 0x1D or 0011101 - reference section 5.8, page 18 of data sheet 
-// The MMA8653_ID refers to the value of the WHOAMI byte in the register 0x0D, it has a hex value of 0x5a
-const int MMA8653_ADDRESS = (0x1d<<1); 
-const int MMA8653_ID = 0x5a;
+// Slowest rate used while a client listens to the gestures or the spectrum, ODR of 100Hz (DR = 011) 
+// A tap is over in a few tens of milliseconds and is missed between the samples of anything slower 
+const uint8_t MMA8653_GESTURE_RATE = 3;
 
-// Assigning the pins of the LEDS as outputs  
-// LED's in BBC microbit laid out in 9 columns and 3 rows 
-// The columns are intialsed to have a starting value of 1 
-// The rows have a starting value of 0 
-// Rows are anodes of the LED 
-// Columns are cathodes of LED 
-// To light LED set the column to 0 and row to 1 
-DigitalOut col1(P0_4,1);
-DigitalOut col2(P0_5,1);
-DigitalOut col3(P0_6,1);
-DigitalOut col4(P0_7,1);
-DigitalOut col5(P0_8,1);
-DigitalOut col6(P0_9,1);
-DigitalOut col7(P0_10,1);
-DigitalOut col8(P0_11,1);
-DigitalOut col9(P0_12,1);
+// The LED display, see LEDMatrix.h 
+// The arrow showing the direction of tilt is drawn on it and the refresh ticker does the rest 
+LEDMatrix ledMatrix;
 
-DigitalOut row1(P0_13);
-DigitalOut row2(P0_14);
-DigitalOut row3(P0_15);
+// The arrows, see LEDFrame, the head points the way the board is tilted 
+// The masks the display refreshes from are worked out by the compiler 
+constexpr LEDFrame LED_ARROW_UP    = {{0b00100, 0b01110, 0b10101, 0b00100, 0b00100}};
+constexpr LEDFrame LED_ARROW_DOWN  = {{0b00100, 0b00100, 0b10101, 0b01110, 0b00100}};
+constexpr LEDFrame LED_ARROW_LEFT  = {{0b00100, 0b01000, 0b11111, 0b01000, 0b00100}};
+constexpr LEDFrame LED_ARROW_RIGHT = {{0b00100, 0b00010, 0b11111, 0b00010, 0b00100}};
+constexpr LEDMasks LED_ARROW_UP_MASKS    = LEDMatrixMasks(LED_ARROW_UP);
+constexpr LEDMasks LED_ARROW_DOWN_MASKS  = LEDMatrixMasks(LED_ARROW_DOWN);
+constexpr LEDMasks LED_ARROW_LEFT_MASKS  = LEDMatrixMasks(LED_ARROW_LEFT);
+constexpr LEDMasks LED_ARROW_RIGHT_MASKS = LEDMatrixMasks(LED_ARROW_RIGHT);
 
 
 ///ACCELService///
@@ -57,191 +71,291 @@ public:
     //UUID X plane Characteristic - 0xA013
     //UUID Y plane Characteristic - 0xA014
     //UUID Z plane Characteristic - 0xA015
+    //UUID Batch Characteristic   - 0xA016, notifies several X, Y and Z samples at once, see SampleBatch.h 
+    //UUID Config Characteristic  - 0xA017, output data rate, range, oversampling, active, filter, deadband and encoding, see SensorConfig.h 
+    //UUID Motion Config          - 0xA018, motion wake enable, threshold, count and time before sleeping, see MotionWake.h 
+    //UUID Motion Status          - 0xA019, awake or asleep, number of wakes and the last wake latency, see MotionWake.h 
     const static uint16_t ACCEL_SERVICE_UUID = 0xA012;
     const static uint16_t ACCEL_X_CHARACTERISTIC_UUID = 0xA013;
     const static uint16_t ACCEL_Y_CHARACTERISTIC_UUID = 0xA014;
     const static uint16_t ACCEL_Z_CHARACTERISTIC_UUID = 0xA015;
+    const static uint16_t ACCEL_BATCH_CHARACTERISTIC_UUID = 0xA016;
+    const static uint16_t ACCEL_CONFIG_CHARACTERISTIC_UUID = 0xA017;
+    const static uint16_t ACCEL_MOTION_CONFIG_CHARACTERISTIC_UUID = 0xA018;
+    const static uint16_t ACCEL_MOTION_STATUS_CHARACTERISTIC_UUID = 0xA019;
     
     //ACCELService Constructor//
     // Will create the Accelerometer service for bluetooth profile 
     // Assigns the UUID's decalred for Accelerometer and Characteristics 
-    // Wakes up the Accelerometer by writing to control register 1 a value of 1
+    // Wakes up the Accelerometer at 800Hz, 2g range and normal oversampling, the same as writing 1 to control register 1
     ACCELService(BLEDevice &_ble, int16_t initialValueForACCELCharacteristic) :
-        ble(_ble), AccelX(ACCEL_X_CHARACTERISTIC_UUID, &initialValueForACCELCharacteristic),AccelY(ACCEL_Y_CHARACTERISTIC_UUID, &initialValueForACCELCharacteristic),AccelZ(ACCEL_Z_CHARACTERISTIC_UUID, &initialValueForACCELCharacteristic)
+        ble(_ble), AccelX(ACCEL_X_CHARACTERISTIC_UUID, &initialValueForACCELCharacteristic),AccelY(ACCEL_Y_CHARACTERISTIC_UUID, &initialValueForACCELCharacteristic),AccelZ(ACCEL_Z_CHARACTERISTIC_UUID, &initialValueForACCELCharacteristic),
+        AccelBatch(ACCEL_BATCH_CHARACTERISTIC_UUID, NULL, 0, SAMPLE_BATCH_MAX_LENGTH, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        AccelConfig(ACCEL_CONFIG_CHARACTERISTIC_UUID, (uint8_t *)&Config),
+        AccelMotionConfig(ACCEL_MOTION_CONFIG_CHARACTERISTIC_UUID, (uint8_t *)&Motion.config()),
+        AccelMotionStatus(ACCEL_MOTION_STATUS_CHARACTERISTIC_UUID, (MotionStatus *)&Motion.status(), GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        DataReady(false), Raised(false), FrameReadPending(false), MotionReadPending(false), Latest(), Raw(), DirectionSample(), DirectionSequence(0)
     {
+        // The starting configuration, also the initial value of the config characteristic 
+        Config.Rate         = 0;
+        Config.Range        = 0;
+        Config.Oversampling = 0;
+        Config.Active       = 1;
+        Config.Filter       = SENSOR_FILTER_NONE;
+        Config.Decimation   = 1;
+        Config.Deadband     = SENSOR_CONFIG_DEFAULT_DEADBAND;
+        Config.MaxSilence   = SENSOR_CONFIG_DEFAULT_MAX_SILENCE;
+        Config.Encoding     = SAMPLE_CODEC_RAW;
+        
         // Assign the gatt characteristics to a GattCharacteristic instance 
-        GattCharacteristic *charTable[] = {&AccelX,&AccelY,&AccelZ};
+        GattCharacteristic *charTable[] = {&AccelX,&AccelY,&AccelZ,&AccelBatch,&AccelConfig,&AccelMotionConfig,&AccelMotionStatus};
         // Create an instance of a service for the Accelerometer and associate the characteristics with it
         GattService         AccelService(ACCEL_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
         // Add the service to the ble profile 
         ble.addService(AccelService);
         
-        // Wake the accelerometer from sleep mode by writing 1 to register number 0x2a    
-        char Data[8]; // Declare a buffer for data transfer    
-        int Status;
-        Data[0]=0x2a; // Control regester 1 address 
-        Data[1]=1;
-        Status = i2c.write(MMA8653_ADDRESS,Data,2);  // Write data to register    
+        // Wake the accelerometer from sleep mode    
+        applyConfig();
     }
 
     GattAttribute::Handle_t getValueHandle() const {
         return AccelX.getValueHandle();
     }
     
-    // Updates the value of the X characteristic 
-    void updateAccelX(uint16_t newValue) {
-        ble.gattServer().write(AccelX.getValueHandle(), (uint8_t *)&newValue, sizeof(uint16_t));
+    /// EnableDataReadyInterrupt ///
+    // Sets up the MMA8653 to pull its INT1 pin low every time a new sample is ready 
+    // The part must be put in standby before the control registers can be changed 
+    // The INT1 pin is active low and stays low until the X, Y and Z registers have been read 
+    void EnableDataReadyInterrupt()
+    {
+        DataReady   = true;
+        Config.Rate = MMA8653_DATA_READY_RATE;
+        applyConfig();
+        writeConfig();
     }
-    // Updates the value of the Y characteristic 
-    void updateAccelY(uint16_t newValue) {
-        ble.gattServer().write(AccelY.getValueHandle(), (uint8_t *)&newValue, sizeof(uint16_t));
+    
+    /// RaiseRate ///
+    // Called with true while a client listens to the gestures or the spectrum, which need every sample 
+    // at MMA8653_GESTURE_RATE or faster, and with false once they have all gone 
+    // A slower configured rate is raised until then, the config characteristic shows the rate in use 
+    // When polling, the caller must follow the new SamplePeriodUs() 
+    void RaiseRate(bool Raise)
+    {
+        uint8_t Before = Rate();
+        Raised = Raise;
+        if (Rate() != Before){
+            applyConfig();
+            writeConfig();
+            }
+    }
+    
+    /// onDataWritten ///
+    // Called when a client writes to any characteristic, returns true if it was the config characteristic 
+    // A valid configuration is sent to the MMA8653 straight away, an invalid one is ignored 
+    // Either way the characteristic is rewritten so a client reading it back sees what the sensor is using 
+    // Motion wake settings go the same way through the motion config characteristic, they leave the output 
+    // data rate alone so false is returned for them 
+    bool onDataWritten(const GattWriteCallbackParams *params)
+    {
+        if (params->handle == AccelMotionConfig.getValueHandle()){
+            if (params->len == MOTION_CONFIG_LENGTH){
+                MotionConfig NewMotion;
+                memcpy(&NewMotion, params->data, MOTION_CONFIG_LENGTH);
+                if (MotionConfigValid(NewMotion)){
+                    Motion.configure(NewMotion);
+                    applyConfig();
+                    }
+                }
+            ble.gattServer().write(AccelMotionConfig.getValueHandle(), (uint8_t *)&Motion.config(), MOTION_CONFIG_LENGTH);
+            return false;
+            }
+        if (params->handle != AccelConfig.getValueHandle()){
+            return false;
+            }
+        if (SensorConfigLengthValid(params->len)){
+            SensorConfig NewConfig = Config;
+            memcpy(&NewConfig, params->data, params->len);
+            if (MMA8653ConfigValid(NewConfig)){
+                Config = NewConfig;
+                applyConfig();
+                }
+            }
+        writeConfig();
+        return true;
     }
-    // Updates the value of the Z characteristic 
-    void updateAccelZ(uint16_t newValue) {
-        ble.gattServer().write(AccelZ.getValueHandle(), (uint8_t *)&newValue, sizeof(uint16_t));
+    
+    // Time between samples at the output data rate in use in microseconds 
+    uint32_t SamplePeriodUs() const {
+        return MMA8653_SAMPLE_PERIOD_US[Rate()];
     }
+
     
+    // Updates the value of the X characteristic if it has moved past the deadband 
+    void updateAccelX(int16_t newValue, uint32_t Now) {
+        PublishX.publish(ble, AccelX.getValueHandle(), newValue, Now);
+    }
+    // Updates the value of the Y characteristic if it has moved past the deadband 
+    void updateAccelY(int16_t newValue, uint32_t Now) {
+        PublishY.publish(ble, AccelY.getValueHandle(), newValue, Now);
+    }
+    // Updates the value of the Z characteristic if it has moved past the deadband 
+    void updateAccelZ(int16_t newValue, uint32_t Now) {
+        PublishZ.publish(ble, AccelZ.getValueHandle(), newValue, Now);
+    }
     
     
-/// MMA8653_ReadAccelX ///
-// Will read the value value of accleration in the X plane from the MMA8653
-// The current value of accleration in the x plane is returend from function 
-int16_t MMA8653_ReadAccelX()
-{
-    //Data   - Bufer for data transfer 
-    //Status - Return status of read/write i2c operations
-    //X      - The value of accleration in X plane 
-    char Data[8]; // Declare a buffer for data transfer    
-    int Status;
-    int16_t X;
-    
-    //Data[0] is assigned a value of 0x01 as this will be the 8 MSB's of the accleration in the x plane 
-    //There is a 10 bit A/D converter, the 2 remaining LSB's are in register 0x02
-    Data[0]=0x01; 
-    
-    //First write to the register number 0x01 to the MMA865
-    Status = i2c.write(MMA8653_ADDRESS,Data,1,true);
-    //Now read the value of the register 0x01 from the MMA865  
-    Status = i2c.read(MMA8653_ADDRESS,Data,2);
-    
-    //The value of X will be a 10 bit number but only the 8 MSB's have been read 
-    //If the remining 2 LSB's could be read from register 0x02  
-    X = Data[0];            
-    X = (X << 8) + Data[1]; //16 bit number 
-    X = X >> 6;             //10 bit number 
-    return X;
-
-}
-
-/// MMA8653_ReadAccelY ///
-// Will read the value value of accleration in the Y plane from the MMA8653
-// The current value of accleration in the Y plane is returend from function 
-int16_t MMA8653_ReadAccelY()
-{
-    //Data   - Bufer for data transfer 
-    //Status - Return status of read/write i2c operations
-    //Y      - The value of accleration in X plane 
-    char Data[8];   
-    int Status;
-    int16_t Y;
-    
-    //Data[0] is assigned a value of 0x03 as this will be the 8 MSB's of the accleration in the y plane 
-    //There is a 10 bit A/D converter, the 2 remaining LSB's are in register 0x04
-    Data[0]=0x03;
-    
-    //First write to the register number 0x03 to the MMA865
-    Status = i2c.write(MMA8653_ADDRESS,Data,1,true);
-    //Now read the value of the register 0x03 from the MMA865  
-    Status = i2c.read(MMA8653_ADDRESS,Data,2);
-    
-    //The value of Y will be a 10 bit number but only the 8 MSB's have been read 
-    //If the remining 2 LSB's could be read from register 0x04
-    Y = Data[0];
-    Y = (Y << 8) + Data[1]; //16 bit number 
-    Y = Y >> 6;             //10 bit number 
-    return Y;
-}
-
-/// MMA8653_ReadAccelZ  ///
-// Will read the value value of accleration in the Z plane from the MMA8653
-// The current value of accleration in the Z plane is returend from function 
-int16_t MMA8653_ReadAccelZ()
-{
-    //Data   - Bufer for data transfer 
-    //Status - Return status of read/write i2c operations
-    //Z      - The value of accleration in Z plane 
-    char Data[8];   
-    int Status;
-    int16_t Z;
-    
-    //Data[0] is assigned a value of 0x05 as this will be the 8 MSB's of the accleration in the Z plane 
-    //There is a 10 bit A/D converter, the 2 remaining LSB's are in register 0x06
-    Data[0]=0x05;
-    
-    //First write to the register number 0x05 to the MMA865
-    Status = i2c.write(MMA8653_ADDRESS,Data,1,true);
-    //Now read the value of the register 0x05 from the MMA865 
-    Status = i2c.read(MMA8653_ADDRESS,Data,2);
-    
-    //The value of Z will be a 10 bit number but only the 8 MSB's have been read 
-    //If the remining 2 LSB's could be read from register 0x06
-    Z = Data[0];
-    Z = (Z << 8) + Data[1]; //16 bit number
-    Z = Z >> 6;             //10 bit number 
-    return Z;
-}
     
     ///poll///
     //Poll will get the value of the acellerometer for the x, y and z planes
-    //by calling the functions MMA8653_ReadAccelX(), MMA8653_ReadAccelY and MMA8653_ReadAccelZ()
-    //The values of the x, y and z planes are updated using i2c 
-    //The two functions used in i2c are i2c.write and i2c.read
-    
-    //i2c.write - The master writes to the slave using i2c, requires 4 parameters 
-    //Address   - The i2c device address that will be written to, the i2c address is in the variable MMA8653_ADDRESS 0x1D
-    //Data      - The internal register to write, remeber a write of the memory location that is to be read is required first in i2c  
-    //lenght    - The number of bytes to send, in the case below 1 byte will be written at a time the registers for the MSB's of the X, Y and Z planes
-    //repeated  - Default value is False,set True does not send stop condition at end of write, this means multiple i2c transactions can happen sequentially all teminated by 1 stop condition 
-    
-    
-    //i2c.read  - Performs an i2c read transaction, requires 4 parameters 
-    //Address   - The i2c address of the devce that will be read, here MMA8653_ADDRESS 0x1D
-    //Data      - The internal register that's value will be read, in the MMA8653 it will be the X, Y and Z registers for accleration
-    //lenght    - The number of bytes to read, if one byte adress is given and lenght set to 2 bytes it will return the next value of next memory location along with value of original memeory location requested 
-    //repeated  - Default value is False, set True does not send a stop condition at end of read, this means multiple i2c transactions can happen sequentially all teminated by 1 stop condition 
+    //A read of the 6 output registers (0x01 to 0x06) is queued on i2cQueue, the register number 
+    //auto increments so the MSB and LSB of the X, Y and Z planes come back in one transaction 
+    //When the read completes onFrameRead() decodes the values and pushes them onto the sample ring 
+    //If the last read has not completed yet there is no need to queue another 
     void poll()
     {
-        // X - x plane value 
-        // Y - y plane value 
-        // Z - z plane value
-        int16_t X;
-        int16_t Y;
-        int16_t Z;
-        
-        //Get each of the values 
-        Z=MMA8653_ReadAccelZ();
-        X=MMA8653_ReadAccelX();
-        Y=MMA8653_ReadAccelY();
+        if (FrameReadPending || !Config.Active || Motion.asleep()){
+            return;
+            }
+        FrameReadPending = true;
+        FrameTimestamp = us_ticker_read();
+        if (!i2cQueue.Read(MMA8653_ADDRESS, SENSOR_FRAME_FIRST_REGISTER, FrameData, SENSOR_FRAME_LENGTH, callback(this, &ACCELService::onFrameRead))){
+            FrameReadPending = false;
+            }
+    }
+    
+    // Returns true while a read queued by poll() has not completed 
+    bool ReadPending() const {
+        return FrameReadPending;
+    }
+    
+    ///MotionInterrupt///
+    // Called on the falling edge of the MMA8653 INT2 pin, which signals motion and the auto-sleep changing state 
+    // Notes the time for the wake latency and queues a read of SYSMOD and INT_SOURCE (0x0b and 0x0c) 
+    // onMotionSourceRead() hands them to Motion, reading SYSMOD also releases the pin 
+    void MotionInterrupt()
+    {
+        Motion.onInterrupt(us_ticker_read());
+        if (MotionReadPending){
+            return;
+            }
+        MotionReadPending = true;
+        if (!i2cQueue.Read(MMA8653_ADDRESS, MMA8653_SYSMOD, MotionData, 2, callback(this, &ACCELService::onMotionSourceRead))){
+            MotionReadPending = false;
+            }
+    }
+    
+    // Returns true while the reads queued by MotionInterrupt() have not completed 
+    bool MotionPending() const {
+        return MotionReadPending;
+    }
+    
+    // Returns true while motion wake has the micro:bit idling, sampling stops until the board moves 
+    bool Asleep() const {
+        return Motion.asleep();
+    }
+    
+    ///onSample///
+    // Attaches a handler that publish() calls with every sample read, before the filter and decimation 
+    // It sees every sample whether or not the batch characteristic is keeping up with the link 
+    // The X, Y and Z values are scaled to the 2g range (256 counts to 1g) whatever range is configured 
+    void onSample(const Callback<void(const SensorSample &)> &Handler)
+    {
+        SampleHandler = Handler;
+    }
+    
+    ///publish///
+    // Called from the main loop, drains the samples read since the last call 
+    // Sampling runs at whatever rate the sensor is read while publishing runs as often as the 
+    // main loop gets to it and the link allows 
+    // Every sample is run through the filter selected by the config characteristic, see SensorFilter.h 
+    // Every sample left after decimation goes into the batch characteristic, a full batch is notified straight away and a part 
+    // filled one once its first sample is SAMPLE_BATCH_MAX_LATENCY_US old 
+    // The ring is emptied every time whatever the link is doing, if the bluetooth stack has no room for the 
+    // notification only the filtered samples wait, in Batches, see BatchQueue.h 
+    // The X, Y and Z characteristics hold a single value so only the newest sample is written to them, 
+    // and only once it has moved past the deadband or the characteristic has been silent too long 
+    void publish()
+    {
+        // Let a client know the micro:bit has gone to sleep, woken up or measured a wake latency 
+        if (Motion.update()){
+            ble.gattServer().write(AccelMotionStatus.getValueHandle(), (uint8_t *)&Motion.status(), sizeof(MotionStatus));
+            }
+        bool NewSample = false;
+        bool NewRaw = false;
+        SensorSample Sample;
+        SensorSample Newest;
+        SensorSample NewestRaw;
+        while (Samples.pop(Sample)){
+            if (SampleHandler){
+                SampleHandler(scaled(Sample));
+                }
+            NewestRaw = Sample;
+            NewRaw = true;
+            if (!Filter.process(Sample.Frame, Sample.Frame)){
+                continue;
+                }
+            Batches.add(Sample);
+            Newest = Sample;
+            NewSample = true;
+            }
+        Batches.flush(us_ticker_read(), callback(this, &ACCELService::sendBatch));
+        if (NewRaw){
+            Raw.write(NewestRaw);
+            }
+        if (!NewSample){
+            return;
+            }
+        // Every other consumer picks the sample up from the cache 
+        Latest.write(Newest);
         
         // Update the characteristcs for each 
         // of these values in bluetooth profile 
-        updateAccelX(X);
-        updateAccelY(Y);
-        updateAccelZ(Z);  
+        uint32_t Now = us_ticker_read();
+        updateAccelX(Newest.Frame.X, Now);
+        updateAccelY(Newest.Frame.Y, Now);
+        updateAccelZ(Newest.Frame.Z, Now);  
         
-        //Will write values to COM port useful for debug     
-        pc.printf("X=%d Y=%d Z=%d \n\r",X,Y,Z); 
+        //Will write values to COM port useful for debug, queued on the log and printed by the main loop 
+        LOG_DEBUG("X=%d Y=%d Z=%d",Newest.Frame.X,Newest.Frame.Y,Newest.Frame.Z); 
+    }
+    
+    // Number of samples dropped because publish() fell behind the sensor 
+    uint32_t Overruns() const {
+        return Samples.overruns();
+    }
+    
+    // Number of filtered samples left out of the batch characteristic because the link fell behind 
+    uint32_t BatchDrops() const {
+        return Batches.dropped();
+    }
+    
+    // The newest sample published and its sequence number, all zero until the first one 
+    // Safe to read from any context, see SampleCache.h 
+    const SampleCache<SensorSample> &LatestSample() const {
+        return Latest;
+    }
+    
+    // The newest sample read, before the filter and decimation, for the heading and the arrow 
+    // A high pass filter would take gravity out and the others add lag, see HeadingService.h 
+    const SampleCache<SensorSample> &RawSample() const {
+        return Raw;
     }
     
     ///Direction///
-    // This function will read the values of the X and Y palne of the acelerometer
-    // Based upon these values it can be determined what direction the bbc microbit is tilted 
+    // Uses the values of the X and Y planes of the newest sample read to update the arrow on the LED display 
+    // The sample comes from the raw cache rather than another read of the acelerometer, so the bus only carries 
+    // the reads queued by poll(). It is taken before the filter, a high or band pass filter would take gravity 
+    // out and leave the arrow pointing at noise, see RawSample() 
+    // If the main loop was writing the cache when the ticker went off the last sample is shown again 
+    void Direction(){
+        Raw.read(DirectionSample, DirectionSequence);
+        ShowDirection(DirectionSample.Frame.X, DirectionSample.Frame.Y);
+    }
+    
+    ///ShowDirection///
+    // Based upon the values of the X and Y plane it can be determined what direction the bbc microbit is tilted 
     // Functions are then called to display arrows on the LED display in the tilted direction  
-    void Direction(){ 
-        int16_t X;
-        int16_t Y;      
-        X=MMA8653_ReadAccelX();
-        Y=MMA8653_ReadAccelY();
+    void ShowDirection(int16_t X, int16_t Y){ 
          
     //-X and -Y
     //Tilt is to the bottom right    
@@ -293,170 +407,172 @@ int16_t MMA8653_ReadAccelZ()
  
     // Up //
     // Will display a Up arrow on LED display    
-    // Rows are anodes of the LED 
-    // Columns are cathodes of LED 
-    // Should not have more than 1 row powered at once  
     void Up(){
-             //ROW1//     
-             row1=1;  
-             col2=0;
-             col6=0;
-             wait(0.01);
-             row1=0;
-             col2=1;
-             col6=1;
-             
-             //ROW2//
-             row2=1;
-             col3=0;
-             col2=0;
-             col1=0;
-             wait(0.01);
-             row2=0;   
-             col3=1;
-             col2=1;
-             col1=1;
-             
-             //ROW3//
-             row3=1;
-             col5=0;
-             col7=0;
-             col6=0;
-             col1=0;
-             wait(0.01);
-             row3=0;
-             col5=1;
-             col7=1;
-             col6=1;
-             col1=1; 
-         }
+        ledMatrix.show(LED_ARROW_UP_MASKS);
+        }
     //Left//
     //Will display a Left arrow on LED display        
-    // Rows are anodes of the LED 
-    // Columns are cathodes of LED 
-    // Should not have more than 1 row powered at once  
     void Left(){
-            //ROW1//
-            row1=1;
-            col2=0;
-            col7=0;
-            col9=0;
-            wait(0.01);
-            row1=0;
-            col2=1;
-            col7=1;
-            col9=1;
-            
-            //ROW2//
-            row2=1;
-            col1=0;
-            col2=0;
-            col3=0;
-            wait(0.01);
-            row2=0;
-            col1=1;
-            col2=1;
-            col3=1;
-            
-            //ROW3//
-            row3=1;
-            col1=0;
-            col5=0;
-            col9=0;
-            wait(0.01);
-            row3=0;
-            col1=1;
-            col5=1;
-            col9=1;
-            }
-        
+        ledMatrix.show(LED_ARROW_LEFT_MASKS);
+        }
     //Right//
     //Will display a Right arrow on LED display    
-    // Rows are anodes of the LED 
-    // Columns are cathodes of LED 
-    // Should not have more than 1 row powered at once  
     void Right(){
-        //ROW1//
-        row1=1;
-        col2=0;   
-        col5=0;
-        col9=0;  
-        wait(0.01);
-        row1=0;
-        col2=1;   
-        col5=1;
-        col9=1;
-        
-        //ROW2//
-        row2=1;
-        col1=0;
-        col2=0;
-        col3=0;
-        wait(0.01);
-        row2=0;
-        col1=1;
-        col2=1;
-        col3=1;
-        
-        //ROW3//
-        row3=1;
-        col1=0;
-        col7=0;
-        col9=0; 
-        wait(0.01);
-        row3=0;
-        col1=1;
-        col7=1;
-        col9=1; 
-               
-               }
-               
+        ledMatrix.show(LED_ARROW_RIGHT_MASKS);
+        }
     //Down//
-    //Will display a Right arrow on LED display    
-    // Rows are anodes of the LED 
-    // Columns are cathodes of LED 
-    // Should not have more than 1 row powered at once   
+    //Will display a Down arrow on LED display    
     void Down(){
-        //ROW1//
-        row1=1;
-        col2=0;
-        col5=0;
-        col6=0;
-        col7=0;
-        wait(0.01);
-        row1=0;
-        col2=1;
-        col5=1;
-        col6=1;
-        col7=1;
-        
-        //ROW2//
-        row2=1;
-        col1=0;
-        col2=0;
-        col3=0;
-        wait(0.01);
-        row2=0;
-        col1=1;
-        col2=1;
-        col3=1;
-        
-        //ROW3//
-        row3=1;
-        col1=0;
-        col6=0;
-        wait(0.01);
-        row3=0;
-        col1=1;
-        col6=1;
-    }
+        ledMatrix.show(LED_ARROW_DOWN_MASKS);
+        }
     
 //Private variables of the class 
 private:
+    /// onFrameRead ///
+    // Called by i2cQueue when the read queued by poll() has completed 
+    // Status is 0 if the read succeeded, each plane is a 10 bit number split across the MSB and 
+    // 2 bits of the LSB register, DecodeMMA8653Frame joins each pair into a signed 10 bit number 
+    // The sample is pushed onto the ring for publish() to pick up 
+    void onFrameRead(int Status)
+    {
+        FrameReadPending = false;
+        if (Status != 0){
+            return;
+            }
+        SensorSample Sample;
+        Sample.Timestamp = FrameTimestamp;
+        Sample.Frame     = DecodeMMA8653Frame(FrameData);
+        Samples.push(Sample);
+    }
+    
+    /// sendBatch ///
+    // Notifies the batch, returns false if the bluetooth stack is out of buffers and it must be sent later 
+    // The nRF51 port also returns BLE_STACK_BUSY when nobody is connected, so busy only means "try again" 
+    // while there is a link. With no link, or any other error (the client is not listening), the batch is dropped 
+    bool sendBatch(const SampleBatch &Batch)
+    {
+        ble_error_t Error = ble.gattServer().write(AccelBatch.getValueHandle(), Batch.data(), Batch.length());
+        if ((Error == BLE_STACK_BUSY) && ble.gap().getState().connected){
+            return false;
+            }
+        if (Error == BLE_ERROR_NONE){
+            Motion.notified(us_ticker_read());
+            }
+        return true;
+    }
+    
+    /// scaled ///
+    // Sample with X, Y and Z scaled from the configured range to the 2g range 
+    SensorSample scaled(const SensorSample &Sample) const
+    {
+        SensorSample Scaled = Sample;
+        Scaled.Frame.X = Sample.Frame.X * (1 << Config.Range);
+        Scaled.Frame.Y = Sample.Frame.Y * (1 << Config.Range);
+        Scaled.Frame.Z = Sample.Frame.Z * (1 << Config.Range);
+        return Scaled;
+    }
+    
+    /// onMotionSourceRead ///
+    // Called by i2cQueue when the read queued by MotionInterrupt() has completed, MotionData holds SYSMOD and INT_SOURCE 
+    // A latched motion event is cleared by reading FF_MT_SRC, the pin is released once both reads are done 
+    void onMotionSourceRead(int Status)
+    {
+        if ((Status == 0) && Motion.onSource(MotionData[0], MotionData[1], us_ticker_read())){
+            if (i2cQueue.Read(MMA8653_ADDRESS, MMA8653_FF_MT_SRC, MotionData, 1, callback(this, &ACCELService::onMotionEventRead))){
+                return;
+                }
+            }
+        MotionReadPending = false;
+    }
+    
+    /// onMotionEventRead ///
+    // Called by i2cQueue once FF_MT_SRC has been read, which axes moved does not matter here 
+    // A failed read leaves the motion event latched and INT2 low, serviceMotion() sees the pin still 
+    // asserted and queues both reads again 
+    void onMotionEventRead(int Status)
+    {
+        MotionReadPending = false;
+        if (Status != 0){
+            LOG_WARN("FF_MT_SRC read failed %d", Status);
+            return;
+            }
+    }
+    
+    /// applyConfig ///
+    // Queues the writes to put Config into the MMA8653, see WriteMMA8653Config() in SensorRegisters.h 
+    // The filter, deadband and encoding settings are handed to Filter, the publishers and Batches 
+    void applyConfig()
+    {
+        Filter.configure(Config.Filter, Config.Decimation);
+        Batches.setEncoding(Config.Encoding);
+        PublishX.configure(Config.Deadband, Config.MaxSilence * 1000000UL);
+        PublishY.configure(Config.Deadband, Config.MaxSilence * 1000000UL);
+        PublishZ.configure(Config.Deadband, Config.MaxSilence * 1000000UL);
+        WriteMMA8653Config(i2cQueue, Config, Rate(), DataReady, Motion);
+    }
+    
+    /// Rate ///
+    // The output data rate in use, the configured one unless RaiseRate() needs it faster 
+    // A lower DR code is a faster rate 
+    uint8_t Rate() const
+    {
+        return (Raised && (Config.Rate > MMA8653_GESTURE_RATE)) ? MMA8653_GESTURE_RATE : Config.Rate;
+    }
+    
+    /// writeConfig ///
+    // Rewrites the config characteristic with the configuration in use, including a raised rate 
+    void writeConfig()
+    {
+        SensorConfig InUse = Config;
+        InUse.Rate = Rate();
+        ble.gattServer().write(AccelConfig.getValueHandle(), (uint8_t *)&InUse, SENSOR_CONFIG_LENGTH);
+    }
+    
     BLEDevice &ble;
     ReadOnlyGattCharacteristic<int16_t>  AccelX;
     ReadOnlyGattCharacteristic<int16_t>  AccelY;
     ReadOnlyGattCharacteristic<int16_t>  AccelZ;
+    GattCharacteristic                   AccelBatch;
+    ReadWriteArrayGattCharacteristic<uint8_t, SENSOR_CONFIG_LENGTH> AccelConfig;
+    ReadWriteArrayGattCharacteristic<uint8_t, MOTION_CONFIG_LENGTH> AccelMotionConfig;
+    ReadOnlyGattCharacteristic<MotionStatus> AccelMotionStatus;
+    SensorConfig                         Config;
+    
+    // Motion wake state machine and whether the data ready interrupt is enabled, see MotionWake.h 
+    MotionWake                           Motion;
+    bool                                 DataReady;
+    // True while RaiseRate() holds the output data rate at MMA8653_GESTURE_RATE or faster 
+    bool                                 Raised;
+    
+    // Raw register contents for the read queued by poll() 
+    // The buffer is only reused once the read using it has completed 
+    char FrameData[SENSOR_FRAME_LENGTH];
+    uint32_t FrameTimestamp;
+    volatile bool FrameReadPending;
+    
+    // SYSMOD and INT_SOURCE, then FF_MT_SRC, for the reads queued by MotionInterrupt() 
+    char MotionData[2];
+    volatile bool MotionReadPending;
+    
+    // Samples read but not yet published, the filter they pass through on the way out, 
+    // the filtered samples waiting for the batch characteristic, the newest sample published and the newest read 
+    SampleRing<SensorSample, 16> Samples;
+    SensorFilter Filter;
+    
+    // Decide when each of the X, Y and Z characteristics is worth writing 
+    DeadbandPublisher<int16_t> PublishX;
+    DeadbandPublisher<int16_t> PublishY;
+    DeadbandPublisher<int16_t> PublishZ;
+    BatchQueue Batches;
+    SampleCache<SensorSample> Latest;
+    SampleCache<SensorSample> Raw;
+    
+    // Called with every sample read, see onSample() 
+    Callback<void(const SensorSample &)> SampleHandler;
+    
+    // The sample the arrow was last drawn from 
+    SensorSample DirectionSample;
+    uint32_t DirectionSequence;
 };
 
 #endif /* #ifndef __BLE_ACCEL_SERVICE_H__ */
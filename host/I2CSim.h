@@ -0,0 +1,156 @@
+// I2C Sim: Stand in for the mbed I2C class so the sensor code can run on a PC
+// MBED I2C API - https://os.mbed.com/docs/mbed-os/v5.14/apis/i2c.html
+// Every transaction is handed to the simulated device at its address, the bus time the transaction
+// would take on the micro:bit is added to HostClock so output data rates and bus load come out right
+#ifndef __I2C_SIM_H__
+#define __I2C_SIM_H__
+#include <stdint.h>
+#include <stddef.h>
+
+///HostClock///
+// Simulated time in microseconds, us_ticker_read() returns it on the host
+// Nothing moves it on by itself, the simulation and the bus advance it
+struct HostClock {
+    static uint64_t &now() {
+        static uint64_t Now = 0;
+        return Now;
+    }
+    static void advance(uint64_t Us) {
+        now() += Us;
+    }
+};
+
+///I2CDevice///
+// A register level model of one chip on the bus
+// start()  - A write has addressed the chip, the first byte written is the register number
+// write()  - One byte written after the register number
+// read()   - One byte read from the register pointer, which then moves on
+class I2CDevice {
+public:
+    virtual ~I2CDevice() {}
+    virtual void start(uint8_t Register) = 0;
+    virtual void write(uint8_t Value) = 0;
+    virtual uint8_t read() = 0;
+};
+
+///I2C///
+// Same constructor, write(), read() and frequency() as the mbed class
+// Addresses are the 8 bit form used on mbed, (7 bit address << 1)
+// write() and read() return 0 on success and 1 if no device answers (a NACK), as on the micro:bit
+// nackEvery() makes the devices miss the odd address byte so retries can be exercised
+class I2C {
+public:
+    // Number of devices that can be attached to one bus
+    const static int I2C_SIM_MAX_DEVICES = 4;
+
+    I2C(int /* Sda */ = 0, int /* Scl */ = 0) :
+        Hz(100000), DeviceCount(0), Current(NULL), NackPeriod(0), Addressed(0), Transactions(0), Bytes(0), BusyUs(0)
+    {
+    }
+
+    /// attach ///
+    // Puts a device model on the bus at Address
+    void attach(int Address, I2CDevice &Device)
+    {
+        if (DeviceCount < I2C_SIM_MAX_DEVICES) {
+            Addresses[DeviceCount] = Address & 0xfe;
+            Devices[DeviceCount]   = &Device;
+            DeviceCount++;
+        }
+    }
+
+    void frequency(int NewHz) {
+        Hz = NewHz;
+    }
+
+    // Every Period'th time a device is addressed it does not acknowledge, 0 to never NACK
+    void nackEvery(int Period) {
+        NackPeriod = Period;
+    }
+
+    /// write ///
+    // The first byte sets the register pointer, the rest are written from there on
+    int write(int Address, const char *Data, int Length, bool /* Repeated */ = false)
+    {
+        Current = find(Address);
+        if ((Current == NULL) || nack()) {
+            busTime(0);
+            return 1;
+        }
+        busTime(Length);
+        if (Length > 0) {
+            Current->start((uint8_t)Data[0]);
+        }
+        for (int i = 1; i < Length; i++) {
+            Current->write((uint8_t)Data[i]);
+        }
+        return 0;
+    }
+
+    /// read ///
+    // Reads from the register pointer left by the last write, it moves on after every byte
+    int read(int Address, char *Data, int Length, bool /* Repeated */ = false)
+    {
+        Current = find(Address);
+        if ((Current == NULL) || nack()) {
+            busTime(0);
+            return 1;
+        }
+        busTime(Length);
+        for (int i = 0; i < Length; i++) {
+            Data[i] = (char)Current->read();
+        }
+        return 0;
+    }
+
+    // Number of transactions, bytes moved and microseconds the bus has been busy
+    uint32_t transactions() const {
+        return Transactions;
+    }
+    uint32_t bytes() const {
+        return Bytes;
+    }
+    uint64_t busyUs() const {
+        return BusyUs;
+    }
+
+private:
+    I2CDevice *find(int Address)
+    {
+        for (int i = 0; i < DeviceCount; i++) {
+            if (Addresses[i] == (Address & 0xfe)) {
+                return Devices[i];
+            }
+        }
+        return NULL;
+    }
+
+    bool nack()
+    {
+        Addressed++;
+        return (NackPeriod != 0) && ((Addressed % NackPeriod) == 0);
+    }
+
+    // A start, the address byte and each data byte take 9 clocks each (8 bits and the acknowledge)
+    void busTime(int Length)
+    {
+        uint64_t Us = ((uint64_t)(Length + 1) * 9 + 1) * 1000000 / Hz;
+        Transactions++;
+        Bytes += Length;
+        BusyUs += Us;
+        HostClock::advance(Us);
+    }
+
+    int Hz;
+    int Addresses[I2C_SIM_MAX_DEVICES];
+    I2CDevice *Devices[I2C_SIM_MAX_DEVICES];
+    int DeviceCount;
+    I2CDevice *Current;
+    int NackPeriod;
+    uint32_t Addressed;
+    uint32_t Transactions;
+    uint32_t Bytes;
+    uint64_t BusyUs;
+};
+
+#endif /* #ifndef __I2C_SIM_H__ */
@@ -0,0 +1,136 @@
+// MAG3110 Model: Register level model of the magnetometer for the host i2c simulator
+// Datasheet: https://www.nxp.com/docs/en/data-sheet/MAG3110.pdf
+#ifndef __MAG3110_MODEL_H__
+#define __MAG3110_MODEL_H__
+#include <stdint.h>
+#include <math.h>
+#include "I2CSim.h"
+#include "SensorWaveform.h"
+
+// Registers of the model, the same numbers as the part
+const uint8_t MAG3110_MODEL_DR_STATUS = 0x00;
+const uint8_t MAG3110_MODEL_OUT_Z_LSB = 0x06;
+const uint8_t MAG3110_MODEL_WHO_AM_I  = 0x07;
+const uint8_t MAG3110_MODEL_SYSMOD    = 0x08;
+const uint8_t MAG3110_MODEL_CTRL_REG1 = 0x10;
+const uint8_t MAG3110_MODEL_CTRL_REG2 = 0x11;
+
+// DR_STATUS bits, ZYXDR is set by every new sample and ZYXOW if the last one was never read
+const uint8_t MAG3110_MODEL_ZYXDR = 0x08;
+const uint8_t MAG3110_MODEL_ZYXOW = 0x80;
+
+///MAG3110Model///
+// What the model covers
+// - WHO_AM_I, the data rate, oversampling and active bits of CTRL_REG1
+// - A new sample every 12.5ms << (DR + OS) of HostClock while active, taken from X, Y and Z
+// - DR_STATUS data ready and overwrite flags, cleared once OUT_Z_LSB has been read
+// - The INT1 pin, high while a sample is waiting to be read
+// - The register pointer auto increments, past OUT_Z_LSB it carries on to WHO_AM_I
+// Every other register just holds what was last written to it
+class MAG3110Model : public I2CDevice {
+public:
+    MAG3110Model() :
+        Pointer(0), LastSampleUs(0)
+    {
+        for (int i = 0; i < 0x12; i++) {
+            Registers[i] = 0;
+        }
+        Registers[MAG3110_MODEL_WHO_AM_I] = 0xc4;
+    }
+
+    // What each axis measures in uT
+    SensorWaveform X;
+    SensorWaveform Y;
+    SensorWaveform Z;
+
+    void start(uint8_t Register)
+    {
+        update();
+        Pointer = Register;
+    }
+
+    void write(uint8_t Value)
+    {
+        update();
+        if (Pointer < 0x12) {
+            if ((Pointer == MAG3110_MODEL_CTRL_REG1) && (Value & 1) && !(Registers[Pointer] & 1)) {
+                // Going active, the first sample lands one period from now
+                LastSampleUs = HostClock::now();
+            }
+            Registers[Pointer] = Value;
+        }
+        Pointer++;
+    }
+
+    uint8_t read()
+    {
+        update();
+        uint8_t Value = (Pointer < 0x12) ? Registers[Pointer] : 0;
+        if (Pointer == MAG3110_MODEL_OUT_Z_LSB) {
+            Registers[MAG3110_MODEL_DR_STATUS] = 0;
+        }
+        Pointer++;
+        return Value;
+    }
+
+    // Level of the INT1 pin, high while a sample is waiting
+    bool int1() {
+        update();
+        return Registers[MAG3110_MODEL_DR_STATUS] & MAG3110_MODEL_ZYXDR;
+    }
+
+    // Time between samples at the data rate and oversampling in CTRL_REG1
+    uint32_t periodUs() const {
+        uint8_t Ctrl = Registers[MAG3110_MODEL_CTRL_REG1];
+        return 12500UL << (((Ctrl >> 5) & 7) + ((Ctrl >> 3) & 3));
+    }
+
+    /// update ///
+    // Takes any samples that have come due since the last call
+    void update()
+    {
+        bool Active = Registers[MAG3110_MODEL_CTRL_REG1] & 1;
+        Registers[MAG3110_MODEL_SYSMOD] = Active ? 1 : 0;
+        if (!Active) {
+            return;
+        }
+        uint64_t Now = HostClock::now();
+        while ((Now - LastSampleUs) >= periodUs()) {
+            LastSampleUs += periodUs();
+            sample(LastSampleUs);
+        }
+    }
+
+private:
+    // Latches a new sample into OUT_X_MSB to OUT_Z_LSB, 0.1uT per count, MSB first
+    void sample(uint64_t Us)
+    {
+        put(1, X.at(Us) * 10);
+        put(3, Y.at(Us) * 10);
+        put(5, Z.at(Us) * 10);
+        if (Registers[MAG3110_MODEL_DR_STATUS] & MAG3110_MODEL_ZYXDR) {
+            Registers[MAG3110_MODEL_DR_STATUS] |= MAG3110_MODEL_ZYXOW;
+        }
+        Registers[MAG3110_MODEL_DR_STATUS] |= MAG3110_MODEL_ZYXDR | 0x07;
+    }
+
+    // The part reads +-1000uT, clamps to +-30000 counts
+    void put(int Register, double Counts)
+    {
+        long Value = lround(Counts);
+        if (Value > 30000) {
+            Value = 30000;
+        } else if (Value < -30000) {
+            Value = -30000;
+        }
+        uint16_t Raw = (uint16_t)Value;
+        Registers[Register]     = Raw >> 8;
+        Registers[Register + 1] = Raw & 0xff;
+    }
+
+    uint8_t Registers[0x12];
+    uint8_t Pointer;
+    uint64_t LastSampleUs;
+};
+
+#endif /* #ifndef __MAG3110_MODEL_H__ */
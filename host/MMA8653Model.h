@@ -0,0 +1,153 @@
+// MMA8653 Model: Register level model of the accelerometer for the host i2c simulator
+// Datasheet: https://www.nxp.com/docs/en/data-sheet/MMA8653FC.pdf
+#ifndef __MMA8653_MODEL_H__
+#define __MMA8653_MODEL_H__
+#include <stdint.h>
+#include <math.h>
+#include "I2CSim.h"
+#include "SensorWaveform.h"
+
+// Registers of the model, the same numbers as the part
+const uint8_t MMA8653_MODEL_STATUS       = 0x00;
+const uint8_t MMA8653_MODEL_OUT_Z_LSB    = 0x06;
+const uint8_t MMA8653_MODEL_SYSMOD       = 0x0b;
+const uint8_t MMA8653_MODEL_INT_SOURCE   = 0x0c;
+const uint8_t MMA8653_MODEL_WHO_AM_I     = 0x0d;
+const uint8_t MMA8653_MODEL_XYZ_DATA_CFG = 0x0e;
+const uint8_t MMA8653_MODEL_CTRL_REG1    = 0x2a;
+const uint8_t MMA8653_MODEL_CTRL_REG4    = 0x2d;
+const uint8_t MMA8653_MODEL_CTRL_REG5    = 0x2e;
+
+// STATUS bits, ZYXDR is set by every new sample and ZYXOW if the last one was never read
+const uint8_t MMA8653_MODEL_ZYXDR = 0x08;
+const uint8_t MMA8653_MODEL_ZYXOW = 0x80;
+
+///MMA8653Model///
+// What the model covers
+// - WHO_AM_I, the output data rate, range and active bits of CTRL_REG1 and XYZ_DATA_CFG
+// - A new sample every output data period of HostClock while active, taken from X, Y and Z
+// - STATUS data ready and overwrite flags, cleared once OUT_Z_LSB has been read
+// - The data ready interrupt of CTRL_REG4/5 on the INT1 or INT2 pin, active low as on the micro:bit
+// - The register pointer auto increments, a read past OUT_Z_LSB wraps back to STATUS
+// Every other register just holds what was last written to it
+class MMA8653Model : public I2CDevice {
+public:
+    MMA8653Model() :
+        Pointer(0), LastSampleUs(0)
+    {
+        for (int i = 0; i < 0x40; i++) {
+            Registers[i] = 0;
+        }
+        Registers[MMA8653_MODEL_WHO_AM_I] = 0x5a;
+    }
+
+    // What each axis measures in g
+    SensorWaveform X;
+    SensorWaveform Y;
+    SensorWaveform Z;
+
+    void start(uint8_t Register)
+    {
+        update();
+        Pointer = Register & 0x3f;
+    }
+
+    void write(uint8_t Value)
+    {
+        update();
+        if ((Pointer == MMA8653_MODEL_CTRL_REG1) && (Value & 1) && !(Registers[Pointer] & 1)) {
+            // Going active, the first sample lands one period from now
+            LastSampleUs = HostClock::now();
+        }
+        Registers[Pointer] = Value;
+        Pointer = (Pointer + 1) & 0x3f;
+    }
+
+    uint8_t read()
+    {
+        update();
+        uint8_t Value = Registers[Pointer];
+        if (Pointer == MMA8653_MODEL_OUT_Z_LSB) {
+            Registers[MMA8653_MODEL_STATUS] = 0;
+            Registers[MMA8653_MODEL_INT_SOURCE] &= ~1;
+            Pointer = MMA8653_MODEL_STATUS;
+        } else {
+            Pointer = (Pointer + 1) & 0x3f;
+        }
+        return Value;
+    }
+
+    // Level of the INT1 and INT2 pins, high when no interrupt is asserted
+    bool int1() {
+        return !dataReadyInterrupt(true);
+    }
+    bool int2() {
+        return !dataReadyInterrupt(false);
+    }
+
+    // Time between samples at the data rate in CTRL_REG1
+    uint32_t periodUs() const {
+        static const uint32_t Periods[8] = {1250, 2500, 5000, 10000, 20000, 80000, 160000, 640000};
+        return Periods[(Registers[MMA8653_MODEL_CTRL_REG1] >> 3) & 7];
+    }
+
+    /// update ///
+    // Takes any samples that have come due since the last call
+    void update()
+    {
+        bool Active = Registers[MMA8653_MODEL_CTRL_REG1] & 1;
+        Registers[MMA8653_MODEL_SYSMOD] = Active ? 1 : 0;
+        if (!Active) {
+            return;
+        }
+        uint64_t Now = HostClock::now();
+        while ((Now - LastSampleUs) >= periodUs()) {
+            LastSampleUs += periodUs();
+            sample(LastSampleUs);
+        }
+    }
+
+private:
+    // Latches a new sample into OUT_X_MSB to OUT_Z_LSB, left justified 10 bit counts
+    void sample(uint64_t Us)
+    {
+        double CountsPerG = 256 >> (Registers[MMA8653_MODEL_XYZ_DATA_CFG] & 3);
+        put(1, X.at(Us) * CountsPerG);
+        put(3, Y.at(Us) * CountsPerG);
+        put(5, Z.at(Us) * CountsPerG);
+        if (Registers[MMA8653_MODEL_STATUS] & MMA8653_MODEL_ZYXDR) {
+            Registers[MMA8653_MODEL_STATUS] |= MMA8653_MODEL_ZYXOW;
+        }
+        Registers[MMA8653_MODEL_STATUS] |= MMA8653_MODEL_ZYXDR | 0x07;
+        Registers[MMA8653_MODEL_INT_SOURCE] |= 1;
+    }
+
+    // Clamps to the 10 bit range and stores the count MSB first with the 2 low bits at the top of the LSB
+    void put(int Register, double Counts)
+    {
+        long Value = lround(Counts);
+        if (Value > 511) {
+            Value = 511;
+        } else if (Value < -512) {
+            Value = -512;
+        }
+        uint16_t Justified = (uint16_t)(Value << 6);
+        Registers[Register]     = Justified >> 8;
+        Registers[Register + 1] = Justified & 0xc0;
+    }
+
+    // True if the data ready interrupt is enabled, pending and routed to INT1 (or INT2)
+    bool dataReadyInterrupt(bool Int1)
+    {
+        update();
+        bool Enabled = Registers[MMA8653_MODEL_CTRL_REG4] & 1;
+        bool ToInt1  = Registers[MMA8653_MODEL_CTRL_REG5] & 1;
+        return Enabled && (ToInt1 == Int1) && (Registers[MMA8653_MODEL_INT_SOURCE] & 1);
+    }
+
+    uint8_t Registers[0x40];
+    uint8_t Pointer;
+    uint64_t LastSampleUs;
+};
+
+#endif /* #ifndef __MMA8653_MODEL_H__ */
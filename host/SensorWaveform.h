@@ -0,0 +1,42 @@
+// Sensor Waveform: What a simulated sensor axis measures over time
+#ifndef __SENSOR_WAVEFORM_H__
+#define __SENSOR_WAVEFORM_H__
+#include <stdint.h>
+#include <math.h>
+
+///SensorWaveform///
+// Offset + Amplitude * sin(2 pi FrequencyHz t) + Step after StepAtUs + uniform noise of +-Noise
+// The units are whatever the sensor model expects, g for the MMA8653 and uT for the MAG3110
+// The noise comes from a fixed seed so every run of a test or benchmark sees the same samples
+struct SensorWaveform {
+    double Offset;
+    double Amplitude;
+    double FrequencyHz;
+    double Step;
+    uint64_t StepAtUs;
+    double Noise;
+    uint32_t Seed;
+
+    SensorWaveform(double _Offset = 0, double _Amplitude = 0, double _FrequencyHz = 0, double _Noise = 0) :
+        Offset(_Offset), Amplitude(_Amplitude), FrequencyHz(_FrequencyHz), Step(0), StepAtUs(0), Noise(_Noise), Seed(12345)
+    {
+    }
+
+    /// at ///
+    // The value at time Us microseconds
+    double at(uint64_t Us)
+    {
+        double Seconds = Us / 1000000.0;
+        double Value = Offset + Amplitude * sin(2 * M_PI * FrequencyHz * Seconds);
+        if ((Step != 0) && (Us >= StepAtUs)) {
+            Value += Step;
+        }
+        if (Noise != 0) {
+            Seed = Seed * 1664525 + 1013904223;
+            Value += Noise * ((Seed >> 8) / 8388608.0 - 1.0);
+        }
+        return Value;
+    }
+};
+
+#endif /* #ifndef __SENSOR_WAVEFORM_H__ */
@@ -0,0 +1,331 @@
+// Codec Test: Round trips samples through SampleCodec.h, SampleBatch.h and BatchQueue.h on a PC
+// Build from the top of the repository, host comes first so its mbed.h is used
+//   g++ -std=gnu++14 -O2 -Ihost -I. host/codec_test.cpp -o codec_test
+// Usage
+//   ./codec_test
+// Prints one line per check and exits with 1 if any of them failed
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <mbed.h>
+#include "SensorFrame.h"
+#include "SampleCodec.h"
+#include "SampleBatch.h"
+#include "BatchQueue.h"
+
+// More frames than a 20 byte batch can hold, so DecodeSampleBatch() never runs out of room
+const int TEST_MAX_FRAMES = 8;
+
+int Failures = 0;
+
+void check(bool Passed, const char *What)
+{
+    printf("%s %s\n", Passed ? "pass" : "FAIL", What);
+    if (!Passed) {
+        Failures++;
+    }
+}
+
+bool sameFrame(const SensorFrame &A, const SensorFrame &B)
+{
+    return (A.X == B.X) && (A.Y == B.Y) && (A.Z == B.Z);
+}
+
+SensorSample sample(int16_t X, int16_t Y, int16_t Z, uint32_t TimestampUs)
+{
+    SensorSample Sample;
+    Sample.Frame.X = X;
+    Sample.Frame.Y = Y;
+    Sample.Frame.Z = Z;
+    Sample.Timestamp = TimestampUs;
+    return Sample;
+}
+
+///roundTrip///
+// Packs Count samples into as many batches of Encoding as they need, the way BatchQueue::flush() does,
+// and checks every batch decodes back to exactly the samples that went into it
+// Returns the number of batches, or -1 if one of them did not fit or did not decode
+int roundTrip(const SensorSample *Samples, int Count, uint16_t Encoding)
+{
+    SampleBatch Batch;
+    Batch.setEncoding(Encoding);
+    int Batches = 0;
+    int First = 0;
+    int i = 0;
+    while (i <= Count) {
+        if ((i < Count) && Batch.append(Samples[i])) {
+            i++;
+            continue;
+        }
+        if (Batch.empty()) {
+            return -1;
+        }
+        // The batch is full, or the next sample did not fit, or there are no samples left
+        SensorFrame Frames[TEST_MAX_FRAMES];
+        uint16_t TimestampMs = 0;
+        int Decoded = DecodeSampleBatch(Batch.data(), Batch.length(), Frames, TEST_MAX_FRAMES, TimestampMs);
+        if ((Batch.length() > SAMPLE_BATCH_MAX_LENGTH) || (Decoded != (i - First)) ||
+            (TimestampMs != ((Samples[First].Timestamp / 1000) & SAMPLE_CODEC_TIMESTAMP_MASK))) {
+            return -1;
+        }
+        for (int f = 0; f < Decoded; f++) {
+            if (!sameFrame(Frames[f], Samples[First + f].Frame)) {
+                return -1;
+            }
+        }
+        Batches++;
+        Batch.clear();
+        First = i;
+        if (i == Count) {
+            break;
+        }
+    }
+    return Batches;
+}
+
+// Decodes Data and returns what DecodeSampleBatch() did
+int decode(const uint8_t *Data, uint16_t Length)
+{
+    SensorFrame Frames[TEST_MAX_FRAMES];
+    uint16_t TimestampMs;
+    return DecodeSampleBatch(Data, Length, Frames, TEST_MAX_FRAMES, TimestampMs);
+}
+
+void testZigZagAndVarints()
+{
+    bool Passed = true;
+    for (uint32_t v = 0; v <= 0xffff; v++) {
+        int16_t Value = (int16_t)(uint16_t)v;
+        uint16_t Folded = ZigZag(Value);
+        uint8_t Bytes[4];
+        uint16_t Length = PutVarint(Bytes, Folded);
+        uint16_t Back = 0;
+        if ((UnZigZag(Folded) != Value) || (Length != VarintLength(Folded)) ||
+            (GetVarint(Bytes, Length, Back) != Length) || (Back != Folded)) {
+            Passed = false;
+        }
+    }
+    check(Passed, "zigzag and varint round trip every 16 bit value");
+    check((ZigZag(0) == 0) && (ZigZag(-1) == 1) && (ZigZag(1) == 2) && (ZigZag(-32768) == 0xffff),
+          "zigzag puts small magnitudes first");
+}
+
+void testExtremeDeltas()
+{
+    // Every axis swings across the whole int16 range, the differences wrap modulo 2^16 so a swing
+    // from -32768 to 32767 is a difference of -1 and takes one byte
+    SensorSample Samples[12];
+    for (int i = 0; i < 12; i++) {
+        int16_t High = 32767;
+        int16_t Low  = -32768;
+        Samples[i] = sample((i & 1) ? High : Low, (i & 1) ? Low : High, (i % 3) ? High : Low, 1000 * i);
+    }
+    check(DeltaLength(Samples[0].Frame, Samples[1].Frame) == SAMPLE_CODEC_MIN_DELTA_LENGTH,
+          "a -32768 to 32767 swing wraps to the shortest delta");
+    check(roundTrip(Samples, 12, SAMPLE_CODEC_DELTA) == 3, "delta batches of -32768 to 32767 swings decode exactly");
+
+    // Half the range away is the largest difference there is, -32768, and takes the longest delta
+    SensorFrame Zero = {0, 0, 0};
+    SensorFrame Half = {-32768, -32768, -32768};
+    check(DeltaLength(Zero, Half) == SAMPLE_CODEC_MAX_DELTA_LENGTH, "a difference of -32768 takes the longest delta");
+    SensorSample Halves[12];
+    for (int i = 0; i < 12; i++) {
+        Halves[i] = sample((i & 1) ? -32768 : 0, (i & 1) ? 0 : -32768, (i & 2) ? 32767 : -1, 1000 * i);
+    }
+    check(roundTrip(Halves, 12, SAMPLE_CODEC_DELTA) == 6, "delta batches of -32768 differences decode exactly");
+    check(roundTrip(Samples, 12, SAMPLE_CODEC_RAW) == 4, "raw batches of -32768 to 32767 swings decode exactly");
+
+    // A mix of small steps and full swings
+    SensorSample Mixed[40];
+    int16_t X = 0;
+    for (int i = 0; i < 40; i++) {
+        X = (i % 7 == 3) ? (int16_t)(X ^ 0x8000) : (int16_t)(X + (i & 3) - 1);
+        Mixed[i] = sample(X, (int16_t)(-X), (int16_t)(i * 1000), 1000 * i);
+    }
+    check(roundTrip(Mixed, 40, SAMPLE_CODEC_DELTA) > 0, "delta batches of small steps and full swings decode exactly");
+}
+
+void testBatchBoundaries()
+{
+    // Header and raw first sample take 8 bytes, three one byte per axis deltas bring it to 17,
+    // there is still room for a 3 byte delta but not for a 9 byte one
+    SampleBatch Batch;
+    Batch.setEncoding(SAMPLE_CODEC_DELTA);
+    bool Appended = Batch.append(sample(0, 0, 0, 0));
+    for (int i = 1; i <= 3; i++) {
+        Appended = Appended && Batch.append(sample(i, i, i, 1000 * i));
+    }
+    check(Appended && (Batch.length() == 17) && !Batch.full(), "three small deltas leave room for one more");
+    check(!Batch.append(sample(-32768, -32768, -32768, 4000)), "a 9 byte delta is refused with 3 bytes left");
+    check(Batch.length() == 17, "a refused delta leaves the batch alone");
+    check(Batch.append(sample(4, 4, 4, 4000)) && (Batch.length() == 20) && Batch.full(),
+          "a 3 byte delta still fills the last 3 bytes");
+    check(decode(Batch.data(), Batch.length()) == 5, "the full batch decodes to 5 samples");
+
+    // The refused sample must start the next batch raw and decode exactly
+    SensorSample Samples[5];
+    for (int i = 0; i < 4; i++) {
+        Samples[i] = sample(i, i, i, 1000 * i);
+    }
+    Samples[4] = sample(-32768, 32767, -32768, 4000);
+    check(roundTrip(Samples, 5, SAMPLE_CODEC_DELTA) == 2, "the sample that did not fit starts the next batch");
+
+    // One delta of 9 bytes and nothing else after the first sample, 17 bytes, a second one never fits
+    SensorSample Swings[3] = {sample(0, 0, 0, 0), sample(-32768, -32768, -32768, 1000), sample(0, 0, 0, 2000)};
+    check(roundTrip(Swings, 3, SAMPLE_CODEC_DELTA) == 2, "two 9 byte deltas never share a batch");
+
+    // Raw batches hold 3 samples exactly
+    SampleBatch Raw;
+    bool RawAppended = Raw.append(sample(1, 2, 3, 0)) && Raw.append(sample(4, 5, 6, 1000)) && Raw.append(sample(7, 8, 9, 2000));
+    check(RawAppended && Raw.full() && (Raw.length() == 20) && !Raw.append(sample(0, 0, 0, 3000)),
+          "a raw batch is full after 3 samples");
+}
+
+void testMalformedPayloads()
+{
+    // A good delta batch to cut up, header, raw sample and two deltas of 1 and 3 bytes per axis
+    SampleBatch Batch;
+    Batch.setEncoding(SAMPLE_CODEC_DELTA);
+    Batch.append(sample(0, 0, 0, 0));
+    Batch.append(sample(1, -1, 1, 1000));
+    Batch.append(sample(20000, -20000, 20000, 2000));
+    uint8_t Data[SAMPLE_BATCH_MAX_LENGTH];
+    uint16_t Length = Batch.length();
+    memcpy(Data, Batch.data(), Length);
+    check(decode(Data, Length) == 3, "the batch to cut up decodes");
+
+    // Cutting it anywhere but between two samples leaves half a sample
+    const int ENDS = 3;
+    const uint16_t Ends[ENDS] = {2 + 6, 2 + 6 + 3, 2 + 6 + 3 + 9};
+    bool Passed = true;
+    for (uint16_t Cut = 0; Cut < Length; Cut++) {
+        int Expected = -1;
+        if (Cut == 2) {
+            Expected = 0;
+        }
+        for (int e = 0; e < ENDS; e++) {
+            if (Cut == Ends[e]) {
+                Expected = e + 1;
+            }
+        }
+        if (decode(Data, Cut) != Expected) {
+            printf("     cut at %u decoded to %d not %d\n", Cut, decode(Data, Cut), Expected);
+            Passed = false;
+        }
+    }
+    check(Passed && (Ends[ENDS - 1] == Length), "a truncated delta batch is an error unless cut between samples");
+
+    SampleBatch Raw;
+    Raw.append(sample(1, 2, 3, 0));
+    Raw.append(sample(4, 5, 6, 1000));
+    Passed = true;
+    for (uint16_t Cut = 0; Cut < Raw.length(); Cut++) {
+        int Expected = (Cut < 2) ? -1 : (((Cut - 2) % SAMPLE_CODEC_RAW_LENGTH) ? -1 : ((Cut - 2) / SAMPLE_CODEC_RAW_LENGTH));
+        if (decode(Raw.data(), Cut) != Expected) {
+            Passed = false;
+        }
+    }
+    check(Passed, "a truncated raw batch is an error unless cut between samples");
+
+    // The last varint says another byte follows but the payload ends
+    uint8_t Corrupt[SAMPLE_BATCH_MAX_LENGTH];
+    memcpy(Corrupt, Data, Length);
+    Corrupt[Length - 1] |= 0x80;
+    check(decode(Corrupt, Length) == -1, "a varint running off the end is an error");
+
+    // Four varint bytes, longer than any 16 bit value
+    const uint8_t Long[] = {0x00, 0x40, 0, 0, 0, 0, 0, 0, 0x80, 0x80, 0x80, 0x01, 0x00, 0x00};
+    check(decode(Long, sizeof(Long)) == -1, "a varint longer than 3 bytes is an error");
+
+    // Three varint bytes holding more than 16 bits
+    const uint8_t Wide[] = {0x00, 0x40, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0x7f, 0x00, 0x00};
+    check(decode(Wide, sizeof(Wide)) == -1, "a varint over 16 bits is an error");
+
+    // Encodings 2 and 3 are not defined, even a batch holding just the raw first sample is refused
+    uint8_t Unknown[SAMPLE_BATCH_MAX_LENGTH];
+    memcpy(Unknown, Data, Length);
+    bool Refused = true;
+    for (uint16_t Encoding = SAMPLE_CODEC_COUNT; Encoding < 4; Encoding++) {
+        Unknown[1] = (uint8_t)((Data[1] & 0x3f) | (Encoding << (SAMPLE_CODEC_ENCODING_SHIFT - 8)));
+        Refused = Refused && (decode(Unknown, Length) == -1) && (decode(Unknown, 2 + SAMPLE_CODEC_RAW_LENGTH) == -1);
+    }
+    check(Refused, "an unknown encoding is an error");
+
+    // More frames than the caller has room for
+    SensorFrame Frames[2];
+    uint16_t TimestampMs;
+    check(DecodeSampleBatch(Data, Length, Frames, 2, TimestampMs) == -1, "a batch larger than MaxFrames is an error");
+}
+
+// Batches handed to linkSend() and whether the link takes them
+const int TEST_MAX_SENT = 16;
+SensorFrame Sent[TEST_MAX_SENT][TEST_MAX_FRAMES];
+int SentFrames[TEST_MAX_SENT];
+int SentCount = 0;
+bool LinkFree = false;
+
+// The Send callback of BatchQueue::flush(), keeps what each batch decodes to while the link is free
+bool linkSend(const SampleBatch &Batch)
+{
+    if (!LinkFree) {
+        return false;
+    }
+    if (SentCount < TEST_MAX_SENT) {
+        uint16_t TimestampMs;
+        SentFrames[SentCount] = DecodeSampleBatch(Batch.data(), Batch.length(), Sent[SentCount], TEST_MAX_FRAMES, TimestampMs);
+        SentCount++;
+    }
+    return true;
+}
+
+void testDropInBatch()
+{
+    // Sample i has every axis at i, each delta is 3 bytes so a full batch holds samples n to n + 4
+    BatchQueue Queue;
+    Queue.setEncoding(SAMPLE_CODEC_DELTA);
+    Callback<bool(const SampleBatch &)> Send(linkSend);
+
+    // The link is busy, samples 0 and 1 go into the batch and 2 to 17 fill the queue, 18 and 19 are dropped
+    for (int i = 0; i < 2; i++) {
+        Queue.add(sample(i, i, i, 1000 * i));
+    }
+    Queue.flush(2000, Send);
+    int Queued = 0;
+    for (int i = 2; i < 20; i++) {
+        Queued += Queue.add(sample(i, i, i, 1000 * i)) ? 1 : 0;
+    }
+    check((Queued == (int)BATCH_QUEUE_LENGTH) && (Queue.dropped() == 2), "a full queue drops the newest samples");
+
+    // The link comes back, the full batches go and 15 to 17 are left part filled in the batch
+    LinkFree = true;
+    Queue.flush(20000, Send);
+    bool Filling = (SentCount == 3);
+
+    // 20 follows the gap, it must not join 15 to 17
+    Queue.add(sample(20, 20, 20, 20000));
+    Queue.flush(21000, Send);
+    Queue.flush(21000 + SAMPLE_BATCH_MAX_LATENCY_US, Send);
+
+    // 0 to 4, 5 to 9, 10 to 14, then 15 to 17 sent short at the drop and 20 on its own
+    const int Firsts[] = {0, 5, 10, 15, 20};
+    const int Counts[] = {5, 5, 5, 3, 1};
+    bool Passed = Filling && (SentCount == 5);
+    for (int b = 0; Passed && (b < 5); b++) {
+        Passed = (SentFrames[b] == Counts[b]);
+        for (int f = 0; Passed && (f < Counts[b]); f++) {
+            Passed = (Sent[b][f].X == (Firsts[b] + f));
+        }
+    }
+    check(Passed, "a drop closes the batch and the next sample starts another");
+}
+
+int main()
+{
+    testZigZagAndVarints();
+    testExtremeDeltas();
+    testBatchBoundaries();
+    testMalformedPayloads();
+    testDropInBatch();
+    printf("%d failed\n", Failures);
+    return (Failures == 0) ? 0 : 1;
+}
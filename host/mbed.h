@@ -0,0 +1,66 @@
+// Host mbed: The few parts of mbed the sensor headers use, so they build with the PC compiler
+// Put this directory first on the include path (-Ihost) and #include <mbed.h> picks this up
+// Only what I2CQueue.h and the sample pipeline need is here, the bluetooth services are not covered
+#ifndef __HOST_MBED_H__
+#define __HOST_MBED_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <functional>
+#include "I2CSim.h"
+
+// There is no asynchronous i2c on the host, I2CQueue::process() runs the transactions
+#define DEVICE_I2C_ASYNCH 0
+
+// The simulated time in microseconds, wraps like the real ticker
+inline uint32_t us_ticker_read()
+{
+    return (uint32_t)HostClock::now();
+}
+
+// A single thread has nothing to lock out
+inline void core_util_critical_section_enter() {}
+inline void core_util_critical_section_exit() {}
+
+///Callback///
+// Just enough of mbed's Callback for the i2c completion callbacks
+template <typename F>
+class Callback;
+
+template <typename R, typename A>
+class Callback<R(A)> {
+public:
+    Callback() {}
+
+    template <typename T>
+    Callback(T *Object, R (T::*Method)(A)) :
+        Function([Object, Method](A Argument) { return (Object->*Method)(Argument); })
+    {
+    }
+
+    Callback(R (*Free)(A)) :
+        Function(Free)
+    {
+    }
+
+    R operator()(A Argument) const {
+        return Function(Argument);
+    }
+
+    explicit operator bool() const {
+        return (bool)Function;
+    }
+
+private:
+    std::function<R(A)> Function;
+};
+
+typedef Callback<void(int)> event_callback_t;
+
+template <typename T, typename R, typename A>
+Callback<R(A)> callback(T *Object, R (T::*Method)(A))
+{
+    return Callback<R(A)>(Object, Method);
+}
+
+#endif /* #ifndef __HOST_MBED_H__ */
@@ -0,0 +1,237 @@
+// Sensor Bench: Runs the sensor acquisition, filter and batch pipeline against the simulated
+// MMA8653 and MAG3110 on a PC, for checking the pipeline and timing it off the micro:bit
+// Build from the top of the repository, host comes first so its mbed.h is used
+//   g++ -std=gnu++14 -O2 -Ihost -I. host/sensor_bench.cpp -o sensor_bench
+// Usage
+//   ./sensor_bench [seconds] [filter] [encoding] [nack] [busy]
+//   seconds  - Simulated time to run for, 60 by default
+//   filter   - SensorFilter kind applied to both sensors, 0 to 3, 0 by default
+//   encoding - SampleBatch encoding, 0 raw or 1 delta, 0 by default
+//   nack     - Every nack'th address byte is not acknowledged, 0 by default for never
+//   busy     - 1 to have every batch notification fail as on a link that never has a free buffer, 0 by default
+// Exits with 1 if a batch does not decode back to the samples that went in, or if a sample read never
+// reached the raw stream hook
+#include <mbed.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <chrono>
+#include "I2CQueue.h"
+#include "SensorFrame.h"
+#include "SampleRing.h"
+#include "SensorFilter.h"
+#include "SampleBatch.h"
+#include "BatchQueue.h"
+#include "SensorRegisters.h"
+#include "MMA8653Model.h"
+#include "MAG3110Model.h"
+
+I2C i2c;
+I2CQueue i2cQueue(i2c);
+
+// Filtered samples queued for the batches and not yet seen in a sent one, more than BatchQueue holds
+const uint32_t BENCH_EXPECTED_LENGTH = 64;
+
+///SensorPipeline///
+// The part of a sensor service between its data ready pin and the batch characteristic
+// A read is queued when the pin says a sample is waiting, the decoded sample goes through the ring,
+// the raw stream hook, the filter and the BatchQueue just as in publish(), a batch that is sent counts
+// as one notification. With Busy set no batch is ever sent, as on a link that never has a free buffer
+class SensorPipeline {
+public:
+    SensorPipeline(int _Address, SensorFrame (*_Decode)(const char *)) :
+        Busy(false), Reads(0), Hooked(0), Samples(0), Notifications(0), NotifiedBytes(0), Mismatches(0),
+        Address(_Address), Decode(_Decode), ReadPending(false), ExpectedHead(0), ExpectedTail(0)
+    {
+    }
+
+    void poll()
+    {
+        if (ReadPending) {
+            return;
+        }
+        ReadPending = true;
+        Timestamp = us_ticker_read();
+        if (!i2cQueue.Read(Address, SENSOR_FRAME_FIRST_REGISTER, FrameData, SENSOR_FRAME_LENGTH, callback(this, &SensorPipeline::onFrameRead))) {
+            ReadPending = false;
+        }
+    }
+
+    void publish()
+    {
+        SensorSample Sample;
+        while (Ring.pop(Sample)) {
+            // Where the services call their sample hook
+            Hooked++;
+            if (!Filter.process(Sample.Frame, Sample.Frame)) {
+                continue;
+            }
+            if (Batches.add(Sample)) {
+                Expected[ExpectedHead++ % BENCH_EXPECTED_LENGTH] = Sample.Frame;
+            }
+        }
+        Batches.flush(us_ticker_read(), callback(this, &SensorPipeline::send));
+    }
+
+    SensorFilter Filter;
+    BatchQueue Batches;
+    bool Busy;
+    uint32_t Reads;
+    uint32_t Hooked;
+    uint32_t Samples;
+    uint32_t Notifications;
+    uint32_t NotifiedBytes;
+    uint32_t Mismatches;
+
+    uint32_t overruns() const {
+        return Ring.overruns();
+    }
+
+private:
+    void onFrameRead(int Status)
+    {
+        ReadPending = false;
+        if (Status != 0) {
+            return;
+        }
+        SensorSample Sample;
+        Sample.Timestamp = Timestamp;
+        Sample.Frame     = Decode(FrameData);
+        Reads++;
+        Ring.push(Sample);
+    }
+
+    // Counts the notification and checks it decodes back to the next samples that were queued
+    bool send(const SampleBatch &Batch)
+    {
+        if (Busy) {
+            return false;
+        }
+        SensorFrame Decoded[SAMPLE_BATCH_MAX_LENGTH];
+        uint16_t TimestampMs;
+        int Count = DecodeSampleBatch(Batch.data(), Batch.length(), Decoded, SAMPLE_BATCH_MAX_LENGTH, TimestampMs);
+        if ((Count < 0) || ((uint32_t)Count > (ExpectedHead - ExpectedTail))) {
+            Mismatches++;
+            Count = 0;
+        }
+        for (int i = 0; i < Count; i++) {
+            const SensorFrame &Queued = Expected[ExpectedTail++ % BENCH_EXPECTED_LENGTH];
+            if ((Decoded[i].X != Queued.X) || (Decoded[i].Y != Queued.Y) || (Decoded[i].Z != Queued.Z)) {
+                Mismatches++;
+            }
+        }
+        Samples += Count;
+        Notifications++;
+        NotifiedBytes += Batch.length();
+        return true;
+    }
+
+    int Address;
+    SensorFrame (*Decode)(const char *);
+    char FrameData[SENSOR_FRAME_LENGTH];
+    uint32_t Timestamp;
+    bool ReadPending;
+    SampleRing<SensorSample, 16> Ring;
+    SensorFrame Expected[BENCH_EXPECTED_LENGTH];
+    uint32_t ExpectedHead;
+    uint32_t ExpectedTail;
+};
+
+// Stands in for the serial console of I2CStats::dump()
+struct Console {
+    void printf(const char *Format, ...)
+    {
+        va_list Args;
+        va_start(Args, Format);
+        vprintf(Format, Args);
+        va_end(Args);
+    }
+};
+
+void report(const char *Name, const SensorPipeline &Pipeline, double Seconds)
+{
+    printf("%-6s %7u samples %6.1f/s  %6u notifications %5.2f samples each  %6.1f bytes/s  %u overruns  %u mismatches\n",
+           Name, Pipeline.Samples, Pipeline.Samples / Seconds, Pipeline.Notifications,
+           Pipeline.Notifications ? (double)Pipeline.Samples / Pipeline.Notifications : 0.0,
+           Pipeline.NotifiedBytes / Seconds, Pipeline.overruns(), Pipeline.Mismatches);
+    printf("       %7u read %7u to the hook  %u left out of the batches\n",
+           Pipeline.Reads, Pipeline.Hooked, Pipeline.Batches.dropped());
+}
+
+int main(int argc, char **argv)
+{
+    double Seconds   = (argc > 1) ? atof(argv[1]) : 60;
+    uint8_t Filter   = (argc > 2) ? atoi(argv[2]) : SENSOR_FILTER_NONE;
+    uint16_t Encoding = (argc > 3) ? atoi(argv[3]) : SAMPLE_CODEC_RAW;
+    int NackPeriod    = (argc > 4) ? atoi(argv[4]) : 0;
+    bool Busy         = (argc > 5) && (atoi(argv[5]) != 0);
+
+    // The board lying flat and being tilted back and forth once a second, with a bit of noise
+    MMA8653Model Accel;
+    Accel.X = SensorWaveform(0, 0.5, 1, 0.01);
+    Accel.Y = SensorWaveform(0, 0, 0, 0.01);
+    Accel.Z = SensorWaveform(1, 0, 0, 0.01);
+    // The earth's field turning slowly as the board is rotated
+    MAG3110Model Mag;
+    Mag.X = SensorWaveform(-10, 30, 0.1, 0.2);
+    Mag.Y = SensorWaveform(5, 30, 0.1, 0.2);
+    Mag.Z = SensorWaveform(-40, 0, 0, 0.2);
+    i2c.attach(MMA8653_ADDRESS, Accel);
+    i2c.attach(MAG3110_ADDRESS, Mag);
+    i2c.nackEvery(NackPeriod);
+
+    // The data ready setup of EnableDataReadyInterrupt() through the same register writes as the services,
+    // 100Hz accelerometer and 80Hz magnetometer with motion wake off
+    SensorConfig AccelConfig = {};
+    AccelConfig.Rate   = 3;
+    AccelConfig.Active = 1;
+    SensorConfig MagConfig = {};
+    MagConfig.Active = 1;
+    MotionWake Motion;
+    WriteMMA8653Config(i2cQueue, AccelConfig, AccelConfig.Rate, true, Motion);
+    WriteMAG3110Reset(i2cQueue);
+    WriteMAG3110Config(i2cQueue, MagConfig, true);
+    i2cQueue.process();
+
+    SensorPipeline AccelPipeline(MMA8653_ADDRESS, DecodeMMA8653Frame);
+    SensorPipeline MagPipeline(MAG3110_ADDRESS, DecodeMAG3110Frame);
+    AccelPipeline.Filter.configure(Filter, 1);
+    MagPipeline.Filter.configure(Filter, 1);
+    AccelPipeline.Batches.setEncoding(Encoding);
+    MagPipeline.Batches.setEncoding(Encoding);
+    AccelPipeline.Busy = Busy;
+    MagPipeline.Busy   = Busy;
+
+    // The main loop wakes every millisecond of simulated time
+    uint64_t EndUs = HostClock::now() + (uint64_t)(Seconds * 1000000);
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+    while (HostClock::now() < EndUs) {
+        HostClock::advance(1000);
+        if (!Accel.int1()) {
+            AccelPipeline.poll();
+        }
+        if (Mag.int1()) {
+            MagPipeline.poll();
+        }
+        i2cQueue.process();
+        AccelPipeline.publish();
+        MagPipeline.publish();
+    }
+    double HostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    report("Accel", AccelPipeline, Seconds);
+    report("Mag", MagPipeline, Seconds);
+    printf("i2c    %u transactions %u bytes, bus busy %.1f%% of the time\n",
+           i2c.transactions(), i2c.bytes(), 100.0 * i2c.busyUs() / (Seconds * 1000000));
+    Console Out;
+    i2cQueue.Stats.dump(Out, us_ticker_read());
+    // With every batch refused (busy) no sample is ever counted, the time per sample read is shown instead
+    uint32_t Timed = AccelPipeline.Reads + MagPipeline.Reads;
+    printf("host   %.3f s for %.0f s simulated, %.0f ns per sample read\n",
+           HostSeconds, Seconds, Timed ? HostSeconds * 1e9 / Timed : 0.0);
+    // Every sample read must reach the hook whatever happened to the batches, bar the last one or two
+    // still in flight when the bench stopped
+    bool Lost = ((AccelPipeline.Reads - AccelPipeline.Hooked) > 1) || ((MagPipeline.Reads - MagPipeline.Hooked) > 1) ||
+                AccelPipeline.overruns() || MagPipeline.overruns();
+    return (AccelPipeline.Mismatches || MagPipeline.Mismatches || Lost) ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+// Stream Capture: Decodes the binary sample stream the micro:bit sends with SERIAL_OUTPUT_STREAM, see SerialStream.h
+// Every good packet is printed as a line of comma separated values, the totals go to stderr at the end
+// Build from the top of the repository
+//   g++ -std=gnu++14 -O2 host/stream_capture.cpp -o stream_capture
+// Usage
+//   ./stream_capture [port] [baud] > samples.csv
+//   port - Serial port of the micro:bit, /dev/ttyACM0 on Linux, standard input if left out (a saved capture)
+//   baud - 115200 by default, the SERIAL_STREAM_BAUD the firmware was built with
+// Stop it with Ctrl-C, the totals are still printed
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+// The packet and framing of SerialStream.h
+const int PACKET_LENGTH = 14;
+const int MAX_FRAME     = 64;
+const uint8_t TYPE_ACCEL = 1;
+const uint8_t TYPE_MAG   = 2;
+
+volatile sig_atomic_t Stop = 0;
+
+void onInterrupt(int)
+{
+    Stop = 1;
+}
+
+/// crc16 ///
+// CRC-16/CCITT, polynomial 0x1021 starting at 0xffff, the same as crc16_compute() in the Nordic SDK
+uint16_t crc16(const uint8_t *Data, int Length)
+{
+    uint16_t Crc = 0xffff;
+    for (int i = 0; i < Length; i++) {
+        Crc ^= (uint16_t)Data[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            Crc = (Crc & 0x8000) ? ((Crc << 1) ^ 0x1021) : (Crc << 1);
+        }
+    }
+    return Crc;
+}
+
+/// uncobs ///
+// Undoes the COBS encoding of a frame without its zero, returns the length of the packet or -1 if the frame is broken
+int uncobs(const uint8_t *In, int Length, uint8_t *Out)
+{
+    int Written = 0;
+    int i = 0;
+    while (i < Length) {
+        int Code = In[i++];
+        if ((Code == 0) || ((i + Code - 1) > Length)) {
+            return -1;
+        }
+        for (int j = 1; j < Code; j++) {
+            Out[Written++] = In[i++];
+        }
+        if ((Code < 0xff) && (i < Length)) {
+            Out[Written++] = 0;
+        }
+    }
+    return Written;
+}
+
+// Opens and sets up the serial port, raw 8N1 at Baud
+int openPort(const char *Path, int Baud)
+{
+    int Port = open(Path, O_RDONLY | O_NOCTTY);
+    if (Port < 0) {
+        perror(Path);
+        return -1;
+    }
+    struct termios Settings;
+    tcgetattr(Port, &Settings);
+    cfmakeraw(&Settings);
+    speed_t Speed;
+    switch (Baud) {
+    case 9600:   Speed = B9600;   break;
+    case 57600:  Speed = B57600;  break;
+    case 230400: Speed = B230400; break;
+    default:     Speed = B115200; break;
+    }
+    cfsetispeed(&Settings, Speed);
+    cfsetospeed(&Settings, Speed);
+    Settings.c_cc[VMIN]  = 1;
+    Settings.c_cc[VTIME] = 0;
+    tcsetattr(Port, TCSANOW, &Settings);
+    return Port;
+}
+
+uint16_t get16(const uint8_t *Data)
+{
+    return Data[0] | (Data[1] << 8);
+}
+
+uint32_t get32(const uint8_t *Data)
+{
+    return get16(Data) | ((uint32_t)get16(Data + 2) << 16);
+}
+
+int main(int argc, char **argv)
+{
+    int Port = 0;
+    if (argc > 1) {
+        Port = openPort(argv[1], (argc > 2) ? atoi(argv[2]) : 115200);
+        if (Port < 0) {
+            return 1;
+        }
+    }
+    signal(SIGINT, onInterrupt);
+
+    unsigned Packets[3] = {0, 0, 0};
+    unsigned Missing[3] = {0, 0, 0};
+    unsigned BadFrames = 0;
+    unsigned BadCrcs   = 0;
+    bool HaveSequence[3] = {false, false, false};
+    uint8_t NextSequence[3];
+    // Whatever comes before the first zero may be the end of a packet cut in half, it is not counted if it is broken
+    bool Synced = false;
+
+    uint8_t Frame[MAX_FRAME];
+    int FrameLength = 0;
+    bool Overlong = false;
+    uint8_t Chunk[256];
+    printf("sensor,sequence,timestamp_us,x,y,z\n");
+    while (!Stop) {
+        ssize_t Got = read(Port, Chunk, sizeof(Chunk));
+        if (Got <= 0) {
+            break;
+        }
+        for (ssize_t c = 0; c < Got; c++) {
+            if (Chunk[c] != 0) {
+                if (FrameLength < MAX_FRAME) {
+                    Frame[FrameLength++] = Chunk[c];
+                } else {
+                    Overlong = true;
+                }
+                continue;
+            }
+            // A zero ends the frame
+            uint8_t Packet[MAX_FRAME];
+            int Length = Overlong ? -1 : uncobs(Frame, FrameLength, Packet);
+            bool First = !Synced;
+            Synced = true;
+            FrameLength = 0;
+            Overlong = false;
+            if ((Length != PACKET_LENGTH) || (crc16(Packet, PACKET_LENGTH - 2) != get16(&Packet[PACKET_LENGTH - 2]))) {
+                if (!First && (Length == PACKET_LENGTH)) {
+                    BadCrcs++;
+                } else if (!First) {
+                    BadFrames++;
+                }
+                continue;
+            }
+            uint8_t Type = Packet[0];
+            if ((Type != TYPE_ACCEL) && (Type != TYPE_MAG)) {
+                BadFrames++;
+                continue;
+            }
+            uint8_t Sequence = Packet[1];
+            if (HaveSequence[Type]) {
+                Missing[Type] += (uint8_t)(Sequence - NextSequence[Type]);
+            }
+            HaveSequence[Type] = true;
+            NextSequence[Type] = Sequence + 1;
+            Packets[Type]++;
+            printf("%s,%u,%u,%d,%d,%d\n", (Type == TYPE_ACCEL) ? "accel" : "mag", Sequence, get32(&Packet[2]),
+                   (int16_t)get16(&Packet[6]), (int16_t)get16(&Packet[8]), (int16_t)get16(&Packet[10]));
+        }
+    }
+    fflush(stdout);
+    fprintf(stderr, "accel %u packets %u missing, mag %u packets %u missing, %u bad frames, %u bad crcs\n",
+            Packets[TYPE_ACCEL], Missing[TYPE_ACCEL], Packets[TYPE_MAG], Missing[TYPE_MAG], BadFrames, BadCrcs);
+    return 0;
+}
@@ -3,9 +3,19 @@
 #ifndef __BLE_MAG_SERVICE_H__
 #define __BLE_MAG_SERVICE_H__
 #include <mbed.h>
+#include "SensorFrame.h"
+#include "SampleRing.h"
+#include "BatchQueue.h"
+#include "SensorConfig.h"
+#include "SensorRegisters.h"
+#include "SensorFilter.h"
+#include "DeadbandPublisher.h"
+#include "SampleCache.h"
+#include "MagCalibration.h"
 
-// The standard i2c slave address for MAG3110 is 0x0e
-const int MAG3110_ADDRESS = (0x0e<<1);
+// Rate used in data ready mode, DR = 011 and OS = 00 gives an ODR of 10Hz 
+// The default of 80Hz would swamp the bus and the bluetooth link with samples 
+const uint8_t MAG3110_DATA_READY_RATE = 3;
 
 ///MAGService///
 // Contains all the functions and class variables associated with Magnetometer
@@ -22,19 +32,47 @@ public:
     // UUID X plane characteristic - 0x01
     // UUID Y plane characteristic - 0x02
     // UUID Z plane characteristic - 0x03
+    // UUID Batch characteristic   - 0x04, notifies several X, Y and Z samples at once, see SampleBatch.h 
+    // UUID Config characteristic  - 0x05, output data rate, oversampling, active, filter, deadband and encoding, see SensorConfig.h 
+    // UUID Calibration control    - 0x06, write a command to calibrate, read back the state, see MagCalibration.h 
+    // UUID Calibration values     - 0x07, int16 X, Y and Z offsets then uint16 X, Y and Z scales being applied 
     const static uint16_t MAG_X_CHARACTERISTIC_UUID = 0x1;
     const static uint16_t MAG_Y_CHARACTERISTIC_UUID = 0x2;
     const static uint16_t MAG_Z_CHARACTERISTIC_UUID = 0x3;
+    const static uint16_t MAG_BATCH_CHARACTERISTIC_UUID = 0x4;
+    const static uint16_t MAG_CONFIG_CHARACTERISTIC_UUID = 0x5;
+    const static uint16_t MAG_CALIBRATION_CONTROL_CHARACTERISTIC_UUID = 0x6;
+    const static uint16_t MAG_CALIBRATION_VALUES_CHARACTERISTIC_UUID = 0x7;
      
      //MAGService Constructor//
     // Will create the magnontometer service for bluetooth profile 
     // Assigns the UUID's decalred for magnontometer and Characteristics 
     // Wakes up the magnontometer by setting bit 7 in CNTRL_REG_2 and setting bit 0 in CNTRL_REG_A 
     MAGService(BLEDevice &_ble, int16_t initialValueForMAGCharacteristic) :
-        ble(_ble), MagX(MAG_X_CHARACTERISTIC_UUID, &initialValueForMAGCharacteristic),MagY(MAG_Y_CHARACTERISTIC_UUID, &initialValueForMAGCharacteristic),MagZ(MAG_Z_CHARACTERISTIC_UUID, &initialValueForMAGCharacteristic)
+        ble(_ble), MagX(MAG_X_CHARACTERISTIC_UUID, &initialValueForMAGCharacteristic),MagY(MAG_Y_CHARACTERISTIC_UUID, &initialValueForMAGCharacteristic),MagZ(MAG_Z_CHARACTERISTIC_UUID, &initialValueForMAGCharacteristic),
+        MagBatch(MAG_BATCH_CHARACTERISTIC_UUID, NULL, 0, SAMPLE_BATCH_MAX_LENGTH, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        MagConfig(MAG_CONFIG_CHARACTERISTIC_UUID, (uint8_t *)&Config),
+        MagCalibrationControl(MAG_CALIBRATION_CONTROL_CHARACTERISTIC_UUID, &CalibrationState, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY),
+        MagCalibrationValues(MAG_CALIBRATION_VALUES_CHARACTERISTIC_UUID, (uint8_t *)Calibration.coefficients()),
+        Suspended(false), FrameReadPending(false), Latest(), Raw()
     {
+        // The starting configuration of 80Hz, also the initial value of the config characteristic 
+        Config.Rate         = 0;
+        Config.Range        = 0;
+        Config.Oversampling = 0;
+        Config.Active       = 1;
+        Config.Filter       = SENSOR_FILTER_NONE;
+        Config.Decimation   = 1;
+        Config.Deadband     = SENSOR_CONFIG_DEFAULT_DEADBAND;
+        Config.MaxSilence   = SENSOR_CONFIG_DEFAULT_MAX_SILENCE;
+        Config.Encoding     = SAMPLE_CODEC_RAW;
+        
+        // Load the calibration saved in flash before the characteristics take their initial values 
+        Calibration.begin();
+        CalibrationState = Calibration.state();
+        
         // Assign the gatt characteristics to a GattCharacteristic instance 
-        GattCharacteristic *charTable[] = {&MagX,&MagY,&MagZ};
+        GattCharacteristic *charTable[] = {&MagX,&MagY,&MagZ,&MagBatch,&MagConfig,&MagCalibrationControl,&MagCalibrationValues};
         // Create an instance of a service for the magnetometer and associate the characteristics with it
         GattService         MagService(MAG_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
         // Add the service to the ble profile 
@@ -42,86 +80,263 @@ public:
         
         // Wake the accelerometer from sleep mode 
         // Step 1. Set bit 7 in CTRL_REG2 by writing 0x80 to register number 0x11   
-        char Data[8]; // Declare a buffer for data transfer    
-        int Status;
-        Data[0]=0x11;//Control Reg 2
-        Data[1]=0x80;
-        Status = i2c.write(MAG3110_ADDRESS,Data,2);    
+        WriteMAG3110Reset(i2cQueue);
         
-        // Step 2. Set bit 0 in CNTRL_REGA by writing 1 to register number 0x01
-        Data[0]=0x10; //Control Regsiter A 
-        Data[1]=1;
-        Status = i2c.write(MAG3110_ADDRESS,Data,2);  // Write data to register 
+        // Step 2. Set bit 0 in CNTRL_REGA with the starting data rate 
+        applyConfig();
     }
 
     GattAttribute::Handle_t getValueHandle() const {
         return MagX.getValueHandle();
     }
     
-    // Updates the value of the X characteristic 
-    void updateMagX(int16_t newValue) {
-        ble.gattServer().write(MagX.getValueHandle(), (uint8_t *)&newValue, sizeof(uint16_t));    
+    /// EnableDataReadyInterrupt ///
+    // The MAG3110 needs no interrupt setup, its INT1 pin always signals data ready 
+    // The data rate is lowered to suit the bluetooth link, the part must be in standby to change it 
+    void EnableDataReadyInterrupt()
+    {
+        Config.Rate = MAG3110_DATA_READY_RATE;
+        applyConfig();
+        ble.gattServer().write(MagConfig.getValueHandle(), (uint8_t *)&Config, SENSOR_CONFIG_LENGTH);
+    }
+    
+    /// Sleep ///
+    // Puts the MAG3110 in standby while motion wake has the micro:bit idling and wakes it again afterwards 
+    // The configuration is kept, a client reading the config characteristic still sees it active 
+    void Sleep(bool Asleep)
+    {
+        Suspended = Asleep;
+        applyConfig();
+    }
+    
+    ///onSample///
+    // Attaches a handler that publish() calls with every sample read, after the calibration and before the filter and decimation 
+    // It sees every sample whether or not the batch characteristic is keeping up with the link 
+    void onSample(const Callback<void(const SensorSample &)> &Handler)
+    {
+        SampleHandler = Handler;
     }
-    // Updates the value of the Y characteristic 
-    void updateMagY(int16_t newValue) {
-        ble.gattServer().write(MagY.getValueHandle(), (uint8_t *)&newValue, sizeof(uint16_t));
+    
+    /// onDataWritten ///
+    // Called when a client writes to any characteristic, returns true if it was the config characteristic 
+    // A valid configuration is sent to the MAG3110 straight away, an invalid one is ignored 
+    // Either way the characteristic is rewritten so a client reading it back sees what the sensor is using 
+    // A calibration command is handed to Calibration and carried out by the next publish() 
+    bool onDataWritten(const GattWriteCallbackParams *params)
+    {
+        if ((params->handle == MagCalibrationControl.getValueHandle()) && (params->len == 1)){
+            Calibration.command(params->data[0]);
+            return false;
+            }
+        if (params->handle != MagConfig.getValueHandle()){
+            return false;
+            }
+        if (SensorConfigLengthValid(params->len)){
+            SensorConfig NewConfig = Config;
+            memcpy(&NewConfig, params->data, params->len);
+            if (MAG3110ConfigValid(NewConfig)){
+                Config = NewConfig;
+                applyConfig();
+                }
+            }
+        ble.gattServer().write(MagConfig.getValueHandle(), (uint8_t *)&Config, SENSOR_CONFIG_LENGTH);
+        return true;
     }
-    // Updates the value of the Z characteristic 
-    void updateMagZ(int16_t newValue) {
-        ble.gattServer().write(MagZ.getValueHandle(), (uint8_t *)&newValue, sizeof(uint16_t));
+    
+    // Time between samples at the configured output data rate in microseconds 
+    uint32_t SamplePeriodUs() const {
+        return MAG3110SamplePeriodUs(Config);
+    }
+    
+    // Updates the value of the X characteristic if it has moved past the deadband 
+    void updateMagX(int16_t newValue, uint32_t Now) {
+        PublishX.publish(ble, MagX.getValueHandle(), newValue, Now);    
+    }
+    // Updates the value of the Y characteristic if it has moved past the deadband 
+    void updateMagY(int16_t newValue, uint32_t Now) {
+        PublishY.publish(ble, MagY.getValueHandle(), newValue, Now);
+    }
+    // Updates the value of the Z characteristic if it has moved past the deadband 
+    void updateMagZ(int16_t newValue, uint32_t Now) {
+        PublishZ.publish(ble, MagZ.getValueHandle(), newValue, Now);
     }
     
      ///poll///
     //Poll will get the value of the magnontometer for the x, y and z planes
-    //The values of the x, y and z planes are updated using i2c 
-    //The two functions used in i2c are i2c.write and i2c.read
-    
-    //i2c.write - The master writes to the slave using i2c, requires 4 parameters 
-    //Address   - The i2c device address that will be written to, the i2c address is in the variable MMA8653_ADDRESS 0x1D
-    //Data      - The internal register to write, remeber a write of the memory location that is to be read is required first in i2c  
-    //lenght    - The number of bytes to send, in the case below 1 byte will be written at a time the registers for the MSB's of the X, Y and Z planes
-    //repeated  - Default value is False,set True does not send stop condition at end of write, this means multiple i2c transactions can happen sequentially all teminated by 1 stop condition 
-      
-    //i2c.read  - Performs an i2c read transaction, requires 4 parameters 
-    //Address   - The i2c address of the devce that will be read, here MMA8653_ADDRESS 0x1D
-    //Data      - The internal register that's value will be read, in the MMA8653 it will be the X, Y and Z registers for accleration
-    //lenght    - The number of bytes to read, if one byte adress is given and lenght set to 2 bytes it will return the next value of next memory location along with value of original memeory location requested 
-    //repeated  - Default value is False, set True does not send a stop condition at end of read, this means multiple i2c transactions can happen sequentially all teminated by 1 stop condition 
+    //A read of the 6 output registers (0x01 to 0x06) is queued on i2cQueue, the register number 
+    //auto increments so the MSB and LSB of the X, Y and Z planes come back in one transaction 
+    //When the read completes onFrameRead() decodes the values and pushes them onto the sample ring 
+    //If the last read has not completed yet there is no need to queue another 
     void poll()
     {
-        char Data[8]; // Declare a buffer for data transfer    
-        int Status;
-        int16_t X;
-        
-        Data[0]=0x01;                                     // Register number 1 X_MSB
-        Status = i2c.write(MAG3110_ADDRESS,Data,1,true);  // Write register number
-        Status = i2c.read(MAG3110_ADDRESS,Data,2);        // Read register contents
-        X = (Data[0]<<8)+Data[1];                         // 2 bytes returned, shift by 8 bits and AND Least signficant byte to get 16 bit number 
-        
-        int16_t Y;
-        Data[0]=0x03;                                     // Register number 3 Y_MSB
-        Status = i2c.write(MAG3110_ADDRESS,Data,1,true);  // Write register number
-        Status = i2c.read(MAG3110_ADDRESS,Data,2);        // Read register contents
-        Y = (Data[0]<<8)+Data[1];                         // 2 bytes returned, shift by 8 bits and AND Least signficant byte to get 16 bit number 
-        
-        int16_t Z;
-        Data[0]=0x05;                                     // Register number 5 Z_MSB
-        Status = i2c.write(MAG3110_ADDRESS,Data,1,true);  // Write register number
-        Status = i2c.read(MAG3110_ADDRESS,Data,2);        // Read register contents
-        Z = (Data[0]<<8) +Data[1];                        // 2 bytes returned, shift by 8 bits and AND Least signficant byte to get 16 bit number
+        if (FrameReadPending || !Config.Active || Suspended){
+            return;
+            }
+        FrameReadPending = true;
+        FrameTimestamp = us_ticker_read();
+        if (!i2cQueue.Read(MAG3110_ADDRESS, SENSOR_FRAME_FIRST_REGISTER, FrameData, SENSOR_FRAME_LENGTH, callback(this, &MAGService::onFrameRead))){
+            FrameReadPending = false;
+            }
+    }
+    
+    // Returns true while a read queued by poll() has not completed 
+    bool ReadPending() const {
+        return FrameReadPending;
+    }
+    
+    ///publish///
+    // Called from the main loop, drains the samples read since the last call 
+    // Every sample is corrected with the hard and soft iron calibration, see MagCalibration.h 
+    // Every sample is run through the filter selected by the config characteristic, see SensorFilter.h 
+    // Every sample left after decimation goes into the batch characteristic, a full batch is notified straight away and a part 
+    // filled one once its first sample is SAMPLE_BATCH_MAX_LATENCY_US old 
+    // The ring is emptied every time whatever the link is doing, if the bluetooth stack has no room for the 
+    // notification only the filtered samples wait, in Batches, see BatchQueue.h 
+    // The X, Y and Z characteristics hold a single value so only the newest sample is written to them, 
+    // and only once it has moved past the deadband or the characteristic has been silent too long 
+    void publish()
+    {
+        // Carry out any calibration command and let the client know the new state and coefficients 
+        if (Calibration.update()){
+            CalibrationState = Calibration.state();
+            ble.gattServer().write(MagCalibrationControl.getValueHandle(), &CalibrationState, sizeof(uint8_t));
+            ble.gattServer().write(MagCalibrationValues.getValueHandle(), Calibration.coefficients(), MAG_CALIBRATION_COEFFICIENTS_LENGTH);
+            }
         
-        //Update the X,Y and Z characteristics after they have been read
-        updateMagX(X);
-        updateMagY(Y);
-        updateMagZ(Z);        
+        bool NewSample = false;
+        bool NewRaw = false;
+        SensorSample Sample;
+        SensorSample Newest;
+        SensorSample NewestRaw;
+        while (Samples.pop(Sample)){
+            Calibration.process(Sample.Frame);
+            if (SampleHandler){
+                SampleHandler(Sample);
+                }
+            NewestRaw = Sample;
+            NewRaw = true;
+            if (!Filter.process(Sample.Frame, Sample.Frame)){
+                continue;
+                }
+            Batches.add(Sample);
+            Newest = Sample;
+            NewSample = true;
+            }
+        Batches.flush(us_ticker_read(), callback(this, &MAGService::sendBatch));
+        if (NewRaw){
+            Raw.write(NewestRaw);
+            }
+        if (!NewSample){
+            return;
+            }
+        // Every other consumer picks the sample up from the cache 
+        Latest.write(Newest);
         
+        //Update the X,Y and Z characteristics 
+        uint32_t Now = us_ticker_read();
+        updateMagX(Newest.Frame.X, Now);
+        updateMagY(Newest.Frame.Y, Now);
+        updateMagZ(Newest.Frame.Z, Now);        
+    }
+    
+    // Number of samples dropped because publish() fell behind the sensor 
+    uint32_t Overruns() const {
+        return Samples.overruns();
+    }
+    
+    // Number of filtered samples left out of the batch characteristic because the link fell behind 
+    uint32_t BatchDrops() const {
+        return Batches.dropped();
+    }
+    
+    // The newest sample published and its sequence number, all zero until the first one 
+    // Safe to read from any context, see SampleCache.h 
+    const SampleCache<SensorSample> &LatestSample() const {
+        return Latest;
+    }
+    
+    // The newest sample read, calibrated but not filtered, for the heading 
+    // A high pass filter would take gravity out and the others add lag, see HeadingService.h 
+    const SampleCache<SensorSample> &RawSample() const {
+        return Raw;
     }
 //Private variables of class 
 private:
+    /// onFrameRead ///
+    // Called by i2cQueue when the read queued by poll() has completed, Status is 0 if it succeeded 
+    // Each plane is a 16 bit number, MSB first, the sample is pushed onto the ring for publish() 
+    void onFrameRead(int Status)
+    {
+        FrameReadPending = false;
+        if (Status != 0){
+            return;
+            }
+        SensorSample Sample;
+        Sample.Timestamp = FrameTimestamp;
+        Sample.Frame     = DecodeMAG3110Frame(FrameData);
+        Samples.push(Sample);
+    }
+    
+    /// sendBatch ///
+    // Notifies the batch, returns false if the bluetooth stack is out of buffers and it must be sent later 
+    // The nRF51 port also returns BLE_STACK_BUSY when nobody is connected, so busy only means "try again" 
+    // while there is a link. With no link, or any other error (the client is not listening), the batch is dropped 
+    bool sendBatch(const SampleBatch &Batch)
+    {
+        ble_error_t Error = ble.gattServer().write(MagBatch.getValueHandle(), Batch.data(), Batch.length());
+        return !((Error == BLE_STACK_BUSY) && ble.gap().getState().connected);
+    }
+    
+    /// applyConfig ///
+    // Queues the writes to put Config into the MAG3110, see WriteMAG3110Config() in SensorRegisters.h 
+    // The filter, deadband and encoding settings are handed to Filter, the publishers and Batches 
+    // While put in standby by Sleep() the part is left inactive whatever Config says 
+    void applyConfig()
+    {
+        Filter.configure(Config.Filter, Config.Decimation);
+        Batches.setEncoding(Config.Encoding);
+        PublishX.configure(Config.Deadband, Config.MaxSilence * 1000000UL);
+        PublishY.configure(Config.Deadband, Config.MaxSilence * 1000000UL);
+        PublishZ.configure(Config.Deadband, Config.MaxSilence * 1000000UL);
+        WriteMAG3110Config(i2cQueue, Config, !Suspended && Config.Active);
+    }
+    
     BLEDevice &ble;
     ReadOnlyGattCharacteristic<int16_t>  MagX;
     ReadOnlyGattCharacteristic<int16_t>  MagY;
     ReadOnlyGattCharacteristic<int16_t>  MagZ;
+    GattCharacteristic                   MagBatch;
+    ReadWriteArrayGattCharacteristic<uint8_t, SENSOR_CONFIG_LENGTH> MagConfig;
+    ReadWriteGattCharacteristic<uint8_t> MagCalibrationControl;
+    ReadOnlyArrayGattCharacteristic<uint8_t, MAG_CALIBRATION_COEFFICIENTS_LENGTH> MagCalibrationValues;
+    SensorConfig                         Config;
+    // True while put in standby by Sleep() 
+    bool                                 Suspended;
+    
+    // Hard and soft iron calibration applied to every sample and its state as read by a client 
+    MagCalibration                       Calibration;
+    uint8_t                              CalibrationState;
+    
+    // Raw register contents for the read queued by poll() 
+    char FrameData[SENSOR_FRAME_LENGTH];
+    uint32_t FrameTimestamp;
+    volatile bool FrameReadPending;
+    
+    // Samples read but not yet published, the filter they pass through on the way out, 
+    // the filtered samples waiting for the batch characteristic, the newest sample published and the newest read 
+    SampleRing<SensorSample, 16> Samples;
+    SensorFilter Filter;
+    
+    // Decide when each of the X, Y and Z characteristics is worth writing 
+    DeadbandPublisher<int16_t> PublishX;
+    DeadbandPublisher<int16_t> PublishY;
+    DeadbandPublisher<int16_t> PublishZ;
+    BatchQueue Batches;
+    SampleCache<SensorSample> Latest;
+    SampleCache<SensorSample> Raw;
+    
+    // Called with every sample read, see onSample() 
+    Callback<void(const SensorSample &)> SampleHandler;
 };
 
 #endif /* #ifndef __BLE_ACCEL_SERVICE_H__ */
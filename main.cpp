@@ -4,8 +4,8 @@
 
 //Description//
 // Used to connect the BBC microbit to a phone/computer through bluetooth
-// The services enabled are the accelerometer, the magnetometer, the LED and 
-// button A 
+// The services enabled are the accelerometer, the magnetometer, the compass heading, gestures, 
+// i2c diagnostics, the LED and button A 
 
 //Useful Resources//
 // MBED API                         - https://os.mbed.com/docs/mbed-os/v5.14/apis/index.html
@@ -23,20 +23,28 @@
 #include "ButtonAService.h" //Handles the Button A bluetooth Service and characteristsics 
 #include "accelService.h"   //Handles the Accelerometer bluetooth Service and characteristsics 
 #include "magservice.h"     //Handles the Magnetometer bluetooth Service and characteristsics 
+#include "HeadingService.h" //Handles the compass heading bluetooth Service and characteristsics 
+#include "DiagnosticsService.h" //Handles the i2c diagnostics bluetooth Service and characteristsics 
+#include "GestureService.h" //Handles the gesture bluetooth Service and characteristsics 
+#include "SpectrumService.h" //Handles the vibration spectrum bluetooth Service and characteristsics 
+#include "StatsService.h" //Handles the windowed statistics bluetooth Service and characteristsics 
+#include "DisplayService.h" //Handles the LED display bluetooth Service and characteristsics 
+#include "SerialStream.h" //Frames the samples for the binary serial stream 
 
 
-// The LED's which will illuminate:
-// alivenessLED - Whne button A pressed 
-// actuatedLED  - Write to LED over bluetooth
-DigitalOut col(P0_4, 0);
-DigitalOut alivenessLED(P0_13, 0);
-DigitalOut actuatedLED(P0_14, 0);
+// The LED's which will illuminate, single LEDs in the corners of the display kept lit over the arrow:
+// alivenessLED - Whne button A pressed, top left 
+// actuatedLED  - Write to LED over bluetooth, top right 
+const int ALIVENESS_LED_ROW = 0;
+const int ALIVENESS_LED_COL = 0;
+const int ACTUATED_LED_ROW  = 0;
+const int ACTUATED_LED_COL  = 4;
 
 // The device name that will appear to phone/computer when connecting through bluetooth
 const static char     DEVICE_NAME[] = "WarrenBBC";
 
 // uuid_list - array 16 bit integers, these will be the UUID (Universal Unique Identification Number) of each of the bluetooth enabled services 
-static const uint16_t uuid16_list[] = {LEDService::LED_SERVICE_UUID,ACCELService::ACCEL_SERVICE_UUID,ButtonAService::BUTTONA_SERVICE_UUID,MAGService::MAG_SERVICE_UUID};
+static const uint16_t uuid16_list[] = {LEDService::LED_SERVICE_UUID,ACCELService::ACCEL_SERVICE_UUID,ButtonAService::BUTTONA_SERVICE_UUID,MAGService::MAG_SERVICE_UUID,HeadingService::HEADING_SERVICE_UUID};
 //static const uint16_t uuid16_list[] = {0xA012,0xFFF3};
 
 // Pointers to the services 
@@ -45,59 +53,331 @@ LEDService *ledServicePtr;
 ButtonAService * btnAServicePtr;
 ACCELService *AccelServicePtr;
 MAGService * MagServicePtr;
+HeadingService * HeadingServicePtr;
+DiagnosticsService * DiagnosticsServicePtr;
+GestureService * GestureServicePtr;
+SpectrumService * SpectrumServicePtr;
+StatsService * StatsServicePtr;
+DisplayService * DisplayServicePtr;
 
 // Ticker is used to genrate interrputs every set interval of time 
-// ticker  - Used for polling interupt to poll BLE services
+// ticker  - Used for polling interupt to poll the button service
 // ticker2 - Used for checking Accelrometer value to update direction on LED display
 Ticker ticker;
 Ticker ticker2;
 
-/// disconnectionCallback ///
-// This callback is associated with the ble object when the event of a dissconnect occurs
-// If a dissconnect occurs this fuction will tell the GAP peripheral (BBC Microbit) to 
-// begin adevertising again to GAP centrals (Phones/Computers)
-void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *params)
-{
-    BLE::Instance().gap().startAdvertising();
-}
+// Acquisition modes, select one by setting ACQUISITION_MODE 
+// ACQUIRE_POLLED     - The accelerometer and magnetometer are read by accelTicker and magTicker, every 0.1 and 1 
+//                      second until a client writes a configuration, then at the configured output data rate 
+// ACQUIRE_DATA_READY - The sensors interrupt the micro:bit through their INT1 pins when a new sample 
+//                      is ready, the sample is then read from the main loop straight away 
+#define ACQUIRE_POLLED     0
+#define ACQUIRE_DATA_READY 1
+#ifndef ACQUISITION_MODE
+#define ACQUISITION_MODE ACQUIRE_POLLED
+#endif
+
+#if ACQUISITION_MODE == ACQUIRE_DATA_READY
+// The data ready pins of the sensors 
+// accelInt - MMA8653 INT1, active low 
+// magInt   - MAG3110 INT1, active high 
+InterruptIn accelInt(ACCEL_INT1);
+InterruptIn magInt(MAG_INT1);
+#endif
+
+// Serial console output, select one by setting SERIAL_OUTPUT 
+// SERIAL_OUTPUT_TEXT   - The log (see Log.h) and the i2c stats for a person at a terminal, at 9600 baud 
+// SERIAL_OUTPUT_STREAM - Every sample of both sensors in binary packets at SERIAL_STREAM_BAUD, see SerialStream.h, 
+//                        for capturing the full sample rate on a PC with host/stream_capture.cpp 
+#define SERIAL_OUTPUT_TEXT   0
+#define SERIAL_OUTPUT_STREAM 1
+#ifndef SERIAL_OUTPUT
+#define SERIAL_OUTPUT SERIAL_OUTPUT_TEXT
+#endif
+
+#if SERIAL_OUTPUT == SERIAL_OUTPUT_STREAM
+// The fastest rate the interface chip of the micro:bit passes on to the PC reliably 
+#ifndef SERIAL_STREAM_BAUD
+#define SERIAL_STREAM_BAUD 115200
+#endif
+SerialStream sampleStream;
+#endif
+
+// The MMA8653 INT2 pin, active low, signals motion and the auto-sleep changing state, see MotionWake.h 
+// Idle is true while motion wake has stopped sampling because the board is still 
+InterruptIn motionInt(ACCEL_INT2);
+bool Idle = false;
+
+#if ACQUISITION_MODE == ACQUIRE_POLLED
+// accelTicker - Used for polling interupt to read the accelerometer 
+// magTicker   - Used for polling interupt to read the magnetometer 
+Ticker accelTicker;
+Ticker magTicker;
+
+// The sensors are never polled faster than this, higher output data rates need ACQUIRE_DATA_READY 
+// 100Hz is needed for the taps of the gesture service 
+const uint32_t MIN_POLL_PERIOD_US = 10000;
+
+// True once a client has changed the configuration of a sensor and the tickers follow its output data rate 
+bool Retuned = false;
+#endif
+
+// True while a client is subscribed to the gesture events or the spectrum peaks, both need the 
+// accelerometer sampled at MMA8653_GESTURE_RATE or faster, see listenersChanged() 
+bool GestureListening  = false;
+bool SpectrumListening = false;
 
 /// periodicCallback ///
 // This function is called every second through an intterupt genrated in the main()
-// The function will poll the value of each of the services using the poll functions in
-// the classes ACCELService, MAGService and ButtonAService which checks the value of each services charcteristics
+// The function will poll the value of the button using the poll function in
+// the class ButtonAService which checks the value of the services charcteristic
 // If button A is pressed it will turn on an LED 
 void periodicCallback(void)
 {
     btnAServicePtr->poll(); //polling checks all I/O for btn 
-    AccelServicePtr->poll();//polling checks all I/O for Accel
-    MagServicePtr->poll(); //polling checks all I/O for Mag
     //Turn on LED if btn push 
-    if (btnAServicePtr->GetButtonAState()){
-        alivenessLED =1;
-        }
-   else{
-      alivenessLED=0;
-        }       
+    ledMatrix.overlay(ALIVENESS_LED_ROW, ALIVENESS_LED_COL, btnAServicePtr->GetButtonAState());
 }
 
 //directionCallback//
 // Function called every 0.1 secs in the main through intterupt 
 // The function calls the Direction() function in the ACCELService class
-// which will update the arrow direction on the LED display 
+// which will update the arrow direction on the LED display from the newest cached accelerometer sample 
+// The arrow is left off while a client is drawing on the display 
 void directionCallback(){
-    AccelServicePtr->Direction();
+    if (!DisplayServicePtr->active()){
+        AccelServicePtr->Direction();
+        }
+    }
+
+#if ACQUISITION_MODE == ACQUIRE_POLLED
+//accelPollCallback//
+// Called by accelTicker, polling checks all I/O for Accel 
+void accelPollCallback(){
+    AccelServicePtr->poll();
+    }
+
+//magPollCallback//
+// Called by magTicker, polling checks all I/O for Mag 
+void magPollCallback(){
+    MagServicePtr->poll();
+    }
+
+//pollPeriodUs//
+// Time between polls of a sensor sampling every SamplePeriodUs, no faster than MIN_POLL_PERIOD_US 
+uint32_t pollPeriodUs(uint32_t SamplePeriodUs){
+    return (SamplePeriodUs > MIN_POLL_PERIOD_US) ? SamplePeriodUs : MIN_POLL_PERIOD_US;
+    }
+
+//startPolling//
+// Starts accelTicker and magTicker, every 0.1 and 1 second until a client changes the configuration of a 
+// sensor and then once per sample at the output data rate in use 
+// The accelerometer is polled every 0.1 secs as the arrow on the LED display is drawn from its samples, 
+// and once per sample while the gestures or the spectrum are listened to 
+void startPolling(){
+    if (Retuned || GestureListening || SpectrumListening){
+        accelTicker.attach_us(accelPollCallback, pollPeriodUs(AccelServicePtr->SamplePeriodUs()));
+        }
+    else{
+        accelTicker.attach(accelPollCallback, 0.1);
+        }
+    if (Retuned){
+        magTicker.attach_us(magPollCallback, pollPeriodUs(MagServicePtr->SamplePeriodUs()));
+        }
+    else{
+        magTicker.attach(magPollCallback, 1);
+        }
+    }
+#endif
+
+//rateChanged//
+// Called when the output data rate of a sensor changes, polls it at the new rate 
+// In data ready mode the sensor sets the pace itself 
+// While idle the tickers stay off, startPolling() picks the new rate up when the board moves 
+void rateChanged(){
+#if ACQUISITION_MODE == ACQUIRE_POLLED
+    if (!Idle){
+        startPolling();
+        }
+#endif
+    }
+
+//listenersChanged//
+// Raises the accelerometer output data rate while the gestures or the spectrum are listened to and 
+// drops it back to the configured rate once neither is, see ACCELService::RaiseRate() 
+void listenersChanged(){
+    AccelServicePtr->RaiseRate(GestureListening || SpectrumListening);
+    rateChanged();
+    }
+
+//subscriptionChanged//
+// Keeps track of the clients subscribed to the gesture events and the spectrum peaks 
+// Handle is the value handle of the characteristic whose notifications were turned on or off 
+void subscriptionChanged(GattAttribute::Handle_t Handle, bool Enabled){
+    if (Handle == GestureServicePtr->getValueHandle()){
+        GestureListening = Enabled;
+        }
+    else if (Handle == SpectrumServicePtr->getValueHandle()){
+        SpectrumListening = Enabled;
+        }
+    else{
+        return;
+        }
+    listenersChanged();
+    }
+
+//updatesEnabledCallback//
+// Called when a client turns on notifications of a characteristic 
+void updatesEnabledCallback(GattAttribute::Handle_t Handle){
+    subscriptionChanged(Handle, true);
+    }
+
+//updatesDisabledCallback//
+// Called when a client turns off notifications of a characteristic 
+void updatesDisabledCallback(GattAttribute::Handle_t Handle){
+    subscriptionChanged(Handle, false);
     }
 
+//updateRefresh//
+// Called from the main loop every time the micro:bit wakes up 
+// Stops the LED refresh while the board is idle and nobody is drawing on the display, the frame would only be 
+// blank and the refresh wakes the micro:bit 2000 times a second. Otherwise it keeps it running 
+// Checked on every wake up as a client can start or stop drawing, disconnect, or a scroll can end at any time 
+void updateRefresh(){
+    bool Dark = Idle && !DisplayServicePtr->active();
+    if (Dark && ledMatrix.running()){
+        ledMatrix.show(LED_FRAME_BLANK);
+        ledMatrix.stop();
+        }
+    else if (!Dark && !ledMatrix.running()){
+        ledMatrix.start();
+        }
+    }
+
+/// disconnectionCallback ///
+// This callback is associated with the ble object when the event of a dissconnect occurs
+// If a dissconnect occurs this fuction will tell the GAP peripheral (BBC Microbit) to 
+// begin adevertising again to GAP centrals (Phones/Computers)
+// Whatever the client drew on the LED display goes and the arrow comes back, and with nobody 
+// listening to the gestures or the spectrum the accelerometer goes back to its configured rate 
+void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *params)
+{
+    DisplayServicePtr->release();
+    GestureListening  = false;
+    SpectrumListening = false;
+    listenersChanged();
+    BLE::Instance().gap().startAdvertising();
+}
+
+//motionCallback//
+// Called on the falling edge of the MMA8653 INT2 pin when the board moves or the auto-sleep changes state 
+// MotionInterrupt() only queues the reads on i2cQueue so it is safe to call from the interrupt 
+void motionCallback(){
+    AccelServicePtr->MotionInterrupt();
+    }
+
+//serviceMotion//
+// Called from the main loop every time the micro:bit wakes up 
+// INT2 stays low until SYSMOD and FF_MT_SRC have been read, if it went low again while they were being 
+// read no new edge will be seen so queue the reads again if the pin is still asserted 
+// When motion wake puts the micro:bit to sleep the sensor tickers, the direction arrow and the 
+// magnetometer are stopped, leaving the bluetooth stack, the button ticker and INT2 to wake it 
+// The LED refresh is stopped too unless a client has drawn on the display, see updateRefresh() 
+// They are all started again when the board moves 
+void serviceMotion(){
+    if ((motionInt.read() == 0) && !AccelServicePtr->MotionPending()){
+        AccelServicePtr->MotionInterrupt();
+        }
+    if (AccelServicePtr->Asleep() == Idle){
+        return;
+        }
+    Idle = AccelServicePtr->Asleep();
+    MagServicePtr->Sleep(Idle);
+    LOG_INFO(Idle ? "Idle, no motion" : "Woken by motion");
+    if (Idle){
+        ticker2.detach();
+#if ACQUISITION_MODE == ACQUIRE_POLLED
+        accelTicker.detach();
+        magTicker.detach();
+#endif
+        }
+    else{
+        ticker2.attach(directionCallback, 0.1);
+#if ACQUISITION_MODE == ACQUIRE_POLLED
+        startPolling();
+#endif
+        }
+    }
+
+#if ACQUISITION_MODE == ACQUIRE_DATA_READY
+//accelDataReadyCallback//
+// Called on the falling edge of the MMA8653 INT1 pin when a new sample is ready 
+// poll() only queues the read on i2cQueue so it is safe to call from the interrupt 
+void accelDataReadyCallback(){
+    AccelServicePtr->poll();
+    }
+
+//magDataReadyCallback//
+// Called on the rising edge of the MAG3110 INT1 pin when a new sample is ready 
+void magDataReadyCallback(){
+    MagServicePtr->poll();
+    }
+
+//serviceDataReady//
+// Called from the main loop every time the micro:bit wakes up 
+// If a new sample landed while the last one was being read the data ready pin will not have 
+// toggled and no new edge would ever be seen, so queue another read if the pin is still asserted 
+void serviceDataReady(){
+    if ((accelInt.read() == 0) && !AccelServicePtr->ReadPending()){
+        AccelServicePtr->poll();
+        }
+    if ((magInt.read() == 1) && !MagServicePtr->ReadPending()){
+        MagServicePtr->poll();
+        }
+    }
+#endif
+
  
  /// onDataWrittenCallback ///
  // This callback is used if the GATT server (BBC Microbit) recieves a write from the GATT client (PC/Phone)
- // The only write enabled service is the LED service, if a right is recieved an LED will be turned on 
+ // If a write is recieved on the LED service an LED will be turned on 
+ // Writes to the config characteristics of the accelerometer and magnetometer reprogram the sensor 
 void onDataWrittenCallback(const GattWriteCallbackParams *params) {
     if ((params->handle == ledServicePtr->getValueHandle()) && (params->len == 1)) {
-        actuatedLED = *(params->data);
+        ledMatrix.overlay(ACTUATED_LED_ROW, ACTUATED_LED_COL, *(params->data) != 0);
+    }
+    else if (AccelServicePtr->onDataWritten(params) || MagServicePtr->onDataWritten(params)) {
+#if ACQUISITION_MODE == ACQUIRE_POLLED
+        Retuned = true;
+#endif
+        rateChanged();
+    }
+    else if (!DiagnosticsServicePtr->onDataWritten(params) && !SpectrumServicePtr->onDataWritten(params) &&
+             !StatsServicePtr->onDataWritten(params)) {
+        DisplayServicePtr->onDataWritten(params);
     }
 }
 
+ /// accelSampleCallback ///
+ // Called by the accelerometer service with every sample it reads, hands it to the services that work on the raw stream 
+void accelSampleCallback(const SensorSample &Sample) {
+    GestureServicePtr->process(Sample);
+    SpectrumServicePtr->process(Sample);
+    StatsServicePtr->processAccel(Sample);
+#if SERIAL_OUTPUT == SERIAL_OUTPUT_STREAM
+    sampleStream.write(SERIAL_STREAM_ACCEL, Sample);
+#endif
+}
+
+ /// magSampleCallback ///
+ // Called by the magnetometer service with every calibrated sample it reads 
+void magSampleCallback(const SensorSample &Sample) {
+    StatsServicePtr->processMag(Sample);
+#if SERIAL_OUTPUT == SERIAL_OUTPUT_STREAM
+    sampleStream.write(SERIAL_STREAM_MAG, Sample);
+#endif
+}
+
 void onDataReadCallback(const GattReadCallbackParams *params) {
   
 }
@@ -144,6 +424,10 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
     // In this case it goes to the callback onDataWrittenCallback
     ble.gattServer().onDataWritten(onDataWrittenCallback);
     
+    // Subscribing to the gesture events or the spectrum peaks raises the accelerometer output data rate 
+    ble.gattServer().onUpdatesEnabled(updatesEnabledCallback);
+    ble.gattServer().onUpdatesDisabled(updatesDisabledCallback);
+    
     // ble.gattServer().onDataRead(onDataReadCallback); // Nordic Soft device will not call this so have to poll instead
 
     // The LED's intial state can be configuered to logic high or logic low 
@@ -164,6 +448,45 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
     // Creates the Magnetometer service intialising instance of the MAGService class passing the ble object and intial value
     MagServicePtr = new MAGService(ble,InitialValue);
     
+    // Creates the heading service, it is fed the newest unfiltered samples of the two sensor services 
+    HeadingServicePtr = new HeadingService(ble);
+    
+    // Creates the diagnostics service, it reports the counters kept by the i2c queue and the samples lost by 
+    // both sensor services 
+    // It is left out of the advertising data, a client finds it once connected 
+    DiagnosticsServicePtr = new DiagnosticsService(ble, i2cQueue.Stats);
+    DiagnosticsServicePtr->watchSensor(MMA8653_ADDRESS >> 1, callback(AccelServicePtr, &ACCELService::Overruns),
+                                       callback(AccelServicePtr, &ACCELService::BatchDrops));
+    DiagnosticsServicePtr->watchSensor(MAG3110_ADDRESS >> 1, callback(MagServicePtr, &MAGService::Overruns),
+                                       callback(MagServicePtr, &MAGService::BatchDrops));
+    
+    // Creates the gesture service, every accelerometer sample is run through its step, shake and tap detection 
+    GestureServicePtr = new GestureService(ble);
+    
+    // Creates the spectrum service, it reports the strongest vibration frequencies in every window of accelerometer samples 
+    SpectrumServicePtr = new SpectrumService(ble);
+    
+    // Creates the stats service, it sums up every window of samples of both sensors 
+    StatsServicePtr = new StatsService(ble);
+    
+    // Creates the display service, a client can draw frames and animations on the LED display 
+    DisplayServicePtr = new DisplayService(ble, ledMatrix);
+    // Scroll the name the board advertises under across the display once, then the arrow takes over 
+    DisplayServicePtr->scroll(DEVICE_NAME, false);
+    AccelServicePtr->onSample(accelSampleCallback);
+    MagServicePtr->onSample(magSampleCallback);
+    
+#if ACQUISITION_MODE == ACQUIRE_DATA_READY
+    // Set up the sensors to signal when a new sample is ready and attach the data ready pins 
+    // Pins that are already asserted are picked up by serviceDataReady() in the main loop 
+    AccelServicePtr->EnableDataReadyInterrupt();
+    MagServicePtr->EnableDataReadyInterrupt();
+    accelInt.fall(accelDataReadyCallback);
+    magInt.rise(magDataReadyCallback);
+#endif
+    // The motion and auto-sleep interrupt, it only fires once a client has enabled motion wake 
+    motionInt.fall(motionCallback);
+    
     // The Generic access profile (GAP) portion of the code 
     // After the services have been set up and associated with the ble object they can be advertised
     // Remeber Gap splits the devices being connected into a peripheral and central 
@@ -183,10 +506,20 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
 int main(void)
 {
     // Ticker object is used to set up an innterupt
-    // ticker  - The intterupt calls the function periodicCallback which polls each of the services 
+    // ticker  - The intterupt calls the function periodicCallback which polls the button 
     // ticker2 - The interupt to update the arrow on the LED display 
     ticker.attach(periodicCallback, 1);
     ticker2.attach(directionCallback, 0.1);
+    // Start lighting the LED display, the arrow is drawn into its frame buffer by directionCallback 
+    ledMatrix.start();
+#if SERIAL_OUTPUT == SERIAL_OUTPUT_STREAM
+    pc.baud(SERIAL_STREAM_BAUD);
+    sampleStream.start(pc);
+#endif
+#if ACQUISITION_MODE == ACQUIRE_POLLED
+    // accelTicker and magTicker - Poll the sensors 
+    startPolling();
+#endif
 
     //Get software object that reprensts BLE on BBC
     BLE &ble = BLE::Instance();
@@ -202,5 +535,39 @@ int main(void)
     //BLE object has succesfully intalised Succesful 
     while (true) {
         ble.waitForEvent();
+        // Run the i2c transactions queued by the sensor services since the last wake up 
+        i2cQueue.process();
+        // Check for motion and go to sleep or wake up with the accelerometer 
+        serviceMotion();
+        i2cQueue.process();
+        // Turn the LED refresh off or on again to go with it 
+        updateRefresh();
+#if ACQUISITION_MODE == ACQUIRE_DATA_READY
+        // Read the sensors again if they still have new data after those transactions 
+        serviceDataReady();
+        i2cQueue.process();
+#endif
+        // Publish the samples read so far over bluetooth 
+        AccelServicePtr->publish();
+        MagServicePtr->publish();
+        // Work out the compass heading from the newest unfiltered samples of both sensors, straight from their caches 
+        HeadingServicePtr->update(AccelServicePtr->RawSample(), MagServicePtr->RawSample());
+        // Notify the summaries of any windows that have closed 
+        StatsServicePtr->update();
+        // Notify the next diagnostics record, pressing i on the serial console prints all of them 
+        DiagnosticsServicePtr->update();
+#if SERIAL_OUTPUT == SERIAL_OUTPUT_STREAM
+        // Start the TX interrupt sending the sample packets if it has stopped 
+        sampleStream.pump();
+#else
+        if (pc.readable() && (pc.getc() == 'i')) {
+            i2cQueue.Stats.dump(pc, us_ticker_read());
+            pc.printf("accel %lu overruns %lu batch drops, mag %lu overruns %lu batch drops\n\r",
+                      (unsigned long)AccelServicePtr->Overruns(), (unsigned long)AccelServicePtr->BatchDrops(),
+                      (unsigned long)MagServicePtr->Overruns(), (unsigned long)MagServicePtr->BatchDrops());
+        }
+        // Print what the serial port will take of the log without waiting, the rest goes out next time round 
+        Log.drain(pc);
+#endif
     }
 }